@@ -0,0 +1,625 @@
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "simctty/assembler.h"
+#include "simctty/cpu.h"
+#include "simctty/system.h"
+
+// Per-opcode and MMU microbenchmarks. Each benchmark is a short setup
+// followed by a loop of kUnroll copies of the instructions under test, which
+// is run for a fixed number of guest instructions. Results are printed as
+// JSON so runs can be diffed across commits.
+
+namespace {
+
+const uint32 kStartAddress = 0x2000;
+const uint32 kDataAddress = 0x10000;  // Page 8.
+const reg_t kBase = 30;               // Points at the data.
+const size_t kUnroll = 64;
+const size_t kSliceCycles = 20000;    // As main.cc.
+
+const uint16 kSR = 17;
+const uint16 kEPCR0 = 32;
+const uint16 kEEAR0 = 48;
+const uint16 kPCCR0 = 8 << 11;
+const uint16 kPCMR0 = (8 << 11) | 8;
+
+const uint32 kSRDME = 1 << 5;
+const uint32 kSRIME = 1 << 6;
+
+// MMU groups and TLB permission bits.
+const uint16 kDMMU = 1;
+const uint16 kIMMU = 2;
+const uint16 kDataSRESWE = 0x300;
+const uint16 kInstructionSXE = 0x40;
+
+const uint32 kPageSize = 0x2000;
+const uint32 kSetCount = 64;
+
+// Used only by the TLB miss handlers.
+const reg_t kHandlerAddress = 24;
+const reg_t kHandlerSet = 25;
+
+void LoadConstant(Assembler* a, reg_t d, uint32 value) {
+  a->l_movhi(d, value >> 16);
+  a->l_ori(d, d, value & 0xffff);
+}
+
+// Maps a page to itself in the DMMU or IMMU's TLB.
+void MapPage(Assembler* a, uint16 group, uint32 address, uint16 permissions) {
+  const uint32 page = address & ~(kPageSize - 1);
+  const uint16 set = (address / kPageSize) % kSetCount;
+  LoadConstant(a, kR1, page | 0x1);                      // Valid.
+  a->l_mtspr(kR0, kR1, (group << 11) | (512 + set));     // Match.
+  LoadConstant(a, kR1, page | permissions);
+  a->l_mtspr(kR0, kR1, (group << 11) | (640 + set));     // Translate.
+}
+
+void EnableMMU(Assembler* a, uint32 sr_bit) {
+  a->l_mfspr(kR1, kR0, kSR);
+  a->l_ori(kR1, kR1, sr_bit);
+  a->l_mtspr(kR0, kR1, kSR);
+}
+
+// TLB miss exception handler: maps the missing page to itself and retries.
+void RefillTLB(Assembler* a, uint16 group, uint16 permissions) {
+  a->l_mfspr(kHandlerAddress, kR0, kEEAR0);
+  a->l_srli(kHandlerSet, kHandlerAddress, 13);
+  a->l_andi(kHandlerSet, kHandlerSet, kSetCount - 1);
+  a->l_srli(kHandlerAddress, kHandlerAddress, 13);
+  a->l_slli(kHandlerAddress, kHandlerAddress, 13);
+  a->l_ori(kHandlerAddress, kHandlerAddress, 0x1);
+  a->l_mtspr(kHandlerSet, kHandlerAddress, (group << 11) | 512);
+  a->l_xori(kHandlerAddress, kHandlerAddress, 0x1 | permissions);
+  a->l_mtspr(kHandlerSet, kHandlerAddress, (group << 11) | 640);
+  a->l_rfe();
+}
+
+// Loops forever over kUnroll copies of emit's instructions.
+void Loop(Assembler* a, void (*emit)(Assembler* a, size_t i)) {
+  const size_t start = a->InstructionCount();
+  for (size_t i = 0; i < kUnroll; i++) {
+    emit(a, i);
+  }
+  a->l_j(start - a->InstructionCount());
+  a->l_nop();
+}
+
+// Registers r1-r8, varied so consecutive instructions are independent.
+reg_t Reg(size_t i) {
+  return 1 + i % 8;
+}
+
+void EmitAluReg(Assembler* a, size_t i) {
+  const Assembler::RegOpFunction kOps[] = {
+    &Assembler::l_add, &Assembler::l_sub, &Assembler::l_and,
+    &Assembler::l_or, &Assembler::l_xor,
+  };
+  (a->*kOps[i % 5])(Reg(i), Reg(i + 1), Reg(i + 2));
+}
+
+void EmitAluImm(Assembler* a, size_t i) {
+  switch (i % 4) {
+  case 0:
+    a->l_addi(Reg(i), Reg(i + 1), 3);
+    break;
+  case 1:
+    a->l_andi(Reg(i), Reg(i + 1), 0xff);
+    break;
+  case 2:
+    a->l_ori(Reg(i), Reg(i + 1), 0x10);
+    break;
+  default:
+    a->l_xori(Reg(i), Reg(i + 1), 0x55);
+    break;
+  }
+}
+
+void EmitShift(Assembler* a, size_t i) {
+  switch (i % 6) {
+  case 0:
+    a->l_sll(Reg(i), Reg(i + 1), Reg(i + 2));
+    break;
+  case 1:
+    a->l_srl(Reg(i), Reg(i + 1), Reg(i + 2));
+    break;
+  case 2:
+    a->l_sra(Reg(i), Reg(i + 1), Reg(i + 2));
+    break;
+  case 3:
+    a->l_slli(Reg(i), Reg(i + 1), 3);
+    break;
+  case 4:
+    a->l_srli(Reg(i), Reg(i + 1), 5);
+    break;
+  default:
+    a->l_srai(Reg(i), Reg(i + 1), 7);
+    break;
+  }
+}
+
+// Results go to r1-r4, leaving the operands in r5-r8 as set up so the
+// divides don't degenerate into divides by zero.
+void EmitMulDiv(Assembler* a, size_t i) {
+  const reg_t d = 1 + i % 4;
+  const reg_t s = 5 + i % 4;
+  const reg_t t = 5 + (i + 1) % 4;
+  switch (i % 3) {
+  case 0:
+    a->l_mul(d, s, t);
+    break;
+  case 1:
+    a->l_div(d, s, t);
+    break;
+  default:
+    a->l_divu(d, s, t);
+    break;
+  }
+}
+
+void EmitCompare(Assembler* a, size_t i) {
+  switch (i % 4) {
+  case 0:
+    a->l_sfeq(Reg(i), Reg(i + 1));
+    break;
+  case 1:
+    a->l_sfltu(Reg(i), Reg(i + 1));
+    break;
+  case 2:
+    a->l_sfgtsi(Reg(i), 5);
+    break;
+  default:
+    a->l_sfnei(Reg(i), 0);
+    break;
+  }
+}
+
+// l.bf over one instruction, taken or not as the flag was set up.
+void EmitBranch(Assembler* a, size_t i) {
+  a->l_bf(2);
+  a->l_nop();
+  a->l_nop();
+}
+
+void EmitLoad(Assembler* a, size_t i) {
+  const int16 offset = (i * 4) % 0x2000;
+  switch (i % 4) {
+  case 0:
+  case 1:
+    a->l_lwz(Reg(i), kBase, offset);
+    break;
+  case 2:
+    a->l_lhz(Reg(i), kBase, offset);
+    break;
+  default:
+    a->l_lbz(Reg(i), kBase, offset);
+    break;
+  }
+}
+
+void EmitStore(Assembler* a, size_t i) {
+  const int16 offset = (i * 4) % 0x2000;
+  switch (i % 4) {
+  case 0:
+  case 1:
+    a->l_sw(kBase, Reg(i), offset);
+    break;
+  case 2:
+    a->l_sh(kBase, Reg(i), offset);
+    break;
+  default:
+    a->l_sb(kBase, Reg(i), offset);
+    break;
+  }
+}
+
+void EmitMoveFromSpReg(Assembler* a, size_t i) {
+  a->l_mfspr(Reg(i), kR0, i % 2 ? kSR : kEPCR0);
+}
+
+void EmitMoveToSpReg(Assembler* a, size_t i) {
+  a->l_mtspr(kR0, Reg(i), i % 2 ? kEEAR0 : kEPCR0);
+}
+
+void BuildAluReg(Assembler* a) {
+  Loop(a, EmitAluReg);
+}
+
+void BuildAluImm(Assembler* a) {
+  Loop(a, EmitAluImm);
+}
+
+void BuildShift(Assembler* a) {
+  Loop(a, EmitShift);
+}
+
+void BuildMulDiv(Assembler* a) {
+  for (reg_t reg = 5; reg <= 8; reg++) {
+    LoadConstant(a, reg, 0x12345 * reg);
+  }
+  Loop(a, EmitMulDiv);
+}
+
+void BuildCompare(Assembler* a) {
+  Loop(a, EmitCompare);
+}
+
+void BuildBranchTaken(Assembler* a) {
+  a->l_sfeq(kR0, kR0);
+  Loop(a, EmitBranch);
+}
+
+void BuildBranchNotTaken(Assembler* a) {
+  a->l_sfne(kR0, kR0);
+  Loop(a, EmitBranch);
+}
+
+void BuildLoad(Assembler* a) {
+  LoadConstant(a, kBase, kDataAddress);
+  Loop(a, EmitLoad);
+}
+
+void BuildStore(Assembler* a) {
+  LoadConstant(a, kBase, kDataAddress);
+  Loop(a, EmitStore);
+}
+
+void BuildLoadMMU(Assembler* a) {
+  LoadConstant(a, kBase, kDataAddress);
+  MapPage(a, kDMMU, kDataAddress, kDataSRESWE);
+  EnableMMU(a, kSRDME);
+  Loop(a, EmitLoad);
+}
+
+void BuildStoreMMU(Assembler* a) {
+  LoadConstant(a, kBase, kDataAddress);
+  MapPage(a, kDMMU, kDataAddress, kDataSRESWE);
+  EnableMMU(a, kSRDME);
+  Loop(a, EmitStore);
+}
+
+void BuildMoveFromSpReg(Assembler* a) {
+  Loop(a, EmitMoveFromSpReg);
+}
+
+void BuildMoveToSpReg(Assembler* a) {
+  Loop(a, EmitMoveToSpReg);
+}
+
+// l.jal to a function that returns straight away with l.jr r9.
+void BuildCall(Assembler* a) {
+  const size_t start = a->InstructionCount();
+  const size_t function = start + 2 * kUnroll + 2;
+  for (size_t i = 0; i < kUnroll; i++) {
+    a->l_jal(function - a->InstructionCount());
+    a->l_nop();
+  }
+  a->l_j(start - a->InstructionCount());
+  a->l_nop();
+
+  a->l_jr(kR9);
+  a->l_nop();
+}
+
+// Working set walks: r30 steps by r27 (or by r30 * r26 + 12345 for a random
+// walk), and each access is to r28 | (r30 & r29), loads and stores in turn.
+const reg_t kWalkMultiplier = 26;
+const reg_t kWalkStride = 27;
+const reg_t kWalkBase = 28;
+const reg_t kWalkMask = 29;
+const reg_t kWalkOffset = 30;
+
+void EmitAccess(Assembler* a, size_t i) {
+  a->l_and(kR1, kWalkOffset, kWalkMask);
+  a->l_or(kR1, kR1, kWalkBase);
+  if (i % 2) {
+    a->l_sw(kR1, kR2, 0);
+  } else {
+    a->l_lwz(kR2, kR1, 0);
+  }
+}
+
+void EmitStridedAccess(Assembler* a, size_t i) {
+  a->l_add(kWalkOffset, kWalkOffset, kWalkStride);
+  EmitAccess(a, i);
+}
+
+void EmitRandomAccess(Assembler* a, size_t i) {
+  a->l_mul(kWalkOffset, kWalkOffset, kWalkMultiplier);
+  a->l_addi(kWalkOffset, kWalkOffset, 12345);
+  EmitAccess(a, i);
+}
+
+// Walks size bytes at base (aligned to size), stride bytes at a time or at
+// random if stride is 0. With the DMMU on, the first kSetCount pages are
+// mapped up front and the miss handler maps the rest as they're touched.
+void Walk(Assembler* a, uint32 base, uint32 size, uint32 stride,
+          bool is_mmu_enabled) {
+  LoadConstant(a, kWalkMultiplier, 1664525);
+  LoadConstant(a, kWalkStride, stride);
+  LoadConstant(a, kWalkBase, base);
+  LoadConstant(a, kWalkMask, (size - 1) & ~3);
+  LoadConstant(a, kWalkOffset, 0);
+  if (is_mmu_enabled) {
+    for (uint32 page = 0; page < kSetCount && page * kPageSize < size;
+         page++) {
+      MapPage(a, kDMMU, base + page * kPageSize, kDataSRESWE);
+    }
+    EnableMMU(a, kSRDME);
+  }
+  Loop(a, stride ? EmitStridedAccess : EmitRandomAccess);
+}
+
+// 64 pages from 1MB, one per set.
+void BuildSequentialMMUOff(Assembler* a) {
+  Walk(a, 0x100000, kSetCount * kPageSize, 4, false);
+}
+
+void BuildSequential(Assembler* a) {
+  Walk(a, 0x100000, kSetCount * kPageSize, 4, true);
+}
+
+// A page and a word on each time, so every access is to the next set.
+void BuildStrided(Assembler* a) {
+  Walk(a, 0x100000, kSetCount * kPageSize, kPageSize + 4, true);
+}
+
+// 128 pages at random, two to a set, so about half the accesses miss.
+void BuildRandom(Assembler* a) {
+  Walk(a, 0x400000, 2 * kSetCount * kPageSize, 0, true);
+}
+
+// Between two pages in the same set, so every access misses.
+void BuildDTLBMiss(Assembler* a) {
+  Walk(a, 0x100000, 2 * kSetCount * kPageSize, kSetCount * kPageSize, true);
+}
+
+// The ALU loop, fetched through the IMMU.
+void BuildIMMU(Assembler* a) {
+  MapPage(a, kIMMU, kStartAddress, kInstructionSXE);
+  EnableMMU(a, kSRIME);
+  Loop(a, EmitAluReg);
+}
+
+// Jumps between two pages in the same set, so every jump target misses.
+void BuildITLBMiss(Assembler* a) {
+  const uint32 far_address = kStartAddress + kSetCount * kPageSize;
+  MapPage(a, kIMMU, kStartAddress, kInstructionSXE);
+  EnableMMU(a, kSRIME);
+
+  const uint32 start = a->InstructionCount();
+  a->l_j(far_address / 4 - start);
+  a->l_nop();
+  a->SetAddress(far_address);
+  a->l_j(start - far_address / 4);
+  a->l_nop();
+}
+
+// l.jal to a function on the next page and back, through the IMMU (pages
+// mapped by the miss handler), so every call and return leaves the page.
+void BuildCallFar(Assembler* a) {
+  EnableMMU(a, kSRIME);
+
+  const size_t start = a->InstructionCount();
+  const size_t function = (kStartAddress + kPageSize) / 4;
+  for (size_t i = 0; i < kUnroll; i++) {
+    a->l_jal(function - a->InstructionCount());
+    a->l_nop();
+  }
+  a->l_j(start - a->InstructionCount());
+  a->l_nop();
+
+  a->SetAddress(function * 4);
+  a->l_jr(kR9);
+  a->l_nop();
+}
+
+struct Benchmark {
+  const char* name;
+  void (*build)(Assembler* a);
+};
+
+const Benchmark kBenchmarks[] = {
+  {"alu_reg", BuildAluReg},
+  {"alu_imm", BuildAluImm},
+  {"shift", BuildShift},
+  {"mul_div", BuildMulDiv},
+  {"compare", BuildCompare},
+  {"branch_taken", BuildBranchTaken},
+  {"branch_not_taken", BuildBranchNotTaken},
+  {"load", BuildLoad},
+  {"store", BuildStore},
+  {"load_mmu", BuildLoadMMU},
+  {"store_mmu", BuildStoreMMU},
+  {"mfspr", BuildMoveFromSpReg},
+  {"mtspr", BuildMoveToSpReg},
+  {"call", BuildCall},
+  {"dmmu_off_sequential", BuildSequentialMMUOff},
+  {"dmmu_sequential", BuildSequential},
+  {"dmmu_strided", BuildStrided},
+  {"dmmu_random", BuildRandom},
+  {"dtlb_miss", BuildDTLBMiss},
+  {"immu", BuildIMMU},
+  {"itlb_miss", BuildITLBMiss},
+  {"call_far", BuildCallFar},
+};
+
+uint64 NowNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// Counts host instructions retired in user mode by this thread, -1 if the
+// kernel won't let us.
+int OpenInstructionCounter() {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+struct Result {
+  uint64 instructions;
+  uint64 ns;
+  uint64 host_instructions;
+  uint64 tlb_misses;
+};
+
+// Returns false if the benchmark took an exception.
+bool Measure(const Benchmark& benchmark, uint64 count, int counter_fd,
+             Result* result) {
+  // TLB misses are refilled, any other exception halts.
+  Assembler a;
+  for (uint32 vector = 0x100; vector <= 0xf00; vector += 0x100) {
+    a.SetAddress(vector);
+    if (vector == 0x900) {
+      RefillTLB(&a, kDMMU, kDataSRESWE);
+    } else if (vector == 0xa00) {
+      RefillTLB(&a, kIMMU, kInstructionSXE);
+    } else {
+      a.l_nop(1);
+    }
+  }
+
+  // Performance counter 0 counts TLB misses.
+  a.SetAddress(kStartAddress);
+  a.l_ori(kR1, kR0, (1 << 2) | (1 << 12) | (1 << 13));  // CISM, DTLBM, ITLBM.
+  a.l_mtspr(kR0, kR1, kPCMR0);
+  benchmark.build(&a);
+
+  System system;
+  system.LoadImage(a.Instructions(), a.Size(), kStartAddress);
+  CPU* cpu = system.GetCPU();
+
+  // Past the setup, and warm.
+  bool is_running = system.Run(kSliceCycles);
+
+  const uint64 first = cpu->InstructionRunCount();
+  const uint32 first_tlb_misses = cpu->DebugSpReg(kPCCR0);
+  if (counter_fd >= 0) {
+    ioctl(counter_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter_fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  const uint64 start_ns = NowNs();
+
+  while (is_running && cpu->InstructionRunCount() - first < count) {
+    is_running = system.Run(kSliceCycles);
+  }
+
+  result->ns = NowNs() - start_ns;
+  result->host_instructions = 0;
+  if (counter_fd >= 0) {
+    ioctl(counter_fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(counter_fd, &result->host_instructions,
+             sizeof(result->host_instructions)) !=
+        sizeof(result->host_instructions)) {
+      result->host_instructions = 0;
+    }
+  }
+  result->instructions = cpu->InstructionRunCount() - first;
+  result->tlb_misses = cpu->DebugSpReg(kPCCR0) - first_tlb_misses;
+
+  if (!is_running) {
+    fprintf(stderr, "%s: exception at %#x\n", benchmark.name,
+            cpu->DebugSpReg(32));
+  }
+  return is_running;
+}
+
+}  // namespace
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [-n instructions] [-r repeats] [name...]\n"
+          "  -n  guest instructions per benchmark (default 20000000)\n"
+          "  -r  runs of each benchmark, the fastest is reported (default 3)\n"
+          "Runs the named benchmarks, or all of them, and prints JSON.\n",
+          argv0);
+}
+
+int main(int argc, char** argv) {
+  uint64 count = 20000000;
+  int repeats = 3;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+    switch (opt) {
+    case 'n':
+      count = strtoull(optarg, nullptr, 0);
+      break;
+    case 'r':
+      repeats = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (count == 0 || repeats <= 0) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const int counter_fd = OpenInstructionCounter();
+  if (counter_fd < 0) {
+    perror("perf_event_open, no host instruction counts");
+  }
+
+  printf("{\n  \"instructions\": %llu,\n  \"benchmarks\": [",
+         static_cast<unsigned long long>(count));
+  const char* separator = "\n";
+  for (size_t i = 0; i < sizeof(kBenchmarks) / sizeof(Benchmark); i++) {
+    const Benchmark& benchmark = kBenchmarks[i];
+    bool is_selected = optind == argc;
+    for (int arg = optind; arg < argc; arg++) {
+      is_selected |= strcmp(argv[arg], benchmark.name) == 0;
+    }
+    if (!is_selected) {
+      continue;
+    }
+
+    Result best;
+    for (int run = 0; run < repeats; run++) {
+      Result result;
+      if (!Measure(benchmark, count, counter_fd, &result)) {
+        return EXIT_FAILURE;
+      }
+      if (run == 0 || result.ns < best.ns) {
+        best = result;
+      }
+    }
+
+    const double instructions = static_cast<double>(best.instructions);
+    printf("%s    {\"name\": \"%s\", \"ns_per_instruction\": %.3f, "
+           "\"tlb_misses_per_instruction\": %.4f, "
+           "\"host_instructions_per_instruction\": ",
+           separator, benchmark.name, best.ns / instructions,
+           best.tlb_misses / instructions);
+    if (counter_fd >= 0) {
+      printf("%.2f}", best.host_instructions / instructions);
+    } else {
+      printf("null}");
+    }
+    separator = ",\n";
+    fflush(stdout);
+  }
+  printf("\n  ]\n}\n");
+
+  if (counter_fd >= 0) {
+    close(counter_fd);
+  }
+  return EXIT_SUCCESS;
+}
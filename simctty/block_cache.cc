@@ -0,0 +1,79 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/block_cache.h"
+
+BlockCache::BlockCache(const BlockRuntime::Guest& guest)
+  :
+    runtime_(BlockRuntime::Create(guest)),
+    compiler_(runtime_->State()),
+    blocks_(new Block[kBlockCount]) {
+  for (size_t i = 0; i < kBlockCount; i++) {
+    blocks_[i].phy = 1;
+    blocks_[i].hits = 0;
+    blocks_[i].is_compiled = false;
+    blocks_[i].slot = 0;
+    blocks_[i].generation = 0;
+    blocks_[i].compiled.length = 0;
+  }
+}
+
+BlockCache::~BlockCache() {
+  delete [] blocks_;
+  delete runtime_;
+}
+
+const BlockCache::Block* BlockCache::Lookup(uint32 phy, RAM* ram) {
+  Block* block = &blocks_[(phy >> 2) & (kBlockCount - 1)];
+  if (block->phy != phy) {
+    // Evict, the runtime slot is reused.
+    block->phy = phy;
+    block->hits = 0;
+    block->is_compiled = false;
+  }
+
+  if (block->is_compiled) {
+    if (block->generation == ram->CodeGeneration(phy)) {
+      return block;
+    }
+
+    // The page has been written to since.
+    block->hits = 0;
+    block->is_compiled = false;
+  }
+
+  if (++block->hits == kHotCount) {
+    Compile(block, ram);
+  }
+  return block->is_compiled ? block : nullptr;
+}
+
+const BlockCache::Block* BlockCache::Find(uint32 phy, const RAM* ram) const {
+  const Block* block = &blocks_[(phy >> 2) & (kBlockCount - 1)];
+  if (block->phy != phy || !block->is_compiled ||
+      block->generation != ram->CodeGeneration(phy)) {
+    return nullptr;
+  }
+  return block;
+}
+
+void BlockCache::Compile(Block* block, RAM* ram) {
+  const uint32* code = reinterpret_cast<const uint32*>(ram->Raw() + block->phy);
+  const size_t page_left = (0x2000 - (block->phy & 0x1fff)) / 4;
+  if (!compiler_.Compile(code, page_left, &block->compiled)) {
+    return;
+  }
+  const uint32 slot = runtime_->Instantiate(block->compiled.module,
+                                            block->slot);
+  if (!slot) {
+    return;
+  }
+  ram->SetIsCodePage(block->phy);
+  block->is_compiled = true;
+  block->slot = slot;
+  block->generation = ram->CodeGeneration(block->phy);
+}
+
+uint32 BlockCache::Run(const Block* block, uint32 pc) {
+  return runtime_->Run(block->slot, pc);
+}
@@ -0,0 +1,64 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_BLOCK_CACHE_H_
+#define SIMCTTY_BLOCK_CACHE_H_
+
+#include "simctty/block_compiler.h"
+#include "simctty/block_runtime.h"
+#include "simctty/ram.h"
+#include "simctty/types.h"
+
+// Compiled blocks, keyed by physical address. Built into the browser build
+// with -DWASM_BLOCKS=1 (SIMCTTY_WASM_BLOCKS), and natively into the blocks
+// test and lockstep check, which interpret them (block_runtime.h).
+//
+// A block start the CPU reaches kHotCount times is compiled to a wasm module
+// (block_compiler.h) and instantiated by the runtime, and CPU::Run enters it
+// through Run().
+//
+// Compiling a block marks its page as holding code (RAM::SetIsCodePage),
+// and each block keeps the page's generation at the time. A store to the
+// page, or an l.mtspr to ICBIR for it, moves the generation on, so code
+// that is rewritten or a page that is reused is compiled afresh rather than
+// run stale, while blocks on other pages are untouched.
+class BlockCache {
+ public:
+  struct Block {
+    uint32 phy;
+    uint32 hits;
+    bool is_compiled;   // Its run() is current.
+    uint32 slot;        // Runtime slot, 0 until first compiled.
+    uint32 generation;  // RAM::CodeGeneration() when compiled.
+    BlockCompiler::Block compiled;
+  };
+
+  explicit BlockCache(const BlockRuntime::Guest& guest);
+  ~BlockCache();
+
+  // The compiled block starting at phy, or nullptr while it is cold or
+  // can't be compiled.
+  const Block* Lookup(uint32 phy, RAM* ram);
+
+  // As Lookup(), but only finds a block already compiled and doesn't count
+  // towards compiling one.
+  const Block* Find(uint32 phy, const RAM* ram) const;
+
+  // Runs a compiled block entered at virtual address pc, which sets the
+  // guest's PC, registers and SR[F]. Returns run()'s result.
+  uint32 Run(const Block* block, uint32 pc);
+
+ private:
+  const static size_t kBlockCount = 4096;  // Direct mapped.
+  const static uint32 kHotCount = 64;
+
+  BlockRuntime* runtime_;
+  BlockCompiler compiler_;
+  Block* blocks_;
+
+  void Compile(Block* block, RAM* ram);
+
+  DISALLOW_COPY_AND_ASSIGN(BlockCache);
+};
+
+#endif  // SIMCTTY_BLOCK_CACHE_H_
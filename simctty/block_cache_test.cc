@@ -0,0 +1,381 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "simctty/assembler.h"
+#include "simctty/block_cache.h"
+#include "simctty/cpu.h"
+#include "simctty/lockstep.h"
+#include "simctty/ram.h"
+#include "simctty/system.h"
+
+using std::vector;
+
+namespace {
+
+const uint32 kCode = 0x4000;
+const uint32 kData = 0x100000;
+
+// Pads a with l.nop up to address.
+void PadTo(Assembler* a, uint32 address) {
+  while (a->Size() < address) {
+    a->l_nop();
+  }
+}
+
+// Sums words of kData in a loop, calling a subroutine on another page each
+// time round with the MMUs off, then halts.
+//
+//   0x100  r5 = kData
+//   0x108  loop: load, add, count, call
+//   0x11c  r3 != 1000: back to loop
+//   0x128  halt
+//   0x2000 sub: load, add, return
+vector<uint8> Program() {
+  Assembler a;
+  PadTo(&a, 0x100);
+  a.l_movhi(kR5, kData >> 16);
+  a.l_ori(kR5, kR5, kData & 0xffff);
+  a.l_lwz(kR6, kR5, 0);
+  a.l_add(kR7, kR7, kR6);
+  a.l_addi(kR3, kR3, 1);
+  a.l_jal((0x2000 - 0x114) / 4);
+  a.l_lhs(kR8, kR5, 2);  // Not compiled in the delay slot.
+  a.l_sfnei(kR3, 1000);
+  a.l_bf(-6);
+  a.l_nop();
+  a.l_nop(1);
+  PadTo(&a, 0x2000);
+  a.l_lbz(kR10, kR5, 7);
+  a.l_add(kR11, kR11, kR10);
+  a.l_jr(kR9);
+  a.l_nop();
+  return vector<uint8>(a.Instructions(), a.Instructions() + a.Size());
+}
+
+// Counts to 1000, calling a subroutine on another page each time round.
+//
+//   0x108  loop: count, call
+//   0x114  r3 != 1000: back to loop
+//   0x120  halt
+//   0x2000 sub: count, return
+vector<uint8> Calls() {
+  Assembler a;
+  PadTo(&a, 0x108);
+  a.l_addi(kR3, kR3, 1);
+  a.l_jal((0x2000 - 0x10c) / 4);
+  a.l_nop();
+  a.l_sfnei(kR3, 1000);
+  a.l_bf(-4);
+  a.l_nop();
+  a.l_nop(1);
+  PadTo(&a, 0x2000);
+  a.l_addi(kR4, kR4, 1);
+  a.l_jr(kR9);
+  a.l_nop();
+  return vector<uint8>(a.Instructions(), a.Instructions() + a.Size());
+}
+
+// Writes the data Program() reads.
+void StoreData(RAM* ram) {
+  Exception exception;
+  ram->Store32(kData, 0x11223344, &exception);
+  ram->Store32(kData + 4, 0x8899aabb, &exception);
+}
+
+// Boots Program() with its data.
+class ProgramLockstep : public Lockstep {
+ public:
+  ProgramLockstep() : Lockstep(Program(), 0x100, CPU::kEngineFast) {}
+
+ protected:
+  virtual void Boot(System* system, bool is_candidate) {
+    Lockstep::Boot(system, is_candidate);
+    StoreData(system->GetRAM());
+  }
+};
+
+}  // namespace
+
+class BlockCacheTest : public ::testing::Test {
+ public:
+  BlockCacheTest()
+    :
+      sr_(CPU::kSM),
+      pc_(0),
+      data_page_(0x1),
+      data_phy_(0),
+      cache_(Guest()) {
+    for (size_t i = 0; i < 32; i++) {
+      regs_[i] = 0;
+    }
+  }
+
+  BlockRuntime::Guest Guest() {
+    BlockRuntime::Guest guest;
+    guest.regs = regs_;
+    guest.sr = &sr_;
+    guest.pc = &pc_;
+    guest.data_page = &data_page_;
+    guest.data_phy = &data_phy_;
+    guest.ram = ram_.Raw();
+    return guest;
+  }
+
+  // Looks the block at kCode up until it is hot.
+  const BlockCache::Block* Heat() {
+    const BlockCache::Block* block = nullptr;
+    for (size_t i = 0; i < 64 && !block; i++) {
+      block = cache_.Lookup(kCode, &ram_);
+    }
+    return block;
+  }
+
+ protected:
+  Assembler asm_;
+  RAM ram_;
+  uint32 regs_[32];
+  uint32 sr_;
+  uint32 pc_;
+  uint32 data_page_;
+  uint32 data_phy_;
+  BlockCache cache_;
+
+  void Load() {
+    ram_.LoadImage(asm_.Instructions(), asm_.Size(), kCode);
+  }
+};
+
+// A program on a System, looking into its CPU's private block cache and
+// return stack.
+class CompiledBlockTest : public ::testing::Test {
+ public:
+  explicit CompiledBlockTest(const vector<uint8>& program = Program()) {
+    system_.LoadImage(program.data(), program.size(), 0x100);
+    StoreData(system_.GetRAM());
+  }
+
+  const BlockCache::Block* Find(uint32 phy) {
+    return system_.GetCPU()->block_cache_->Find(phy, system_.GetRAM());
+  }
+
+  // Runs the compiled block at the PC, if any. Returns instructions retired.
+  size_t Step() {
+    return system_.GetCPU()->RunCompiledBlock(1000);
+  }
+
+  // Fetches from the PC's page (MMU off), as the engine does before it
+  // reaches the next block boundary.
+  void Fetch() {
+    CPU* cpu = system_.GetCPU();
+    cpu->authed_page_ = cpu->pc_ & 0xffffe000;
+    cpu->authed_phy_ = cpu->authed_page_;
+  }
+
+  uint32 FetchPage() {
+    return system_.GetCPU()->authed_page_;
+  }
+
+  // The last return pushed, 0x1 if none.
+  uint32 TopReturn() {
+    CPU* cpu = system_.GetCPU();
+    return cpu->return_stack_[(cpu->return_top_ - 1) %
+                              CPU::kReturnStackSize].pc;
+  }
+
+  const BlockCache::Block* TopReturnBlock() {
+    CPU* cpu = system_.GetCPU();
+    return cpu->return_stack_[(cpu->return_top_ - 1) %
+                              CPU::kReturnStackSize].block;
+  }
+
+  // What the last return left for the next Step().
+  const BlockCache::Block* ReturnBlock() {
+    return system_.GetCPU()->return_block_;
+  }
+
+ protected:
+  System system_;
+};
+
+// Calls() run to its halt, so its blocks are compiled, then put back at the
+// top of its loop to be stepped through block by block.
+class ReturnStackTest : public CompiledBlockTest {
+ public:
+  ReturnStackTest() : CompiledBlockTest(Calls()) {}
+
+  virtual void SetUp() {
+    ASSERT_FALSE(system_.Run(100000));
+    ASSERT_EQ(0x120U, system_.GetCPU()->PC());
+    ASSERT_TRUE(Find(0x108) != nullptr);
+    ASSERT_TRUE(Find(0x114) != nullptr);
+    ASSERT_TRUE(Find(0x2000) != nullptr);
+
+    CPU* cpu = system_.GetCPU();
+    cpu->SetReg(kR3, 0);
+    cpu->SetPC(0x108);
+    Fetch();
+  }
+};
+
+TEST_F(BlockCacheTest, CompilesWhenHot) {
+  asm_.l_addi(kR1, kR1, 1);
+  asm_.l_ori(kR2, kR1, 0x10);
+  asm_.l_sw(kR0, kR2, 0x100);
+  Load();
+
+  for (size_t i = 0; i < 63; i++) {
+    ASSERT_TRUE(cache_.Lookup(kCode, &ram_) == nullptr);
+  }
+  ASSERT_TRUE(cache_.Find(kCode, &ram_) == nullptr);
+  const BlockCache::Block* block = cache_.Lookup(kCode, &ram_);
+  ASSERT_TRUE(block != nullptr);
+  ASSERT_EQ(block, cache_.Find(kCode, &ram_));
+  ASSERT_EQ(2U, block->compiled.length);
+
+  // Stops before the store.
+  ASSERT_EQ(2U, cache_.Run(block, 0xc0004000));
+  ASSERT_EQ(1U, regs_[1]);
+  ASSERT_EQ(0x11U, regs_[2]);
+  ASSERT_EQ(0xc0004008U, pc_);
+}
+
+TEST_F(BlockCacheTest, WriteToPageRecompiles) {
+  asm_.l_addi(kR1, kR1, 1);
+  asm_.l_sw(kR0, kR2, 0x100);
+  Load();
+  const BlockCache::Block* block = Heat();
+  ASSERT_TRUE(block != nullptr);
+
+  // Any store to the page, here making l.addi add 2.
+  Exception exception;
+  ram_.Store8(kCode + 3, 2, &exception);
+  ASSERT_TRUE(cache_.Find(kCode, &ram_) == nullptr);
+  ASSERT_TRUE(cache_.Lookup(kCode, &ram_) == nullptr);
+
+  block = Heat();
+  ASSERT_TRUE(block != nullptr);
+  ASSERT_EQ(1U, cache_.Run(block, kCode));
+  ASSERT_EQ(2U, regs_[1]);
+
+  // Blocks on other pages keep theirs.
+  ram_.Store32(kCode + 0x2000, 0, &exception);
+  ASSERT_EQ(block, cache_.Find(kCode, &ram_));
+}
+
+TEST_F(BlockCacheTest, LoadsWithDataMMUOff) {
+  asm_.l_lwz(kR2, kR1, 0);
+  asm_.l_lbz(kR3, kR1, 1);
+  asm_.l_addi(kR4, kR4, 1);
+  asm_.l_sw(kR0, kR2, 0x100);
+  Load();
+  Exception exception;
+  ram_.Store32(kData, 0x12345678, &exception);
+  regs_[1] = kData;
+  const BlockCache::Block* block = Heat();
+  ASSERT_TRUE(block != nullptr);
+
+  // Anywhere in RAM, at its physical address.
+  ASSERT_EQ(3U, cache_.Run(block, kCode));
+  ASSERT_EQ(0x12345678U, regs_[2]);
+  ASSERT_EQ(0x34U, regs_[3]);
+  ASSERT_EQ(1U, regs_[4]);
+
+  // Past the end of RAM is a device, left to the interpreter.
+  regs_[1] = kMaxRamAddress + 1;
+  ASSERT_EQ(0U, cache_.Run(block, kCode));
+  ASSERT_EQ(kCode, pc_);
+
+  // With the data MMU on, only on its fast path page.
+  regs_[1] = 0xc0000000 | kData;
+  sr_ |= CPU::kDME;
+  ASSERT_EQ(0U, cache_.Run(block, kCode));
+  data_page_ = 0xc0000000 | kData;
+  data_phy_ = kData;
+  ASSERT_EQ(3U, cache_.Run(block, kCode));
+  ASSERT_EQ(0x12345678U, regs_[2]);
+  ASSERT_EQ(2U, regs_[4]);
+}
+
+TEST_F(CompiledBlockTest, RunsHotBlocks) {
+  CPU* cpu = system_.GetCPU();
+  ASSERT_FALSE(system_.Run(100000));
+  ASSERT_EQ(0x128U, cpu->PC());
+
+  // The loop and the subroutine, loads and all.
+  ASSERT_TRUE(Find(0x108) != nullptr);
+  ASSERT_TRUE(Find(0x2000) != nullptr);
+  ASSERT_EQ(1000U, cpu->Reg(kR3));
+  ASSERT_EQ(1000U * 0x11223344, cpu->Reg(kR7));
+  ASSERT_EQ(1000U * 0xbb, cpu->Reg(kR11));
+}
+
+TEST(CompiledBlockLockstepTest, EnginesMatch) {
+  ProgramLockstep lockstep;
+  // Blocks are only entered with a block's length or more of the slice
+  // left, so each check runs them for a while.
+  lockstep.SetInterval(1000);
+  ASSERT_TRUE(lockstep.Run(20000));
+  ASSERT_TRUE(lockstep.IsHalted());
+}
+
+TEST_F(ReturnStackTest, PushesAndPops) {
+  CPU* cpu = system_.GetCPU();
+  ASSERT_EQ(0x1U, TopReturn());
+
+  // The call pushes where it returns to, and the block there.
+  ASSERT_EQ(3U, Step());
+  ASSERT_EQ(0x2000U, cpu->PC());
+  ASSERT_EQ(0x114U, TopReturn());
+  ASSERT_EQ(Find(0x114), TopReturnBlock());
+
+  // The return pops it, back onto the caller's page.
+  Fetch();
+  ASSERT_EQ(3U, Step());
+  ASSERT_EQ(0x114U, cpu->PC());
+  ASSERT_EQ(0x1U, TopReturn());
+  ASSERT_EQ(Find(0x114), ReturnBlock());
+  ASSERT_EQ(0U, FetchPage());
+
+  // Which carries straight on, without a fetch.
+  ASSERT_EQ(3U, Step());
+  ASSERT_EQ(0x108U, cpu->PC());
+  ASSERT_TRUE(ReturnBlock() == nullptr);
+  ASSERT_EQ(1U, cpu->Reg(kR3));
+  ASSERT_EQ(1001U, cpu->Reg(kR4));
+}
+
+TEST_F(ReturnStackTest, Mismatch) {
+  CPU* cpu = system_.GetCPU();
+  ASSERT_EQ(3U, Step());
+
+  // Returning elsewhere drops the entry, and leaves the fetch to the engine.
+  cpu->SetReg(kR9, 0x120);
+  Fetch();
+  ASSERT_EQ(3U, Step());
+  ASSERT_EQ(0x120U, cpu->PC());
+  ASSERT_EQ(0x1U, TopReturn());
+  ASSERT_TRUE(ReturnBlock() == nullptr);
+  ASSERT_EQ(0x2000U, FetchPage());
+  ASSERT_EQ(0U, Step());
+}
+
+TEST_F(ReturnStackTest, PageWrittenDuringCall) {
+  CPU* cpu = system_.GetCPU();
+  ASSERT_EQ(3U, Step());
+
+  // Any store to the caller's page, after the block there was pushed.
+  Exception exception;
+  system_.GetRAM()->Store32(0x1000, 0, &exception);
+
+  // The pushed block is stale, so isn't run, and the new one isn't hot yet.
+  Fetch();
+  ASSERT_EQ(3U, Step());
+  ASSERT_EQ(0x114U, cpu->PC());
+  ASSERT_EQ(0U, Step());
+  ASSERT_EQ(0x114U, cpu->PC());
+  ASSERT_EQ(1U, cpu->Reg(kR3));
+}
@@ -0,0 +1,643 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/block_compiler.h"
+
+#include <string>
+
+#include "simctty/ram.h"
+
+namespace {
+
+// WebAssembly opcodes used.
+const uint8 kIf = 0x04;
+const uint8 kEnd = 0x0b;
+const uint8 kReturn = 0x0f;
+const uint8 kSelect = 0x1b;
+const uint8 kLocalGet = 0x20;
+const uint8 kLocalSet = 0x21;
+const uint8 kLocalTee = 0x22;
+const uint8 kI32Load = 0x28;
+const uint8 kI32Load8S = 0x2c;
+const uint8 kI32Load8U = 0x2d;
+const uint8 kI32Load16S = 0x2e;
+const uint8 kI32Load16U = 0x2f;
+const uint8 kI32Store = 0x36;
+const uint8 kI32Const = 0x41;
+const uint8 kI32Eq = 0x46;
+const uint8 kI32Ne = 0x47;
+const uint8 kI32LtS = 0x48;
+const uint8 kI32LtU = 0x49;
+const uint8 kI32GtS = 0x4a;
+const uint8 kI32GtU = 0x4b;
+const uint8 kI32LeS = 0x4c;
+const uint8 kI32LeU = 0x4d;
+const uint8 kI32GeS = 0x4e;
+const uint8 kI32GeU = 0x4f;
+const uint8 kI32Add = 0x6a;
+const uint8 kI32Sub = 0x6b;
+const uint8 kI32Mul = 0x6c;
+const uint8 kI32And = 0x71;
+const uint8 kI32Or = 0x72;
+const uint8 kI32Xor = 0x73;
+const uint8 kI32Shl = 0x74;
+const uint8 kI32ShrS = 0x75;
+const uint8 kI32ShrU = 0x76;
+const uint8 kTypeI32 = 0x7f;
+const uint8 kTypeEmpty = 0x40;
+
+// Locals of run(): the parameter, then the register cache and temporaries.
+const uint32 kLocalPC = 0;
+const uint32 kLocalReg = 1;  // 32 of them.
+const uint32 kLocalSR = 33;
+const uint32 kLocalPage = 34;
+const uint32 kLocalPageMask = 35;
+const uint32 kLocalPhyDelta = 36;
+const uint32 kLocalEA = 37;
+const uint32 kLocalTarget = 38;
+const uint32 kLocalTaken = 39;
+const uint32 kLocalCount = 39;  // Not counting the parameter.
+
+const uint32 kFlagShift = 9;  // CPU::kF.
+const uint32 kDataMMUEnable = 1 << 5;  // CPU::kDME.
+const uint32 kRegMask = 0x1f;
+
+enum Kind {
+  kKindNone,
+  kKindAlu,
+  kKindLoad,
+  kKindBranch,
+};
+
+// Set flag compares, by the low 4 bits of opcode11 (l.sfeq... and
+// l.sfeqi...). 0 when there is no such instruction.
+const uint8 kCompareOps[16] = {
+  kI32Eq, kI32Ne, kI32GtU, kI32GeU, kI32LtU, kI32LeU, 0, 0,
+  0, 0, kI32GtS, kI32GeS, kI32LtS, kI32LeS, 0, 0,
+};
+
+uint32 Opcode(uint32 instruction) {
+  return (instruction >> 26) & 0x3f;
+}
+
+uint32 Opcode11(uint32 instruction) {
+  return (instruction >> 21) & 0x7ff;
+}
+
+uint32 Function(uint32 instruction) {
+  return (instruction & 0xf) | ((instruction & 0x3c0) >> 2);
+}
+
+Kind Classify(uint32 instruction) {
+  switch (Opcode(instruction)) {
+  case 0x00:  // l.j
+  case 0x01:  // l.jal
+  case 0x03:  // l.bnf
+  case 0x04:  // l.bf
+  case 0x11:  // l.jr
+  case 0x12:  // l.jalr
+    return kKindBranch;
+  case 0x05:  // l.nop, except the simulator's halt.
+    return (instruction & 0xffff) == 1 ? kKindNone : kKindAlu;
+  case 0x06:  // l.movhi
+  case 0x27:  // l.addi
+  case 0x29:  // l.andi
+  case 0x2a:  // l.ori
+  case 0x2b:  // l.xori
+    return kKindAlu;
+  case 0x21:  // l.lwz
+  case 0x23:  // l.lbz
+  case 0x24:  // l.lbs
+  case 0x25:  // l.lhz
+  case 0x26:  // l.lhs
+    return kKindLoad;
+  case 0x2e:  // l.slli, l.srli, l.srai
+    return ((instruction >> 6) & 0x3) != 3 ? kKindAlu : kKindNone;
+  case 0x2f:  // l.sf*i
+    return (Opcode11(instruction) & 0x7f0) == 0x5e0 &&
+        kCompareOps[Opcode11(instruction) & 0xf] ? kKindAlu : kKindNone;
+  case 0x38:
+    switch (Function(instruction)) {
+    case 0x00:  // l.add
+    case 0x02:  // l.sub
+    case 0x03:  // l.and
+    case 0x04:  // l.or
+    case 0x05:  // l.xor
+    case 0x08:  // l.sll
+    case 0x18:  // l.srl
+    case 0x28:  // l.sra
+    case 0xc6:  // l.mul
+      return kKindAlu;
+    }
+    return kKindNone;
+  case 0x39:  // l.sf*
+    return (Opcode11(instruction) & 0x7f0) == 0x720 &&
+        kCompareOps[Opcode11(instruction) & 0xf] ? kKindAlu : kKindNone;
+  }
+  return kKindNone;
+}
+
+// l.jal or l.jalr, which link the return address in r9.
+bool IsCall(uint32 instruction) {
+  return Opcode(instruction) == 0x01 || Opcode(instruction) == 0x12;
+}
+
+// l.jr r9, by convention a return.
+bool IsReturn(uint32 instruction) {
+  return Opcode(instruction) == 0x11 && ((instruction >> 11) & kRegMask) == 9;
+}
+
+// Builds the body of run(), tracking which registers are cached in locals
+// and which need writing back.
+class Emitter {
+ public:
+  explicit Emitter(const BlockCompiler::State& state)
+    :
+      state_(state),
+      is_sr_loaded_(false),
+      is_sr_dirty_(false),
+      is_mmu_loaded_(false) {
+    for (size_t i = 0; i < 32; i++) {
+      is_loaded_[i] = false;
+      is_dirty_[i] = false;
+    }
+  }
+
+  std::vector<uint8>* Code() {
+    return &code_;
+  }
+
+  void Alu(uint32 instruction) {
+    const reg_t d = (instruction >> 21) & kRegMask;
+    const reg_t a = (instruction >> 16) & kRegMask;
+    const reg_t b = (instruction >> 11) & kRegMask;
+    const int16 i = instruction & 0xffff;
+    const uint16 k = instruction & 0xffff;
+
+    switch (Opcode(instruction)) {
+    case 0x05:  // l.nop
+      return;
+    case 0x06:  // l.movhi
+      Const(static_cast<uint32>(k) << 16);
+      break;
+    case 0x27:  // l.addi
+      Binary(a, i, kI32Add);
+      break;
+    case 0x29:  // l.andi
+      Binary(a, k, kI32And);
+      break;
+    case 0x2a:  // l.ori
+      Binary(a, k, kI32Or);
+      break;
+    case 0x2b:  // l.xori
+      Binary(a, i, kI32Xor);
+      break;
+    case 0x2e: {
+      const uint8 kShifts[] = {kI32Shl, kI32ShrU, kI32ShrS};
+      Binary(a, instruction & 0x1f, kShifts[(instruction >> 6) & 0x3]);
+      break;
+    }
+    case 0x2f:  // l.sf*i
+      SetFlag(a, i, kCompareOps[Opcode11(instruction) & 0xf], false);
+      return;
+    case 0x38:
+      Reg(a);
+      Reg(b);
+      switch (Function(instruction)) {
+      case 0x00: Op(kI32Add); break;
+      case 0x02: Op(kI32Sub); break;
+      case 0x03: Op(kI32And); break;
+      case 0x04: Op(kI32Or); break;
+      case 0x05: Op(kI32Xor); break;
+      case 0x08: Op(kI32Shl); break;  // Shift counts are taken mod 32.
+      case 0x18: Op(kI32ShrU); break;
+      case 0x28: Op(kI32ShrS); break;
+      case 0xc6: Op(kI32Mul); break;
+      }
+      break;
+    case 0x39:  // l.sf*
+      SetFlag(a, b, kCompareOps[Opcode11(instruction) & 0xf], true);
+      return;
+    }
+
+    SetReg(d);
+  }
+
+  // Loads at index in the block, leaving it first if the address isn't on
+  // the fast path page or is misaligned. With the data MMU off all of RAM
+  // is the fast path, mapped 1:1.
+  void Load(uint32 instruction, uint32 index) {
+    const reg_t d = (instruction >> 21) & kRegMask;
+    const reg_t a = (instruction >> 16) & kRegMask;
+    const int16 i = instruction & 0xffff;
+
+    uint8 op;
+    uint32 align;
+    uint32 swizzle;
+    switch (Opcode(instruction)) {
+    case 0x21: op = kI32Load; align = 2; swizzle = 0; break;
+    case 0x23: op = kI32Load8U; align = 0; swizzle = 3; break;
+    case 0x24: op = kI32Load8S; align = 0; swizzle = 3; break;
+    case 0x25: op = kI32Load16U; align = 1; swizzle = 2; break;
+    default: op = kI32Load16S; align = 1; swizzle = 2; break;
+    }
+
+    Binary(a, i, kI32Add);
+    LocalSet(kLocalEA);
+
+    // The page the address must be on, as ea & mask == page, and what to
+    // add to it to find it in RAM. A block doesn't change SR[DME].
+    if (!is_mmu_loaded_) {
+      is_mmu_loaded_ = true;
+      LoadFrom(state_.data_page);
+      Const(0);
+      DataMMUEnabled();
+      Op(kSelect);
+      LocalSet(kLocalPage);
+      Const(0xffffe000);
+      Const(~kMaxRamAddress);
+      DataMMUEnabled();
+      Op(kSelect);
+      LocalSet(kLocalPageMask);
+      LoadFrom(state_.data_phy);
+      LoadFrom(state_.data_page);
+      Op(kI32Sub);
+      Const(0);
+      DataMMUEnabled();
+      Op(kSelect);
+      LocalSet(kLocalPhyDelta);
+    }
+
+    LocalGet(kLocalEA);
+    LocalGet(kLocalPageMask);
+    Op(kI32And);
+    LocalGet(kLocalPage);
+    Op(kI32Ne);
+    if (align) {
+      LocalGet(kLocalEA);
+      Const((1 << align) - 1);
+      Op(kI32And);
+      Op(kI32Or);
+    }
+    Op(kIf);
+    Op(kTypeEmpty);
+    Exit(index);
+    Op(kEnd);
+
+    // RAM holds words in host order, so bytes and halves are swizzled.
+    LocalGet(kLocalEA);
+    LocalGet(kLocalPhyDelta);
+    Op(kI32Add);
+    if (swizzle) {
+      Const(swizzle);
+      Op(kI32Xor);
+    }
+    Op(op);
+    U32(align);
+    U32(state_.ram);
+    SetReg(d);
+  }
+
+  // The jump or branch at index, and its delay slot, end the block.
+  void Branch(uint32 instruction, uint32 delay_slot, uint32 index) {
+    const reg_t b = (instruction >> 11) & kRegMask;
+    const int32 n = static_cast<int32>(instruction << 6) >> 4;
+    const uint32 pc = 4 * index;
+    const uint32 opcode = Opcode(instruction);
+    const bool is_conditional = opcode == 0x03 || opcode == 0x04;
+
+    // l.jal and l.jalr link before the target is read.
+    if (opcode == 0x01 || opcode == 0x12) {
+      PC(pc + 8);
+      SetReg(9);
+    }
+
+    if (opcode == 0x11 || opcode == 0x12) {
+      Reg(b);
+    } else {
+      PC(pc + n);
+    }
+    LocalSet(kLocalTarget);
+
+    // The condition is read before the delay slot can change it.
+    if (is_conditional) {
+      SR();
+      Const(kFlagShift);
+      Op(kI32ShrU);
+      Const(1);
+      Op(kI32And);
+      if (opcode == 0x03) {
+        Const(1);
+        Op(kI32Xor);
+      }
+      LocalSet(kLocalTaken);
+    }
+
+    Alu(delay_slot);
+
+    WriteBack();
+    Const(0);
+    LocalGet(kLocalTarget);
+    if (is_conditional) {
+      PC(pc + 8);
+      LocalGet(kLocalTaken);
+      Op(kSelect);
+    }
+    Store(state_.pc);
+
+    Const(index + 2);
+    if (is_conditional) {
+      LocalGet(kLocalTaken);
+      Const(16);
+      Op(kI32Shl);
+      Op(kI32Or);
+    } else {
+      Const(BlockCompiler::kTaken);
+      Op(kI32Or);
+    }
+    Op(kReturn);
+  }
+
+  // Leaves the block with index instructions retired.
+  void Exit(uint32 index) {
+    WriteBack();
+    Const(0);
+    PC(4 * index);
+    Store(state_.pc);
+    Const(index);
+    Op(kReturn);
+  }
+
+ private:
+  const BlockCompiler::State& state_;
+  std::vector<uint8> code_;
+
+  bool is_loaded_[32];
+  bool is_dirty_[32];
+  bool is_sr_loaded_;
+  bool is_sr_dirty_;
+  bool is_mmu_loaded_;
+
+  void Op(uint8 op) {
+    code_.push_back(op);
+  }
+
+  void U32(uint32 value) {
+    do {
+      const uint8 byte = value & 0x7f;
+      value >>= 7;
+      code_.push_back(value ? byte | 0x80 : byte);
+    } while (value);
+  }
+
+  void S32(int32 value) {
+    for (;;) {
+      const uint8 byte = value & 0x7f;
+      value >>= 7;  // Arithmetic.
+      if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40))) {
+        code_.push_back(byte);
+        return;
+      }
+      code_.push_back(byte | 0x80);
+    }
+  }
+
+  void Const(int32 value) {
+    Op(kI32Const);
+    S32(value);
+  }
+
+  void LocalGet(uint32 local) {
+    Op(kLocalGet);
+    U32(local);
+  }
+
+  void LocalSet(uint32 local) {
+    Op(kLocalSet);
+    U32(local);
+  }
+
+  void LoadFrom(uint32 address) {
+    Const(0);
+    Op(kI32Load);
+    U32(2);
+    U32(address);
+  }
+
+  // Stores the value on top of the stack, above a 0 base address.
+  void Store(uint32 address) {
+    Op(kI32Store);
+    U32(2);
+    U32(address);
+  }
+
+  // Virtual address offset bytes into the block.
+  void PC(uint32 offset) {
+    LocalGet(kLocalPC);
+    Const(offset);
+    Op(kI32Add);
+  }
+
+  void Reg(reg_t reg) {
+    if (is_loaded_[reg]) {
+      LocalGet(kLocalReg + reg);
+    } else {
+      is_loaded_[reg] = true;
+      LoadFrom(state_.regs + 4 * reg);
+      Op(kLocalTee);
+      U32(kLocalReg + reg);
+    }
+  }
+
+  void SetReg(reg_t reg) {
+    LocalSet(kLocalReg + reg);
+    is_loaded_[reg] = true;
+    is_dirty_[reg] = true;
+  }
+
+  void SR() {
+    if (is_sr_loaded_) {
+      LocalGet(kLocalSR);
+    } else {
+      is_sr_loaded_ = true;
+      LoadFrom(state_.sr);
+      Op(kLocalTee);
+      U32(kLocalSR);
+    }
+  }
+
+  // SR[DME], non-zero if the data MMU is on.
+  void DataMMUEnabled() {
+    SR();
+    Const(kDataMMUEnable);
+    Op(kI32And);
+  }
+
+  void Binary(reg_t a, int32 value, uint8 op) {
+    Reg(a);
+    Const(value);
+    Op(op);
+  }
+
+  // SR[F] = reg[a] compare (reg[b] or an immediate).
+  void SetFlag(reg_t a, int32 b, uint8 compare, bool is_reg) {
+    SR();
+    Const(~(1 << kFlagShift));
+    Op(kI32And);
+    Reg(a);
+    if (is_reg) {
+      Reg(b);
+    } else {
+      Const(b);
+    }
+    Op(compare);
+    Const(kFlagShift);
+    Op(kI32Shl);
+    Op(kI32Or);
+    LocalSet(kLocalSR);
+    is_sr_dirty_ = true;
+  }
+
+  void WriteBack() {
+    for (size_t i = 0; i < 32; i++) {
+      if (is_dirty_[i]) {
+        Const(0);
+        LocalGet(kLocalReg + i);
+        Store(state_.regs + 4 * i);
+      }
+    }
+    if (is_sr_dirty_) {
+      Const(0);
+      LocalGet(kLocalSR);
+      Store(state_.sr);
+    }
+  }
+
+  DISALLOW_COPY_AND_ASSIGN(Emitter);
+};
+
+void AppendU32(std::vector<uint8>* out, uint32 value) {
+  do {
+    const uint8 byte = value & 0x7f;
+    value >>= 7;
+    out->push_back(value ? byte | 0x80 : byte);
+  } while (value);
+}
+
+void AppendName(std::vector<uint8>* out, const char* name) {
+  const std::string value(name);
+  AppendU32(out, value.size());
+  out->insert(out->end(), value.begin(), value.end());
+}
+
+void AppendSection(std::vector<uint8>* out, uint8 id,
+                   const std::vector<uint8>& section) {
+  out->push_back(id);
+  AppendU32(out, section.size());
+  out->insert(out->end(), section.begin(), section.end());
+}
+
+// A module around run()'s body.
+void BuildModule(const std::vector<uint8>& code, std::vector<uint8>* module) {
+  const uint8 kHeader[] = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+  module->assign(kHeader, kHeader + sizeof(kHeader));
+
+  // (func (param i32) (result i32))
+  const uint8 kTypes[] = {0x01, 0x60, 0x01, kTypeI32, 0x01, kTypeI32};
+  AppendSection(module, 1, std::vector<uint8>(kTypes,
+                                              kTypes + sizeof(kTypes)));
+
+  std::vector<uint8> imports;
+  AppendU32(&imports, 1);
+  AppendName(&imports, "env");
+  AppendName(&imports, "memory");
+  imports.push_back(0x02);  // Memory, no minimum or maximum.
+  imports.push_back(0x00);
+  imports.push_back(0x00);
+  AppendSection(module, 2, imports);
+
+  const uint8 kFunctions[] = {0x01, 0x00};
+  AppendSection(module, 3, std::vector<uint8>(kFunctions,
+                                              kFunctions + sizeof(kFunctions)));
+
+  std::vector<uint8> exports;
+  AppendU32(&exports, 1);
+  AppendName(&exports, "run");
+  exports.push_back(0x00);  // Function 0.
+  exports.push_back(0x00);
+  AppendSection(module, 7, exports);
+
+  std::vector<uint8> body;
+  AppendU32(&body, 1);  // One run of locals, all i32.
+  AppendU32(&body, kLocalCount);
+  body.push_back(kTypeI32);
+  body.insert(body.end(), code.begin(), code.end());
+  body.push_back(kEnd);
+
+  std::vector<uint8> functions;
+  AppendU32(&functions, 1);
+  AppendU32(&functions, body.size());
+  functions.insert(functions.end(), body.begin(), body.end());
+  AppendSection(module, 10, functions);
+}
+
+}  // namespace
+
+BlockCompiler::BlockCompiler(const State& state)
+  :
+    state_(state) {
+}
+
+BlockCompiler::~BlockCompiler() {
+}
+
+bool BlockCompiler::Compile(const uint32* code, size_t count, Block* block) {
+  Emitter emitter(state_);
+
+  if (count > kMaxLength) {
+    count = kMaxLength;
+  }
+
+  block->length = 0;
+  block->is_branch_ending = false;
+  block->is_call_ending = false;
+  block->is_return_ending = false;
+  block->loads[0] = 0;
+
+  size_t loads = 0;
+  size_t i;
+  for (i = 0; i < count; i++) {
+    const Kind kind = Classify(code[i]);
+    if (kind == kKindBranch) {
+      if (i + 1 < count && Classify(code[i + 1]) == kKindAlu) {
+        emitter.Branch(code[i], code[i + 1], i);
+        block->is_branch_ending = true;
+        block->is_call_ending = IsCall(code[i]);
+        block->is_return_ending = IsReturn(code[i]);
+        block->loads[i + 1] = loads;
+        block->loads[i + 2] = loads;
+        i += 2;
+      }
+      break;
+    } else if (kind == kKindLoad) {
+      emitter.Load(code[i], i);
+      block->loads[i + 1] = ++loads;
+    } else if (kind == kKindAlu) {
+      emitter.Alu(code[i]);
+      block->loads[i + 1] = loads;
+    } else {
+      break;
+    }
+  }
+
+  if (i == 0) {
+    return false;
+  }
+
+  block->length = i;
+  if (!block->is_branch_ending) {
+    emitter.Exit(i);
+  }
+  BuildModule(*emitter.Code(), &block->module);
+  return true;
+}
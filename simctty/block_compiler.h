@@ -0,0 +1,69 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_BLOCK_COMPILER_H_
+#define SIMCTTY_BLOCK_COMPILER_H_
+
+#include <vector>
+
+#include "simctty/types.h"
+
+// Translates runs of guest instructions into WebAssembly modules, for the
+// block cache (block_cache.h).
+//
+// A block starts at a physical address and takes in straight line integer
+// instructions and loads, up to and including the first jump or branch and
+// its delay slot. Anything else (stores, SPRs, system calls, l.div...) ends
+// the block before it, and the interpreter carries on from there.
+//
+// The module imports the emulator's memory as env.memory and exports
+// run(pc) -> result, pc being the virtual address the block is entered at.
+// Guest registers are cached in wasm locals and written back on exit, along
+// with the new PC. Loads only go ahead on the data MMU's fast path page, as
+// MMU::Load32 does, or with the data MMU off (SR[DME] clear, as before Linux
+// turns it on) anywhere in RAM; a load that misses leaves the block just
+// before itself, for the interpreter to take any TLB miss, page fault or
+// device access.
+class BlockCompiler {
+ public:
+  // Where the guest state lives in the module's linear memory.
+  struct State {
+    uint32 regs;       // uint32[32], general purpose registers.
+    uint32 sr;         // uint32, supervision register (only F is changed).
+    uint32 pc;         // uint32, program counter, written on exit.
+    uint32 data_page;  // uint32, data MMU fast path virtual page, 1 if none.
+    uint32 data_phy;   // uint32, the physical page it maps to.
+    uint32 ram;        // Start of RAM.
+  };
+
+  const static size_t kMaxLength = 64;
+
+  // run() returns the number of instructions retired, with kTaken set if the
+  // block ended in a jump or branch that was taken.
+  const static uint32 kRetiredMask = 0xffff;
+  const static uint32 kTaken = 1 << 16;
+
+  struct Block {
+    size_t length;                  // Instructions, 0 if none compile.
+    bool is_branch_ending;          // Ends with a jump/branch + delay slot.
+    bool is_call_ending;            // ... which is l.jal or l.jalr.
+    bool is_return_ending;          // ... which is l.jr r9.
+    uint8 loads[kMaxLength + 1];    // Loads before each instruction.
+    std::vector<uint8> module;      // WebAssembly binary.
+  };
+
+  explicit BlockCompiler(const State& state);
+  ~BlockCompiler();
+
+  // Compiles the block at code, count instructions as RAM holds them (the
+  // rest of the page). Returns false when not even the first instruction
+  // can be compiled.
+  bool Compile(const uint32* code, size_t count, Block* block);
+
+ private:
+  const State state_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockCompiler);
+};
+
+#endif  // SIMCTTY_BLOCK_COMPILER_H_
@@ -0,0 +1,302 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include "simctty/assembler.h"
+#include "simctty/block_compiler.h"
+#include "simctty/cpu.h"
+#include "simctty/ram.h"
+#include "simctty/system.h"
+
+using std::string;
+
+namespace {
+
+// The first 64KB of RAM sits at State().ram in the image Node runs.
+const size_t kImageSize = 0x20000;
+const uint32 kDataPage = 0x4000;
+
+// Instantiates a module on a memory image and enters it at a PC, then
+// writes the memory back and prints run()'s result.
+const char kNodeRunner[] =
+    "var fs = require('fs');\n"
+    "var image = fs.readFileSync(process.argv[2]);\n"
+    "var memory = new WebAssembly.Memory({initial: image.length >> 16});\n"
+    "new Uint8Array(memory.buffer).set(image);\n"
+    "var module = new WebAssembly.Module(fs.readFileSync(process.argv[3]));\n"
+    "var instance = new WebAssembly.Instance(module, {env: {memory: memory}});\n"
+    "var result = instance.exports.run(Number(process.argv[4]));\n"
+    "fs.writeFileSync(process.argv[2], new Uint8Array(memory.buffer));\n"
+    "console.log(result >>> 0);\n";
+
+string TempFile(const char* contents, size_t length) {
+  char path[] = "/tmp/simctty_block_XXXXXX";
+  const int fd = mkstemp(path);
+  EXPECT_EQ(static_cast<ssize_t>(length), write(fd, contents, length));
+  close(fd);
+  return path;
+}
+
+}  // namespace
+
+class BlockCompilerTest : public ::testing::Test {
+ public:
+  BlockCompilerTest()
+    :
+      compiler_(State()) {
+  }
+
+  static BlockCompiler::State State() {
+    BlockCompiler::State state;
+    state.regs = 0x1000;
+    state.sr = 0x1080;
+    state.pc = 0x1084;
+    state.data_page = 0x1088;
+    state.data_phy = 0x108c;
+    state.ram = 0x10000;
+    return state;
+  }
+
+  bool Compile(size_t count = 16) {
+    ram_.LoadImage(asm_.Instructions(), asm_.Size());
+    return compiler_.Compile(reinterpret_cast<const uint32*>(ram_.Raw()),
+                             count, &block_);
+  }
+
+  // Runs block_, compiled from address 0, in Node with the data MMU's fast
+  // path on kDataPage, mapped 1:1. False if Node isn't installed.
+  bool RunInNode(const uint32* regs, uint32 sr, uint32* result,
+                 uint32* regs_out, uint32* sr_out, uint32* pc_out) {
+    if (system("node --version > /dev/null 2>&1") != 0) {
+      return false;
+    }
+    const BlockCompiler::State state = State();
+    string image(kImageSize, '\0');
+    memcpy(&image[state.regs], regs, 32 * sizeof(uint32));
+    memcpy(&image[state.sr], &sr, sizeof(sr));
+    memcpy(&image[state.data_page], &kDataPage, sizeof(kDataPage));
+    memcpy(&image[state.data_phy], &kDataPage, sizeof(kDataPage));
+    memcpy(&image[state.ram], ram_.Raw(), kImageSize - state.ram);
+
+    const string runner = TempFile(kNodeRunner, sizeof(kNodeRunner) - 1);
+    const string image_path = TempFile(image.data(), image.size());
+    const string module_path = TempFile(
+        reinterpret_cast<const char*>(block_.module.data()),
+        block_.module.size());
+    const string command = "node " + runner + " " + image_path + " " +
+        module_path + " 0";
+    FILE* output = popen(command.c_str(), "r");
+    EXPECT_EQ(1, fscanf(output, "%u", result));
+    EXPECT_EQ(0, pclose(output));
+
+    FILE* file = fopen(image_path.c_str(), "rb");
+    EXPECT_EQ(kImageSize, fread(&image[0], 1, kImageSize, file));
+    fclose(file);
+    unlink(runner.c_str());
+    unlink(image_path.c_str());
+    unlink(module_path.c_str());
+
+    memcpy(regs_out, &image[state.regs], 32 * sizeof(uint32));
+    memcpy(sr_out, &image[state.sr], sizeof(*sr_out));
+    memcpy(pc_out, &image[state.pc], sizeof(*pc_out));
+    return true;
+  }
+
+ protected:
+  Assembler asm_;
+  RAM ram_;
+  BlockCompiler compiler_;
+  BlockCompiler::Block block_;
+};
+
+TEST_F(BlockCompilerTest, EndsBeforeStore) {
+  asm_.l_addi(kR1, kR1, 1);
+  asm_.l_ori(kR2, kR1, 0x10);
+  asm_.l_sw(kR0, kR2, 0x100);
+  asm_.l_addi(kR1, kR1, 1);
+
+  ASSERT_TRUE(Compile());
+  ASSERT_EQ(2U, block_.length);
+  ASSERT_FALSE(block_.is_branch_ending);
+
+  const uint8 kMagic[] = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+  ASSERT_LT(sizeof(kMagic), block_.module.size());
+  ASSERT_TRUE(std::equal(kMagic, kMagic + sizeof(kMagic),
+                         block_.module.begin()));
+}
+
+TEST_F(BlockCompilerTest, EndsWithBranchAndDelaySlot) {
+  asm_.l_lwz(kR2, kR1, 0);
+  asm_.l_addi(kR1, kR1, 4);
+  asm_.l_lbz(kR3, kR1, 0);
+  asm_.l_sfne(kR2, kR3);
+  asm_.l_bf(-4);
+  asm_.l_addi(kR4, kR4, 1);  // Delay slot.
+  asm_.l_addi(kR5, kR5, 1);
+
+  ASSERT_TRUE(Compile());
+  ASSERT_EQ(6U, block_.length);
+  ASSERT_TRUE(block_.is_branch_ending);
+
+  const uint8 kLoads[] = {0, 1, 1, 2, 2, 2, 2};
+  for (size_t i = 0; i <= block_.length; i++) {
+    ASSERT_EQ(kLoads[i], block_.loads[i]);
+  }
+}
+
+TEST_F(BlockCompilerTest, BranchNeedsSimpleDelaySlot) {
+  asm_.l_addi(kR1, kR1, 1);
+  asm_.l_j(-1);
+  asm_.l_lwz(kR2, kR1, 0);  // Delay slot.
+
+  ASSERT_TRUE(Compile());
+  ASSERT_EQ(1U, block_.length);
+  ASSERT_FALSE(block_.is_branch_ending);
+}
+
+TEST_F(BlockCompilerTest, MarksCallsAndReturns) {
+  asm_.l_jal(4);
+  asm_.l_nop();  // Delay slot.
+  asm_.l_jr(kR9);
+  asm_.l_nop();  // Delay slot.
+  asm_.l_jr(kR3);
+  asm_.l_nop();  // Delay slot.
+
+  ASSERT_TRUE(Compile());
+  ASSERT_TRUE(block_.is_call_ending);
+  ASSERT_FALSE(block_.is_return_ending);
+
+  const uint32* code = reinterpret_cast<const uint32*>(ram_.Raw());
+  ASSERT_TRUE(compiler_.Compile(code + 2, 4, &block_));
+  ASSERT_FALSE(block_.is_call_ending);
+  ASSERT_TRUE(block_.is_return_ending);
+
+  ASSERT_TRUE(compiler_.Compile(code + 4, 2, &block_));
+  ASSERT_TRUE(block_.is_branch_ending);
+  ASSERT_FALSE(block_.is_call_ending);
+  ASSERT_FALSE(block_.is_return_ending);
+}
+
+TEST_F(BlockCompilerTest, StopsAtPageEnd) {
+  asm_.l_addi(kR1, kR1, 1);
+  asm_.l_j(-1);
+  asm_.l_nop();
+
+  ASSERT_TRUE(Compile(2));
+  ASSERT_EQ(1U, block_.length);
+}
+
+TEST_F(BlockCompilerTest, NothingToCompile) {
+  asm_.l_mfspr(kR1, kR0, 17);
+
+  ASSERT_FALSE(Compile());
+}
+
+// Random blocks of everything the compiler takes, run as wasm in Node and on
+// the interpreter from the same state, must leave the same registers, PC and
+// flag.
+TEST_F(BlockCompilerTest, MatchesInterpreter) {
+  std::mt19937 random(1);
+  for (int seed = 0; seed < 20; seed++) {
+    // r1-r15 are scratch, r16 points into the data page and r17 off it.
+    uint32 regs[32] = {0};
+    for (size_t i = 1; i < 16; i++) {
+      regs[i] = random() & 1 ? random() : random() & 0xff;
+    }
+    regs[16] = kDataPage + 0x100 + (random() & 0x1c00);
+    regs[17] = kDataPage + 0x2000;
+
+    asm_.Clear();
+    const size_t length = 8 + random() % 40;
+    for (size_t i = 0; i < length; i++) {
+      const reg_t d = 1 + random() % 15;
+      const reg_t a = random() % 16;
+      const reg_t b = random() % 16;
+      const int16 k = random();
+      switch (random() % 20) {
+      case 0: asm_.l_add(d, a, b); break;
+      case 1: asm_.l_sub(d, a, b); break;
+      case 2: asm_.l_and(d, a, b); break;
+      case 3: asm_.l_or(d, a, b); break;
+      case 4: asm_.l_xor(d, a, b); break;
+      case 5: asm_.l_sll(d, a, b); break;
+      case 6: asm_.l_srl(d, a, b); break;
+      case 7: asm_.l_sra(d, a, b); break;
+      case 8: asm_.l_mul(d, a, b); break;
+      case 9: asm_.l_addi(d, a, k); break;
+      case 10: asm_.l_andi(d, a, k); break;
+      case 11: asm_.l_ori(d, a, k); break;
+      case 12: asm_.l_xori(d, a, k); break;
+      case 13: asm_.l_slli(d, a, k & 0x1f); break;
+      case 14: asm_.l_srai(d, a, k & 0x1f); break;
+      case 15: asm_.l_movhi(d, k); break;
+      case 16: asm_.l_sfltu(a, b); break;
+      case 17: asm_.l_sfgesi(a, k); break;
+      case 18: asm_.l_lwz(d, 16 + random() % 8 / 7, (k & 0xfc) - 0x80); break;
+      default:
+        switch (random() % 4) {
+        case 0: asm_.l_lbz(d, 16, k & 0xff); break;
+        case 1: asm_.l_lbs(d, 16, k & 0xff); break;
+        case 2: asm_.l_lhz(d, 16, k & 0xfe); break;
+        default: asm_.l_lhs(d, 16, k & 0xfe); break;
+        }
+      }
+    }
+    if (random() & 1) {
+      if (random() & 1) {
+        asm_.l_bf(-4);
+      } else {
+        asm_.l_bnf(8);
+      }
+      asm_.l_addi(1 + random() % 15, random() % 16, random());  // Delay slot.
+    }
+
+    uint8 data[0x2000];
+    for (size_t i = 0; i < sizeof(data); i++) {
+      data[i] = random();
+    }
+    ram_.LoadImage(data, sizeof(data), kDataPage);
+    ASSERT_TRUE(Compile(asm_.InstructionCount()));
+
+    // With the data MMU on, loads only go ahead on its fast path page.
+    const uint32 sr = CPU::kFO | CPU::kSM | (seed & 1 ? CPU::kDME : 0);
+    uint32 result;
+    uint32 wasm_regs[32];
+    uint32 wasm_sr;
+    uint32 wasm_pc;
+    if (!RunInNode(regs, sr, &result, wasm_regs, &wasm_sr, &wasm_pc)) {
+      printf("Node isn't installed, compiled blocks not run.\n");
+      return;
+    }
+    // A first load off the data page leaves at once, if the MMU is on.
+    const size_t retired = result & BlockCompiler::kRetiredMask;
+    ASSERT_LE(retired, block_.length);
+
+    System system;
+    CPU* cpu = system.GetCPU();
+    system.GetRAM()->LoadImage(asm_.Instructions(), asm_.Size());
+    system.GetRAM()->LoadImage(data, sizeof(data), kDataPage);
+    for (reg_t i = 0; i < 32; i++) {
+      cpu->SetReg(i, regs[i]);
+    }
+    if (retired) {
+      cpu->Run(retired);
+    }
+
+    for (reg_t i = 0; i < 32; i++) {
+      ASSERT_EQ(cpu->Reg(i), wasm_regs[i]) << "seed " << seed << " r" << i;
+    }
+    ASSERT_EQ(cpu->PC(), wasm_pc) << "seed " << seed;
+    ASSERT_EQ(cpu->IsFlagSet(), (wasm_sr & CPU::kF) != 0) << "seed " << seed;
+  }
+}
@@ -0,0 +1,444 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/block_runtime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simctty/ram.h"
+
+using std::vector;
+
+namespace {
+
+// Where the guest state sits in the memory modules see.
+const uint32 kRegsAddress = 0x100;
+const uint32 kSRAddress = 0x180;
+const uint32 kPCAddress = 0x184;
+const uint32 kDataPageAddress = 0x188;
+const uint32 kDataPhyAddress = 0x18c;
+const uint32 kRAMAddress = 0x10000000;
+
+// WebAssembly opcodes BlockCompiler uses, the only ones run.
+const uint8 kIf = 0x04;
+const uint8 kEnd = 0x0b;
+const uint8 kReturn = 0x0f;
+const uint8 kSelect = 0x1b;
+const uint8 kLocalGet = 0x20;
+const uint8 kLocalSet = 0x21;
+const uint8 kLocalTee = 0x22;
+const uint8 kI32Load = 0x28;
+const uint8 kI32Load8S = 0x2c;
+const uint8 kI32Load8U = 0x2d;
+const uint8 kI32Load16S = 0x2e;
+const uint8 kI32Load16U = 0x2f;
+const uint8 kI32Store = 0x36;
+const uint8 kI32Const = 0x41;
+const uint8 kI32Eq = 0x46;
+const uint8 kI32Ne = 0x47;
+const uint8 kI32LtS = 0x48;
+const uint8 kI32LtU = 0x49;
+const uint8 kI32GtS = 0x4a;
+const uint8 kI32GtU = 0x4b;
+const uint8 kI32LeS = 0x4c;
+const uint8 kI32LeU = 0x4d;
+const uint8 kI32GeS = 0x4e;
+const uint8 kI32GeU = 0x4f;
+const uint8 kI32Add = 0x6a;
+const uint8 kI32Sub = 0x6b;
+const uint8 kI32Mul = 0x6c;
+const uint8 kI32And = 0x71;
+const uint8 kI32Or = 0x72;
+const uint8 kI32Xor = 0x73;
+const uint8 kI32Shl = 0x74;
+const uint8 kI32ShrS = 0x75;
+const uint8 kI32ShrU = 0x76;
+
+const uint8 kCodeSection = 10;
+const size_t kStackSize = 16;
+const size_t kMaxLocalCount = 64;
+
+// An instruction of run(), decoded.
+struct Instruction {
+  uint8 op;
+  uint32 immediate;  // Constant, local, memory offset, or for if its end.
+};
+
+// run() of an instantiated module.
+struct Function {
+  size_t local_count;  // Parameter included.
+  vector<Instruction> code;
+};
+
+// Reads modules BlockCompiler built; anything else is rejected.
+class Reader {
+ public:
+  Reader(const uint8* data, size_t size)
+    :
+      data_(data),
+      end_(data + size),
+      is_ok_(true) {
+  }
+
+  bool IsOk() const {
+    return is_ok_;
+  }
+
+  bool AtEnd() const {
+    return data_ == end_;
+  }
+
+  const uint8* Position() const {
+    return data_;
+  }
+
+  uint8 Byte() {
+    if (data_ == end_) {
+      is_ok_ = false;
+      return 0;
+    }
+    return *data_++;
+  }
+
+  uint32 U32() {
+    uint32 value = 0;
+    for (uint32 shift = 0; shift < 35; shift += 7) {
+      const uint8 byte = Byte();
+      value |= static_cast<uint32>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+    is_ok_ = false;
+    return 0;
+  }
+
+  int32 S32() {
+    uint32 value = 0;
+    for (uint32 shift = 0; shift < 35; shift += 7) {
+      const uint8 byte = Byte();
+      value |= static_cast<uint32>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        if (shift < 25 && (byte & 0x40)) {
+          value |= ~0u << (shift + 7);  // Sign extend.
+        }
+        return value;
+      }
+    }
+    is_ok_ = false;
+    return 0;
+  }
+
+  void Skip(size_t size) {
+    if (size > static_cast<size_t>(end_ - data_)) {
+      is_ok_ = false;
+      data_ = end_;
+    } else {
+      data_ += size;
+    }
+  }
+
+ private:
+  const uint8* data_;
+  const uint8* end_;
+  bool is_ok_;
+};
+
+// Decodes the body of run(), the module's only function.
+bool Decode(const vector<uint8>& module, Function* function) {
+  Reader reader(module.data(), module.size());
+  reader.Skip(8);  // Magic and version.
+  while (!reader.AtEnd() && reader.IsOk()) {
+    const uint8 id = reader.Byte();
+    const uint32 size = reader.U32();
+    if (id != kCodeSection) {
+      reader.Skip(size);
+      continue;
+    }
+
+    if (reader.U32() != 1) {
+      return false;
+    }
+    const uint32 body_size = reader.U32();
+    const uint8* body_end = reader.Position() + body_size;
+
+    function->local_count = 1;
+    const uint32 runs = reader.U32();
+    for (uint32 i = 0; i < runs; i++) {
+      function->local_count += reader.U32();
+      reader.Byte();  // All i32.
+    }
+    if (function->local_count > kMaxLocalCount) {
+      return false;
+    }
+
+    vector<size_t> ifs;  // Open if blocks.
+    function->code.clear();
+    while (reader.IsOk() && reader.Position() < body_end) {
+      Instruction instruction;
+      instruction.op = reader.Byte();
+      instruction.immediate = 0;
+      switch (instruction.op) {
+      case kIf:
+        reader.Byte();  // Block type, always empty.
+        ifs.push_back(function->code.size());
+        break;
+      case kEnd:
+        if (!ifs.empty()) {
+          function->code[ifs.back()].immediate = function->code.size();
+          ifs.pop_back();
+        }
+        break;
+      case kLocalGet:
+      case kLocalSet:
+      case kLocalTee:
+        instruction.immediate = reader.U32();
+        if (instruction.immediate >= function->local_count) {
+          return false;
+        }
+        break;
+      case kI32Load:
+      case kI32Load8S:
+      case kI32Load8U:
+      case kI32Load16S:
+      case kI32Load16U:
+      case kI32Store:
+        reader.U32();  // Alignment.
+        instruction.immediate = reader.U32();
+        break;
+      case kI32Const:
+        instruction.immediate = reader.S32();
+        break;
+      case kReturn:
+      case kSelect:
+      case kI32Eq:
+      case kI32Ne:
+      case kI32LtS:
+      case kI32LtU:
+      case kI32GtS:
+      case kI32GtU:
+      case kI32LeS:
+      case kI32LeU:
+      case kI32GeS:
+      case kI32GeU:
+      case kI32Add:
+      case kI32Sub:
+      case kI32Mul:
+      case kI32And:
+      case kI32Or:
+      case kI32Xor:
+      case kI32Shl:
+      case kI32ShrS:
+      case kI32ShrU:
+        break;
+      default:
+        return false;
+      }
+      function->code.push_back(instruction);
+    }
+    return reader.IsOk() && reader.Position() == body_end && ifs.empty();
+  }
+  return false;
+}
+
+class NativeBlockRuntime : public BlockRuntime {
+ public:
+  explicit NativeBlockRuntime(const Guest& guest)
+    :
+      guest_(guest),
+      functions_(1, nullptr) {
+  }
+
+  virtual ~NativeBlockRuntime() {
+    for (size_t i = 0; i < functions_.size(); i++) {
+      delete functions_[i];
+    }
+  }
+
+  virtual BlockCompiler::State State() const {
+    BlockCompiler::State state;
+    state.regs = kRegsAddress;
+    state.sr = kSRAddress;
+    state.pc = kPCAddress;
+    state.data_page = kDataPageAddress;
+    state.data_phy = kDataPhyAddress;
+    state.ram = kRAMAddress;
+    return state;
+  }
+
+  virtual uint32 Instantiate(const vector<uint8>& module, uint32 slot) {
+    Function* function = new Function;
+    if (!Decode(module, function)) {
+      delete function;
+      return 0;
+    }
+
+    if (slot == 0) {
+      slot = functions_.size();
+      functions_.push_back(function);
+    } else {
+      delete functions_[slot];
+      functions_[slot] = function;
+    }
+    return slot;
+  }
+
+  virtual uint32 Run(uint32 slot, uint32 pc) {
+    const Function& function = *functions_[slot];
+    uint32 locals[kMaxLocalCount] = {pc};
+
+    uint32 stack[kStackSize];
+    size_t top = 0;
+    for (size_t i = 0; i < function.code.size(); i++) {
+      const Instruction& instruction = function.code[i];
+      if (top == kStackSize) {
+        Trap("stack overflow");
+      }
+
+      if (instruction.op >= kI32Eq && instruction.op <= kI32ShrU) {
+        const uint32 b = stack[--top];
+        const uint32 a = stack[top - 1];
+        stack[top - 1] = Binary(instruction.op, a, b);
+        continue;
+      }
+
+      switch (instruction.op) {
+      case kIf:
+        if (!stack[--top]) {
+          i = instruction.immediate;
+        }
+        break;
+      case kEnd:
+        break;
+      case kReturn:
+        return stack[top - 1];
+      case kSelect: {
+        const uint32 condition = stack[--top];
+        const uint32 b = stack[--top];
+        if (!condition) {
+          stack[top - 1] = b;
+        }
+        break;
+      }
+      case kLocalGet:
+        stack[top++] = locals[instruction.immediate];
+        break;
+      case kLocalSet:
+        locals[instruction.immediate] = stack[--top];
+        break;
+      case kLocalTee:
+        locals[instruction.immediate] = stack[top - 1];
+        break;
+      case kI32Load:
+      case kI32Load8S:
+      case kI32Load8U:
+      case kI32Load16S:
+      case kI32Load16U:
+        stack[top - 1] = Load(instruction.op,
+                              stack[top - 1] + instruction.immediate);
+        break;
+      case kI32Store: {
+        const uint32 value = stack[--top];
+        const uint32 address = stack[--top] + instruction.immediate;
+        memcpy(Map(address, sizeof(value)), &value, sizeof(value));
+        break;
+      }
+      case kI32Const:
+        stack[top++] = instruction.immediate;
+        break;
+      }
+    }
+    return top ? stack[top - 1] : 0;
+  }
+
+ private:
+  const Guest guest_;
+  vector<Function*> functions_;  // By slot, the first unused.
+
+  static uint32 Binary(uint8 op, uint32 a, uint32 b) {
+    const int32 sa = a;
+    const int32 sb = b;
+    switch (op) {
+    case kI32Eq: return a == b;
+    case kI32Ne: return a != b;
+    case kI32LtS: return sa < sb;
+    case kI32LtU: return a < b;
+    case kI32GtS: return sa > sb;
+    case kI32GtU: return a > b;
+    case kI32LeS: return sa <= sb;
+    case kI32LeU: return a <= b;
+    case kI32GeS: return sa >= sb;
+    case kI32GeU: return a >= b;
+    case kI32Add: return a + b;
+    case kI32Sub: return a - b;
+    case kI32Mul: return a * b;
+    case kI32And: return a & b;
+    case kI32Or: return a | b;
+    case kI32Xor: return a ^ b;
+    case kI32Shl: return a << (b & 0x1f);
+    case kI32ShrS: return sa >> (b & 0x1f);
+    default: return a >> (b & 0x1f);  // kI32ShrU.
+    }
+  }
+
+  uint32 Load(uint8 op, uint32 address) {
+    switch (op) {
+    case kI32Load8S:
+      return static_cast<int8>(*Map(address, 1));
+    case kI32Load8U:
+      return *Map(address, 1);
+    case kI32Load16S:
+    case kI32Load16U: {
+      uint16 value;
+      memcpy(&value, Map(address, sizeof(value)), sizeof(value));
+      return op == kI32Load16S ? static_cast<int16>(value) : value;
+    }
+    default: {
+      uint32 value;
+      memcpy(&value, Map(address, sizeof(value)), sizeof(value));
+      return value;
+    }
+    }
+  }
+
+  // The host address of size bytes at address. Anywhere else would trap in
+  // the browser, and can only be a compiler bug.
+  uint8* Map(uint32 address, uint32 size) {
+    if (address >= kRAMAddress &&
+        address - kRAMAddress <= kMaxRamAddress + 1 - size) {
+      return guest_.ram + (address - kRAMAddress);
+    } else if (address >= kRegsAddress &&
+               address - kRegsAddress <= 32 * sizeof(uint32) - size) {
+      return reinterpret_cast<uint8*>(guest_.regs) + (address - kRegsAddress);
+    } else if (size == sizeof(uint32)) {
+      switch (address) {
+      case kSRAddress:
+        return reinterpret_cast<uint8*>(guest_.sr);
+      case kPCAddress:
+        return reinterpret_cast<uint8*>(guest_.pc);
+      case kDataPageAddress:
+        return reinterpret_cast<uint8*>(const_cast<uint32*>(guest_.data_page));
+      case kDataPhyAddress:
+        return reinterpret_cast<uint8*>(const_cast<uint32*>(guest_.data_phy));
+      }
+    }
+    fprintf(stderr, "Compiled block accessed %08x\n", address);
+    Trap("out of bounds memory access");
+    return nullptr;
+  }
+
+  static void Trap(const char* message) {
+    fprintf(stderr, "Compiled block trapped: %s\n", message);
+    exit(1);
+  }
+
+  DISALLOW_COPY_AND_ASSIGN(NativeBlockRuntime);
+};
+
+}  // namespace
+
+BlockRuntime* BlockRuntime::Create(const Guest& guest) {
+  return new NativeBlockRuntime(guest);
+}
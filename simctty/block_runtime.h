@@ -0,0 +1,55 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_BLOCK_RUNTIME_H_
+#define SIMCTTY_BLOCK_RUNTIME_H_
+
+#include <vector>
+
+#include "simctty/block_compiler.h"
+#include "simctty/types.h"
+
+// Instantiates and runs the modules BlockCompiler makes, for the block cache
+// (block_cache.h).
+//
+// The browser's (block_runtime_web.cc) instantiates them on the emulator's
+// own memory, where the guest state already is, and puts run() in its
+// function table. Native builds have no wasm engine, so theirs
+// (block_runtime.cc) interprets the modules instead, on a small memory of
+// their own that maps onto the guest state and RAM. That is no faster than
+// the CPU's own engines, but lets the cache and CPU::RunCompiledBlock() be
+// tested, and run in lockstep with the reference engine.
+class BlockRuntime {
+ public:
+  // The guest state blocks run on.
+  struct Guest {
+    uint32* regs;             // uint32[32].
+    uint32* sr;
+    uint32* pc;
+    const uint32* data_page;  // MMU::FastAuthPage().
+    const uint32* data_phy;   // MMU::FastAuthPhy().
+    uint8* ram;               // RAM::Raw().
+  };
+
+  BlockRuntime() {}
+  virtual ~BlockRuntime() {}
+
+  // The runtime for this build.
+  static BlockRuntime* Create(const Guest& guest);
+
+  // Where modules find the guest state, to compile them with.
+  virtual BlockCompiler::State State() const = 0;
+
+  // Instantiates module and puts its run() in slot, or in a new slot if
+  // slot is 0. Returns the slot, 0 if the module can't be instantiated.
+  virtual uint32 Instantiate(const std::vector<uint8>& module,
+                             uint32 slot) = 0;
+
+  // Calls run(pc) in slot.
+  virtual uint32 Run(uint32 slot, uint32 pc) = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BlockRuntime);
+};
+
+#endif  // SIMCTTY_BLOCK_RUNTIME_H_
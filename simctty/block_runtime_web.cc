@@ -0,0 +1,57 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/block_runtime.h"
+
+#include <emscripten.h>
+#include <stdint.h>
+
+namespace {
+
+// Blocks share the emulator's memory and function table, so run() is
+// called like any function pointer, at its table index.
+class WebBlockRuntime : public BlockRuntime {
+ public:
+  explicit WebBlockRuntime(const Guest& guest) {
+    state_.regs = reinterpret_cast<uintptr_t>(guest.regs);
+    state_.sr = reinterpret_cast<uintptr_t>(guest.sr);
+    state_.pc = reinterpret_cast<uintptr_t>(guest.pc);
+    state_.data_page = reinterpret_cast<uintptr_t>(guest.data_page);
+    state_.data_phy = reinterpret_cast<uintptr_t>(guest.data_phy);
+    state_.ram = reinterpret_cast<uintptr_t>(guest.ram);
+  }
+
+  virtual BlockCompiler::State State() const {
+    return state_;
+  }
+
+  virtual uint32 Instantiate(const std::vector<uint8>& module, uint32 slot) {
+    return EM_ASM_INT({
+      var module = new WebAssembly.Module(HEAPU8.subarray($0, $0 + $1));
+      var instance = new WebAssembly.Instance(module, {
+        env: {memory: wasmMemory}
+      });
+      var slot = $2;
+      if (slot == 0) {
+        slot = wasmTable.length;
+        wasmTable.grow(1);
+      }
+      wasmTable.set(slot, instance.exports.run);
+      return slot;
+    }, module.data(), module.size(), slot);
+  }
+
+  virtual uint32 Run(uint32 slot, uint32 pc) {
+    typedef uint32 (*Function)(uint32 pc);
+    return reinterpret_cast<Function>(static_cast<uintptr_t>(slot))(pc);
+  }
+
+ private:
+  BlockCompiler::State state_;
+};
+
+}  // namespace
+
+BlockRuntime* BlockRuntime::Create(const Guest& guest) {
+  return new WebBlockRuntime(guest);
+}
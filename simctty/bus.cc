@@ -3,7 +3,20 @@
 
 #include "simctty/bus.h"
 
-Bus::Bus() {
+Bus::Bus(size_t uart_fifo_size)
+  :
+    pic_(),
+    uart_(uart_fifo_size),
+    ram_(),
+    virtio_console_(&ram_),
+    virtio_block_(&ram_),
+    virtio_net_(&ram_),
+    rtc_() {
+  uart_.ConnectInterrupt(&pic_, kUartIrq);
+  virtio_console_.ConnectInterrupt(&pic_, kVirtioConsoleIrq);
+  virtio_block_.ConnectInterrupt(&pic_, kVirtioBlockIrq);
+  virtio_net_.ConnectInterrupt(&pic_, kVirtioNetIrq);
+  rtc_.ConnectInterrupt(&pic_, kRtcIrq);
 }
 
 Bus::~Bus() {
@@ -24,6 +37,17 @@ BusDevice* Bus::GetDevice(uint32 address) {
     device_ = &ram_;
   } else if (address >= kMinUartAddress && address <= kMaxUartAddress) {
     device_ = &uart_;
+  } else if (address >= kMinVirtioConsoleAddress &&
+             address <= kMaxVirtioConsoleAddress) {
+    device_ = &virtio_console_;
+  } else if (address >= kMinVirtioBlockAddress &&
+             address <= kMaxVirtioBlockAddress) {
+    device_ = &virtio_block_;
+  } else if (address >= kMinVirtioNetAddress &&
+             address <= kMaxVirtioNetAddress) {
+    device_ = &virtio_net_;
+  } else if (address >= kMinRtcAddress && address <= kMaxRtcAddress) {
+    device_ = &rtc_;
   } else {
     device_ = nullptr;
   }
@@ -38,6 +62,17 @@ const BusDevice* Bus::GetDevice(uint32 address) const {
     device_ = &ram_;
   } else if (address >= kMinUartAddress && address <= kMaxUartAddress) {
     device_ = &uart_;
+  } else if (address >= kMinVirtioConsoleAddress &&
+             address <= kMaxVirtioConsoleAddress) {
+    device_ = &virtio_console_;
+  } else if (address >= kMinVirtioBlockAddress &&
+             address <= kMaxVirtioBlockAddress) {
+    device_ = &virtio_block_;
+  } else if (address >= kMinVirtioNetAddress &&
+             address <= kMaxVirtioNetAddress) {
+    device_ = &virtio_net_;
+  } else if (address >= kMinRtcAddress && address <= kMaxRtcAddress) {
+    device_ = &rtc_;
   } else {
     device_ = nullptr;
   }
@@ -45,12 +80,38 @@ const BusDevice* Bus::GetDevice(uint32 address) const {
   return device_;
 }
 
-uint32 Bus::Interrupts() const {
-  return uart_.IsInterruptAsserted() ? 0x4 : 0x0;
+PIC* Bus::GetPIC() {
+  return &pic_;
+}
+
+void Bus::Poll() {
+  // Host side input and output since the last slice.
+  uart_.UpdateInterrupt();
+
+  virtio_console_.Poll();
+  virtio_block_.Poll();
+  virtio_net_.Poll();
+  rtc_.Poll();
 }
 
 UART* Bus::GetUART() {
   return &uart_;
 }
 
+VirtioConsole* Bus::GetVirtioConsole() {
+  return &virtio_console_;
+}
+
+VirtioBlock* Bus::GetVirtioBlock() {
+  return &virtio_block_;
+}
+
+VirtioNet* Bus::GetVirtioNet() {
+  return &virtio_net_;
+}
+
+GoldfishRTC* Bus::GetRTC() {
+  return &rtc_;
+}
+
 
@@ -6,14 +6,20 @@
 
 #include "simctty/bus_device.h"
 #include "simctty/exception.h"
+#include "simctty/pic.h"
 #include "simctty/ram.h"
+#include "simctty/rtc.h"
 #include "simctty/types.h"
 #include "simctty/uart.h"
+#include "simctty/virtio_block.h"
+#include "simctty/virtio_console.h"
+#include "simctty/virtio_net.h"
 
 class CPU;
 class Bus {
  public:
-  Bus();
+  // uart_fifo_size picks a 16550A or a 16750 UART (uart.h).
+  explicit Bus(size_t uart_fifo_size = UART::kFifoSize16550);
   ~Bus();
 
   RAM* GetRAM();
@@ -23,12 +29,27 @@ class Bus {
   const BusDevice* GetDevice(uint32 address) const;
 
   UART* GetUART();
+  VirtioConsole* GetVirtioConsole();
+  VirtioBlock* GetVirtioBlock();
+  VirtioNet* GetVirtioNet();
+  GoldfishRTC* GetRTC();
 
-  uint32 Interrupts() const;
+  PIC* GetPIC();
+
+  // Device work done between CPU slices, on the CPU thread.
+  void Poll();
 
  private:
+  // Interrupt lines, PICSR bits.
+  const static uint32 kUartIrq = 2;
+
+  PIC pic_;
   UART uart_;
   RAM ram_;
+  VirtioConsole virtio_console_;
+  VirtioBlock virtio_block_;
+  VirtioNet virtio_net_;
+  GoldfishRTC rtc_;
 
   CPU* cpu_;
 
@@ -5,13 +5,20 @@
 #define SIMCTTY_BUS_DEVICE_H_
 
 #include "simctty/exception.h"
+#include "simctty/pic.h"
 #include "simctty/types.h"
 
 class BusDevice {
  public:
-  BusDevice() {}
+  BusDevice() : pic_(nullptr), irq_(0) {}
   virtual ~BusDevice() {}
 
+  // Routes the device's interrupt output to line irq of pic.
+  void ConnectInterrupt(PIC* pic, uint32 irq) {
+    pic_ = pic;
+    irq_ = irq;
+  }
+
   virtual uint8 Load8(uint32 address, Exception* exception) const {
     *exception = kExceptionBusError;
     return 0;
@@ -39,7 +46,18 @@ class BusDevice {
     *exception = kExceptionBusError;
   }
 
+ protected:
+  // Drives the interrupt line, if connected.
+  void SetInterrupt(bool is_asserted) const {
+    if (pic_) {
+      pic_->SetLine(irq_, is_asserted);
+    }
+  }
+
  private:
+  PIC* pic_;
+  uint32 irq_;
+
   DISALLOW_COPY_AND_ASSIGN(BusDevice);
 };
 
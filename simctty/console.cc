@@ -0,0 +1,222 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/console.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+using std::min;
+
+Console::Console(SerialPort* port)
+  :
+    port_(port),
+    fd_(-1),
+    pending_offset_(0),
+    pending_length_(0) {
+}
+
+Console::~Console() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+Console* Console::Create(const char* spec, SerialPort* port) {
+  if (strcmp(spec, "pty") == 0) {
+    return new PtyConsole(port);
+  } else if (strncmp(spec, "unix:", 5) == 0) {
+    return new UnixSocketConsole(port, spec + 5);
+  }
+
+  return nullptr;
+}
+
+const string& Console::Path() const {
+  return path_;
+}
+
+int Console::PollFd() const {
+  return fd_;
+}
+
+void Console::Pump() {
+  if (fd_ < 0 && !Accept()) {
+    DiscardOutput();
+    return;
+  }
+
+  PumpInput();
+  if (fd_ >= 0) {
+    PumpOutput();
+  }
+}
+
+void Console::Flush() {
+  if (fd_ < 0) {
+    DiscardOutput();
+  } else {
+    PumpOutput();
+  }
+}
+
+bool Console::Accept() {
+  return false;
+}
+
+void Console::Hangup() {
+  close(fd_);
+  fd_ = -1;
+  pending_offset_ = 0;
+  pending_length_ = 0;
+}
+
+void Console::PumpInput() {
+  uint8 buffer[kBufferSize];
+
+  const size_t space = min(kBufferSize, port_->WriteBufferFree());
+  if (space == 0) {
+    return;
+  }
+
+  const ssize_t length = read(fd_, buffer, space);
+  if (length > 0) {
+    port_->WriteBuffer(buffer, length);
+  } else if (length == 0 || (errno != EAGAIN && errno != EINTR)) {
+    Hangup();
+  }
+}
+
+void Console::PumpOutput() {
+  for (;;) {
+    if (pending_offset_ == pending_length_) {
+      pending_offset_ = 0;
+      pending_length_ = port_->ReadBuffer(pending_, kBufferSize);
+      if (pending_length_ == 0) {
+        return;
+      }
+    }
+
+    const ssize_t written = write(fd_, pending_ + pending_offset_,
+                                  pending_length_ - pending_offset_);
+    if (written < 0) {
+      if (errno != EAGAIN && errno != EINTR) {
+        Hangup();
+      }
+      // Otherwise the client is behind, leave the rest queued in the device.
+      return;
+    }
+
+    pending_offset_ += written;
+  }
+}
+
+void Console::DiscardOutput() {
+  while (port_->ReadBuffer(pending_, kBufferSize) > 0) {
+  }
+  pending_offset_ = 0;
+  pending_length_ = 0;
+}
+
+PtyConsole::PtyConsole(SerialPort* port)
+  :
+    Console(port),
+    slave_fd_(-1) {
+}
+
+PtyConsole::~PtyConsole() {
+  if (slave_fd_ >= 0) {
+    close(slave_fd_);
+  }
+}
+
+bool PtyConsole::Open() {
+  fd_ = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd_ < 0 || grantpt(fd_) != 0 || unlockpt(fd_) != 0) {
+    perror("posix_openpt");
+    return false;
+  }
+
+  const char* name = ptsname(fd_);
+  if (!name) {
+    perror("ptsname");
+    return false;
+  }
+  path_ = name;
+
+  slave_fd_ = open(name, O_RDWR | O_NOCTTY);
+  if (slave_fd_ < 0) {
+    perror(name);
+    return false;
+  }
+
+  // The guest does its own line discipline.
+  struct termios termios_p;
+  tcgetattr(slave_fd_, &termios_p);
+  cfmakeraw(&termios_p);
+  tcsetattr(slave_fd_, TCSANOW, &termios_p);
+
+  return true;
+}
+
+UnixSocketConsole::UnixSocketConsole(SerialPort* port, const char* path)
+  :
+    Console(port),
+    listen_fd_(-1) {
+  path_ = path;
+}
+
+UnixSocketConsole::~UnixSocketConsole() {
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(path_.c_str());
+  }
+}
+
+bool UnixSocketConsole::Open() {
+  struct sockaddr_un address;
+  if (path_.size() >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path_.c_str());
+    return false;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path_.c_str(), sizeof(address.sun_path) - 1);
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    perror("socket");
+    return false;
+  }
+
+  // Replace a stale socket left by a previous run.
+  unlink(path_.c_str());
+
+  if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listen_fd_, 1) != 0) {
+    perror(path_.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+int UnixSocketConsole::PollFd() const {
+  return fd_ >= 0 ? fd_ : listen_fd_;
+}
+
+bool UnixSocketConsole::Accept() {
+  fd_ = accept4(listen_fd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  return fd_ >= 0;
+}
@@ -0,0 +1,108 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_CONSOLE_H_
+#define SIMCTTY_CONSOLE_H_
+
+#include <string>
+
+#include "simctty/types.h"
+#include "simctty/serial_port.h"
+
+using std::string;
+
+// Host endpoint for a guest console that isn't the controlling terminal.
+//
+// Pump() moves whatever is ready in both directions without blocking. Output
+// the endpoint can't take yet stays queued in the device, so a slow client
+// never stalls the CPU running the guest; once the device's buffer is full the
+// guest sees the line as busy and waits.
+class Console {
+ public:
+  explicit Console(SerialPort* port);
+  virtual ~Console();
+
+  // Creates a console from a command line spec: "pty" or "unix:PATH".
+  // Returns null for an unknown spec.
+  static Console* Create(const char* spec, SerialPort* port);
+
+  virtual bool Open() = 0;
+
+  // Where a client should connect, e.g. a pty slave path.
+  const string& Path() const;
+
+  // Descriptor that becomes readable when Pump() has input to move or a
+  // client to accept, -1 if none.
+  virtual int PollFd() const;
+
+  // Moves input and output.
+  void Pump();
+
+  // Moves output only.
+  void Flush();
+
+ protected:
+  SerialPort* port_;
+  int fd_;  // Connected client, -1 if none.
+  string path_;
+
+  // Called by Pump() with no client attached. Sets fd_ and returns true if a
+  // client has connected.
+  virtual bool Accept();
+
+  // Drops the current client.
+  void Hangup();
+
+ private:
+  const static size_t kBufferSize = 4096;
+
+  // Output taken from the device but not yet accepted by fd_.
+  uint8 pending_[kBufferSize];
+  size_t pending_offset_;
+  size_t pending_length_;
+
+  void PumpInput();
+  void PumpOutput();
+  void DiscardOutput();
+
+  DISALLOW_COPY_AND_ASSIGN(Console);
+};
+
+// Console on a newly allocated pseudo-terminal, in raw mode. Output written
+// while no client has the slave open is buffered by the pty.
+class PtyConsole : public Console {
+ public:
+  explicit PtyConsole(SerialPort* port);
+  virtual ~PtyConsole();
+
+  virtual bool Open();
+
+ private:
+  // Held open so the master doesn't report EIO while no client is attached.
+  int slave_fd_;
+
+  DISALLOW_COPY_AND_ASSIGN(PtyConsole);
+};
+
+// Console on a listening Unix domain stream socket, one client at a time.
+// When a client disconnects the next one to connect takes over. Output while
+// no client is connected is discarded, like a serial line with nothing
+// plugged in.
+class UnixSocketConsole : public Console {
+ public:
+  UnixSocketConsole(SerialPort* port, const char* path);
+  virtual ~UnixSocketConsole();
+
+  virtual bool Open();
+  virtual int PollFd() const;
+
+ protected:
+  virtual bool Accept();
+
+ private:
+  int listen_fd_;
+
+  DISALLOW_COPY_AND_ASSIGN(UnixSocketConsole);
+};
+
+#endif  // SIMCTTY_CONSOLE_H_
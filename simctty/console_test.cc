@@ -0,0 +1,107 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "simctty/console.h"
+#include "simctty/uart.h"
+
+using std::string;
+
+class ConsoleTest : public ::testing::Test {
+ public:
+  ConsoleTest()
+    :
+      path_("/tmp/simctty-console-test-" + std::to_string(getpid())) {
+  }
+
+  int Connect() {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path_.c_str(), sizeof(address.sun_path) - 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address)) != 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  void Print(const char* text) {
+    Exception exception;
+    for (const char* c = text; *c; c++) {
+      uart_.Store8(kMinUartAddress, *c, &exception);
+    }
+  }
+
+  UART uart_;
+  const string path_;
+};
+
+TEST_F(ConsoleTest, UnixSocket) {
+  UnixSocketConsole console(&uart_, path_.c_str());
+  ASSERT_TRUE(console.Open());
+
+  // Nobody listening, output is dropped.
+  Print("lost");
+  console.Pump();
+  ASSERT_FALSE(uart_.CanRead());
+
+  const int client = Connect();
+  ASSERT_LE(0, client);
+  ASSERT_EQ(2, write(client, "ls", 2));
+
+  Print("ok");
+  console.Pump();
+
+  Exception exception;
+  ASSERT_EQ('l', uart_.Load8(kMinUartAddress, &exception));
+  ASSERT_EQ('s', uart_.Load8(kMinUartAddress, &exception));
+
+  char buffer[16];
+  ASSERT_EQ(2, read(client, buffer, sizeof(buffer)));
+  ASSERT_EQ(0, memcmp("ok", buffer, 2));
+
+  // Hang up, the next client takes over.
+  close(client);
+  console.Pump();
+
+  const int next_client = Connect();
+  ASSERT_LE(0, next_client);
+  console.Pump();
+  Print("hi");
+  console.Flush();
+  ASSERT_EQ(2, read(next_client, buffer, sizeof(buffer)));
+  ASSERT_EQ(0, memcmp("hi", buffer, 2));
+  close(next_client);
+}
+
+TEST_F(ConsoleTest, BusyLineWhenHostIsBehind) {
+  Exception exception;
+  const uint32 kLSR = kMinUartAddress + 5;
+
+  ASSERT_EQ(0x60, uart_.Load8(kLSR, &exception));
+
+  // Nothing drains the UART, eventually it reports the line busy.
+  size_t written = 0;
+  while (uart_.Load8(kLSR, &exception) & 0x20) {
+    uart_.Store8(kMinUartAddress, 'x', &exception);
+    written++;
+  }
+  ASSERT_LT(0U, written);
+
+  uint8 c;
+  ASSERT_EQ(1U, uart_.ReadBuffer(&c, 1));
+  ASSERT_EQ(0x60, uart_.Load8(kLSR, &exception));
+}
@@ -26,16 +26,50 @@ const uint32 CPU::kEPH   = 1 << 14;  // U Exception Prefix High.
 const uint32 CPU::kFO    = 1 << 15;  // S Fixed One (always set).
 const uint32 CPU::kSUMRA = 1 << 16;  // U SPRs User Mode Read Access.
 
+namespace {
+
+// PCMR event bits, indexed by CPU::Event. Branch stalls are counted as taken
+// jumps and branches.
+const uint32 kPCMREventBits[] = {
+  1 << 6,   // IF   : Instruction Fetch.
+  1 << 4,   // LA   : Load Access.
+  1 << 5,   // SA   : Store Access.
+  1 << 11,  // BS   : Branch Stall.
+  1 << 12,  // DTLBM: DTLB Miss.
+  1 << 13,  // ITLBM: ITLB Miss.
+};
+
+}  // namespace
+
 CPU::CPU(Bus* bus)
   :
+    sr_(0),
+    ttcr_(0),
+    raw_(bus->GetRAM()->Raw()),
+    fetch_ttcr_(0),
     bus_(bus),
-    raw_(bus_->GetRAM()->Raw()),
-    immu_(bus_, MMU::kInstruction),
-    dmmu_(bus_, MMU::kData) {
+    pic_(bus->GetPIC()),
+    engine_(kEngineFast),
+    immu_(bus, MMU::kInstruction),
+    dmmu_(bus, MMU::kData) {
   Reset();
+
+#ifdef SIMCTTY_WASM_BLOCKS
+  BlockRuntime::Guest guest;
+  guest.regs = reg_;
+  guest.sr = &sr_;
+  guest.pc = &pc_;
+  guest.data_page = dmmu_.FastAuthPage();
+  guest.data_phy = dmmu_.FastAuthPhy();
+  guest.ram = raw_;
+  block_cache_ = new BlockCache(guest);
+#endif
 }
 
 CPU::~CPU() {
+#ifdef SIMCTTY_WASM_BLOCKS
+  delete block_cache_;
+#endif
 }
 
 void CPU::Reset() {
@@ -56,13 +90,23 @@ void CPU::Reset() {
   esr0_ = 0;
 
   // Initialise programmable interrupt controller.
-  picmr_ = 0;
-  picsr_ = 0;
-  pending_interrupt_ = false;
+  pic_->Reset();
+  is_block_boundary_ = false;
 
   // Initialise tick timer.
   ttmr_ = 0;
   ttcr_ = 0;
+  fetch_ttcr_ = 0;
+
+  // Initialise performance counters.
+  for (size_t i = 0; i < kEventCount; i++) {
+    events_[0][i] = 0;
+    events_[1][i] = 0;
+  }
+  for (size_t i = 0; i < kPerfCounterCount; i++) {
+    pcmr_[i] = kPCMRCP;
+    pccr_offset_[i] = 0;
+  }
 
   // Reset MMUs.
   dmmu_.Reset();
@@ -73,12 +117,116 @@ void CPU::Reset() {
 
   // Counters.
   authed_page_ = 0x1;
+  for (size_t i = 0; i < kFetchPageCount; i++) {
+    fetch_page_[i] = 0x1;
+  }
+#ifdef SIMCTTY_WASM_BLOCKS
+  ClearReturnStack();
+#endif
+}
+
+void CPU::ClearFetchPages(size_t set) {
+  for (size_t i = set; i < kFetchPageCount; i += kITLBSetCount) {
+    fetch_page_[i] = 0x1;
+  }
+#ifdef SIMCTTY_WASM_BLOCKS
+  ClearReturnStack();
+#endif
+}
+
+inline void CPU::CountEvent(Event event) {
+  ++events_[sr_ & kSM][event];
+}
+
+void CPU::AddFetches() {
+  events_[sr_ & kSM][kEventFetch] += ttcr_ - fetch_ttcr_;
+  fetch_ttcr_ = ttcr_;
+}
+
+uint64 CPU::EventCount(size_t is_sm, Event event) const {
+  uint64 count = events_[is_sm][event];
+  if (event == kEventFetch && is_sm == (sr_ & kSM)) {
+    count += ttcr_ - fetch_ttcr_;
+  }
+  return count;
+}
+
+template <bool kIsReference, bool kIsSupervisor>
+inline void CPU::CountEvent(Event event) {
+  ++events_[kIsReference ? sr_ & kSM : kIsSupervisor][event];
 }
 
 bool CPU::Run(size_t cycles) {
+  typedef EngineExit (CPU::*EngineFunction)(size_t cycles, size_t* i);
+  // Indexed by [SR[SM]][SR[IME]][SR[DME]].
+  const static EngineFunction kEngines[2][2][2] = {
+    {{&CPU::RunEngine<false, false, false, false>,
+      &CPU::RunEngine<false, false, false, true>},
+     {&CPU::RunEngine<false, false, true, false>,
+      &CPU::RunEngine<false, false, true, true>}},
+    {{&CPU::RunEngine<false, true, false, false>,
+      &CPU::RunEngine<false, true, false, true>},
+     {&CPU::RunEngine<false, true, true, false>,
+      &CPU::RunEngine<false, true, true, true>}},
+  };
+
   CheckInterrupts();
 
-  for (size_t i = 0; i < cycles; i++) {
+  size_t i = 0;
+  for (;;) {
+    const EngineFunction engine = engine_ == kEngineReference ?
+        &CPU::RunEngine<true, false, false, false> :
+        kEngines[sr_ & kSM][!!(sr_ & kIME)][!!(sr_ & kDME)];
+    const EngineExit exit = (this->*engine)(cycles, &i);
+    AddFetches();
+    switch (exit) {
+    case kExitHalt:
+      return false;
+    case kExitSliceEnd:
+      return true;
+    case kExitModeSwitch:
+      break;
+    }
+  }
+}
+
+void CPU::SetEngine(Engine engine) {
+  engine_ = engine;
+}
+
+template <bool kIsReference, bool kIsSupervisor, bool kIsIMMUEnabled,
+          bool kIsDMMUEnabled>
+CPU::EngineExit CPU::RunEngine(size_t cycles, size_t* count) {
+  const uint32 kMode = (kIsSupervisor ? kSM : 0) |
+                       (kIsIMMUEnabled ? kIME : 0) |
+                       (kIsDMMUEnabled ? kDME : 0);
+
+  for (size_t i = *count; i < cycles; i++) {
+    // Interrupts raised mid-slice are taken at the next block boundary.
+    if (is_block_boundary_) {
+      is_block_boundary_ = false;
+      CheckInterrupts();
+
+      if (!kIsReference && (sr_ & (kSM | kIME | kDME)) != kMode) {
+        *count = i;
+        return kExitModeSwitch;
+      }
+
+#ifdef SIMCTTY_WASM_BLOCKS
+      const size_t retired = kIsReference ? 0 : RunCompiledBlock(cycles - i);
+      if (retired) {
+        i += retired - 1;
+        continue;
+      }
+#endif
+    }
+
+    if (kIsReference) {
+      immu_.ClearFastAuthCache();
+      dmmu_.ClearFastAuthCache();
+      authed_page_ = 0x1;
+    }
+
     // Increment tick timer counter register.
     ++ttcr_;
 
@@ -90,8 +238,9 @@ bool CPU::Run(size_t cycles) {
 
       // Tick timer interrupt?
       if (sr_ & kTEE) {
+        ++fetch_ttcr_;
         ThrowException(kExceptionTickTimerInterrupt);
-        return true;
+        return kExitSliceEnd;
       }
     }
 
@@ -99,34 +248,57 @@ bool CPU::Run(size_t cycles) {
     Exception exception = kExceptionNone;
     uint32 instruction;
 
-    if ((pc_ & 0xffffe000) == authed_page_) {
+    const size_t fetch_slot = (pc_ >> 13) % kFetchPageCount;
+    if (kIsReference) {
+      instruction = immu_.Load32(pc_, &exception, sr_ & kSM);
+      if (exception != kExceptionNone) {
+        ++fetch_ttcr_;
+        ThrowException(exception, pc_);
+        return kExitSliceEnd;
+      }
+    } else if ((pc_ & 0xffffe000) == authed_page_) {
       // Fast path, ~98.6% of instruction fetches.
       instruction = *reinterpret_cast<uint32*>(raw_ + authed_phy_ + (pc_ & 0x1fff));
+    } else if (kIsIMMUEnabled &&
+               fetch_page_[fetch_slot] == (pc_ & 0xffffe000)) {
+      // A page fetched from recently, usually a jump or branch target.
+      authed_page_ = pc_ & 0xffffe000;
+      authed_phy_ = fetch_phy_[fetch_slot];
+      instruction = *reinterpret_cast<uint32*>(raw_ + authed_phy_ + (pc_ & 0x1fff));
     } else {
       // Slow path.
       bool is_ram;
-      const uint32 phy_address = immu_.MapAddress(pc_, &exception, sr_& kSM, false, &is_ram);
+      const uint32 phy_address = immu_.MapAddress<kIsIMMUEnabled, false>(
+          pc_, &exception, kIsSupervisor, &is_ram);
       if (exception != kExceptionNone) {
+        ++fetch_ttcr_;
         ThrowException(exception, pc_);
-        return true;
+        return kExitSliceEnd;
       }
 
       if (is_ram) {
         authed_page_ = pc_ & 0xffffe000;
         authed_phy_ = phy_address & 0xffffe000;
+        if (kIsIMMUEnabled) {
+          fetch_page_[fetch_slot] = authed_page_;
+          fetch_phy_[fetch_slot] = authed_phy_;
+        }
         instruction = *reinterpret_cast<uint32*>(raw_ + authed_phy_ + (pc_ & 0x1fff));
       } else {
         // Slowest path for bus attached devices.
-        instruction = immu_.Load32(pc_, &exception, sr_ & kSM);
+        instruction = immu_.Load32<kIsIMMUEnabled>(pc_, &exception,
+                                                   kIsSupervisor);
       }
     }
 
-    if (!RunInstruction(instruction)) {
-      return false;
+    if (!RunInstruction<kIsReference, kIsSupervisor, kIsDMMUEnabled>(
+            instruction)) {
+      return kExitHalt;
     }
   }
 
-  return true;
+  *count = cycles;
+  return kExitSliceEnd;
 }
 
 uint32 CPU::Reg(reg_t reg) const {
@@ -145,17 +317,33 @@ void CPU::SetPC(uint32 pc) {
   pc_ = pc;
 }
 
+uint64 CPU::InstructionRunCount() const {
+  return EventCount(0, kEventFetch) + EventCount(1, kEventFetch);
+}
+
 uint32 CPU::SpReg(reg_t reg) const {
-  // Sp registers addresses consist of a 5-bit group and 11-bit index:
-  // GGGG GIII IIII IIII.
   const size_t group = (reg & 0xf800) >> 11;
   const size_t index = reg & 0x07ff;
 
   // Supervisor mode enabled? (SUMRA mode not supported).
-  if (!sr_ & kSM) {
+  if (!(sr_ & kSM)) {
+    // Except performance counters opened up to user mode.
+    if (group == 8 && index < kPerfCounterCount &&
+        pcmr_[index] & kPCMRUMRA) {
+      return PerfCount(index);
+    }
     return 0;
   }
 
+  return DebugSpReg(reg);
+}
+
+uint32 CPU::DebugSpReg(reg_t reg) const {
+  // Sp registers addresses consist of a 5-bit group and 11-bit index:
+  // GGGG GIII IIII IIII.
+  const size_t group = (reg & 0xf800) >> 11;
+  const size_t index = reg & 0x07ff;
+
   switch (group) {
   case 0:  // System Control and Status registers.
     switch (index) {
@@ -175,7 +363,7 @@ uint32 CPU::SpReg(reg_t reg) const {
         1 << 4 |  // IMP : Instruction MMU Present.
         0 << 5 |  // MP  : MAC Present.
         0 << 6 |  // DUP : Debug Unit Present.
-        0 << 7 |  // PCUP: Performance Counters Unit Present.
+        1 << 7 |  // PCUP: Performance Counters Unit Present.
         0 << 8 |  // PMP : Power Management Present.
         1 << 9 |  // PICP: Programmable Interrupt Controller Present.
         1 << 10;  // TTP : Tick Timer Present.
@@ -224,12 +412,19 @@ uint32 CPU::SpReg(reg_t reg) const {
     return dmmu_.Reg(index);
   case 2:  // Instruction MMU.
     return immu_.Reg(index);
+  case 8:  // Performance Counters Unit.
+    if (index < kPerfCounterCount) {  // PCCR: Count registers.
+      return PerfCount(index);
+    } else if (index < 2 * kPerfCounterCount) {  // PCMR: Mode registers.
+      return pcmr_[index - kPerfCounterCount];
+    }
+    break;
   case 9:  // Programmable Interrupt Controller.
     switch (index) {
     case 0:  // PIC Mask register.
-      return picmr_;
+      return pic_->Mask();
     case 2:  // PIC Status register.
-      return picsr_;
+      return pic_->Status();
     }
     break;
   case 10: // Tick Timer.
@@ -256,6 +451,7 @@ void CPU::SetSpReg(reg_t reg, uint32 value) {
   case 0:  // System Control and Status registers.
     switch (index) {
     case 17:  // SR   : Supervision register.
+      AddFetches();
       sr_ = value;
       if (sr_ & (kLEE|kCE|kEPH|kSUMRA)) {
         fprintf(stderr, "Unsupported mode enabled sr_=%#x", sr_);
@@ -266,6 +462,9 @@ void CPU::SetSpReg(reg_t reg, uint32 value) {
       immu_.ClearFastAuthCache();
       dmmu_.ClearFastAuthCache();
       authed_page_ = 0x1;
+
+      // Interrupts may have just been enabled.
+      is_block_boundary_ = true;
       return;
     case 32:  // EPCR0: Exception PC registers (1 only).
       epcr0_ = value;
@@ -284,6 +483,9 @@ void CPU::SetSpReg(reg_t reg, uint32 value) {
     }
     break;
   case 2:
+    // The fetch fast path may be on a page this entry no longer maps.
+    authed_page_ = 0x1;
+    ClearFetchPages(index % kITLBSetCount);
     if (immu_.SetReg(index, value)) {
       return;
     }
@@ -292,17 +494,41 @@ void CPU::SetSpReg(reg_t reg, uint32 value) {
     switch (index) {
     case 2:
       // IC Block Invalidate Register.
-      // Instruction cache is not implemented, ignore writes.
+      // Instruction cache is not implemented, but compiled code from the
+      // block's page is dropped (as any store to it does).
+#ifdef SIMCTTY_WASM_BLOCKS
+      {
+        uint32 phy_address;
+        if (immu_.Translate(value, &phy_address) &&
+            phy_address <= kMaxRamAddress) {
+          bus_->GetRAM()->InvalidateCode(phy_address, 1);
+        }
+      }
+#endif
       return;
     };
     break;
+  case 8:  // Performance Counters Unit.
+    if (index < kPerfCounterCount) {  // PCCR: Count registers.
+      pccr_offset_[index] = value - SelectedEventCount(index);
+      return;
+    } else if (index < 2 * kPerfCounterCount) {  // PCMR: Mode registers.
+      // Changing the events counted doesn't change the count so far.
+      const size_t counter = index - kPerfCounterCount;
+      const uint32 count = PerfCount(counter);
+      pcmr_[counter] = value | kPCMRCP;
+      pccr_offset_[counter] = count - SelectedEventCount(counter);
+      return;
+    }
+    break;
   case 9:  // Programmable Interrupt Controller.
     switch (index) {
     case 0:  // PIC Mask register.
-      picmr_ = value;
+      pic_->SetMask(value);
+      is_block_boundary_ = true;
       return;
     case 2:  // PIC Status register.
-      picsr_ = value;
+      pic_->SetStatus(value);
       return;
     }
     break;
@@ -315,7 +541,9 @@ void CPU::SetSpReg(reg_t reg, uint32 value) {
       }
       return;
     case 1:  // Tick Timer Count register.
+      AddFetches();
       ttcr_ = value;
+      fetch_ttcr_ = ttcr_;
       return;
     }
     break;
@@ -326,6 +554,12 @@ void CPU::SetSpReg(reg_t reg, uint32 value) {
 }
 
 void CPU::ThrowException(Exception exception, uint32 effective_address) {
+  if (exception == kExceptionDTLBMiss) {
+    CountEvent(kEventDTLBMiss);
+  } else if (exception == kExceptionITLBMiss) {
+    CountEvent(kEventITLBMiss);
+  }
+
   // Save supervisor register.
   esr0_ = sr_;
 
@@ -354,11 +588,14 @@ void CPU::IncrementPC() {
     pc_ += 4;
   } else {
     pc_ = delayed_next_pc_;
+    is_block_boundary_ = true;
   }
   in_delay_slot_ = false;
 }
 
+template <bool kIsReference, bool kIsSupervisor>
 void CPU::Jump(uint32 next_pc) {
+  CountEvent<kIsReference, kIsSupervisor>(kEventBranch);
   delayed_next_pc_ = next_pc;
   pc_ += 4;
   in_delay_slot_ = true;
@@ -390,8 +627,16 @@ bool CPU::IsFlagSet() const {
 #define DECODE_F() f = (instruction >> 6) & 0x3;
 #define DECODE_FF() ff = (instruction&0xf) | ((instruction&0x3c0) >> 2);
 
+// A data access, e.g. DMMU_ACCESS(Load32, ea, &exception). The reference
+// engine goes through the MMU's own check of whether it is enabled.
+#define DMMU_ACCESS(access, ...) \
+    (kIsReference ? dmmu_.access(__VA_ARGS__, is_sm) : \
+     dmmu_.access<kIsDMMUEnabled>(__VA_ARGS__, is_sm))
+
+template <bool kIsReference, bool kIsSupervisor, bool kIsDMMUEnabled>
 bool CPU::RunInstruction(const uint32 instruction) {
   Exception exception = kExceptionNone;
+  const bool is_sm = kIsReference ? (sr_ & kSM) != 0 : kIsSupervisor;
 
   // Run instruction.
   const uint8 opcode = (instruction >> 26) & 0x3f;
@@ -412,17 +657,17 @@ bool CPU::RunInstruction(const uint32 instruction) {
   switch (opcode) {
   case 0x00:  // 0000 00NN NNNN NNNN NNNN NNNN NNNN NNNN l.j
     DECODE_N();
-    Jump(pc_ + n);
+    Jump<kIsReference, kIsSupervisor>(pc_ + n);
     break;
   case 0x01:  // 0000 01NN NNNN NNNN NNNN NNNN NNNN NNNN l.jal
     DECODE_N();
     reg_[9] = pc_ + 8;
-    Jump(pc_ + n);
+    Jump<kIsReference, kIsSupervisor>(pc_ + n);
     break;
   case 0x03:  // 0000 11NN NNNN NNNN NNNN NNNN NNNN NNNN l.bnf
     if (!(sr_ & kF)) {
       DECODE_N();
-      Jump(pc_ + n);
+      Jump<kIsReference, kIsSupervisor>(pc_ + n);
     } else {
       IncrementPC();
     }
@@ -430,14 +675,14 @@ bool CPU::RunInstruction(const uint32 instruction) {
   case 0x04:  // 0001 00NN NNNN NNNN NNNN NNNN NNNN NNNN l.bf
     if (sr_ & kF) {
       DECODE_N();
-      Jump(pc_ + n);
+      Jump<kIsReference, kIsSupervisor>(pc_ + n);
     } else {
       IncrementPC();
     }
     break;
   case 0x05:  // 0001 0101 ---- ---- KKKK KKKK KKKK KKKK l.nop
     DECODE_K();
-    if ((sr_ & kSM) && k == 1) {
+    if (is_sm && k == 1) {
       return false;
     } else {
       IncrementPC();
@@ -471,19 +716,20 @@ bool CPU::RunInstruction(const uint32 instruction) {
     break;
   case 0x11:  // 0100 01-- ---- ---- BBBB B--- ---- ---- l.jr
     DECODE_B();
-    Jump(reg_[b]);
+    Jump<kIsReference, kIsSupervisor>(reg_[b]);
     break;
   case 0x12:  // 0100 10-- ---- ---- BBBB B--- ---- ---- l.jalr
     DECODE_B();
     reg_[9] = pc_ + 8;
-    Jump(reg_[b]);
+    Jump<kIsReference, kIsSupervisor>(reg_[b]);
     break;
   case 0x21:  // 1000 01DD DDDA AAAA IIII IIII IIII IIII l.lwz
     DECODE_D();
     DECODE_A();
     DECODE_I();
     ea = reg_[a] + i;
-    value = dmmu_.Load32(ea, &exception, sr_ & kSM);
+    CountEvent<kIsReference, kIsSupervisor>(kEventLoad);
+    value = DMMU_ACCESS(Load32, ea, &exception);
 
     if (exception != kExceptionNone) {
       ThrowException(exception, ea);
@@ -497,7 +743,8 @@ bool CPU::RunInstruction(const uint32 instruction) {
     DECODE_A();
     DECODE_I();
     ea = reg_[a] + i;
-    value = dmmu_.Load8(ea, &exception, sr_ & kSM);
+    CountEvent<kIsReference, kIsSupervisor>(kEventLoad);
+    value = DMMU_ACCESS(Load8, ea, &exception);
     if (exception != kExceptionNone) {
       ThrowException(exception, ea);
     } else {
@@ -510,7 +757,8 @@ bool CPU::RunInstruction(const uint32 instruction) {
     DECODE_A();
     DECODE_I();
     ea = reg_[a] + i;
-    value = static_cast<int8>(dmmu_.Load8(ea, &exception, sr_ & kSM));
+    CountEvent<kIsReference, kIsSupervisor>(kEventLoad);
+    value = static_cast<int8>(DMMU_ACCESS(Load8, ea, &exception));
     if (exception != kExceptionNone) {
       ThrowException(exception, ea);
     } else {
@@ -523,7 +771,8 @@ bool CPU::RunInstruction(const uint32 instruction) {
     DECODE_A();
     DECODE_I();
     ea = reg_[a] + i;
-    value = dmmu_.Load16(ea, &exception, sr_ & kSM);
+    CountEvent<kIsReference, kIsSupervisor>(kEventLoad);
+    value = DMMU_ACCESS(Load16, ea, &exception);
     if (exception != kExceptionNone) {
       ThrowException(exception, ea);
     } else {
@@ -536,7 +785,8 @@ bool CPU::RunInstruction(const uint32 instruction) {
     DECODE_A();
     DECODE_I();
     ea = reg_[a] + i;
-    value = static_cast<int16>(dmmu_.Load16(ea, &exception, sr_ & kSM));
+    CountEvent<kIsReference, kIsSupervisor>(kEventLoad);
+    value = static_cast<int16>(DMMU_ACCESS(Load16, ea, &exception));
     if (exception != kExceptionNone) {
       ThrowException(exception, ea);
     } else {
@@ -576,7 +826,7 @@ bool CPU::RunInstruction(const uint32 instruction) {
     DECODE_D();
     DECODE_A();
     DECODE_K();
-    reg_[d] = SpReg(reg_[a] | k);
+    reg_[d] = is_sm ? DebugSpReg(reg_[a] | k) : SpReg(reg_[a] | k);
     IncrementPC();
     break;
   case 0x2e:  // Multiple instructions.
@@ -669,7 +919,8 @@ bool CPU::RunInstruction(const uint32 instruction) {
     DECODE_A();
     DECODE_B();
     ea = reg_[a] + i;
-    dmmu_.Store32(ea, reg_[b], &exception, sr_ & kSM);
+    CountEvent<kIsReference, kIsSupervisor>(kEventStore);
+    DMMU_ACCESS(Store32, ea, reg_[b], &exception);
     if (exception != kExceptionNone) {
       ThrowException(exception, ea);
     } else {
@@ -681,7 +932,8 @@ bool CPU::RunInstruction(const uint32 instruction) {
     DECODE_A();
     DECODE_B();
     ea = reg_[a] + i;
-    dmmu_.Store8(ea, reg_[b] & 0xff, &exception, sr_ & kSM);
+    CountEvent<kIsReference, kIsSupervisor>(kEventStore);
+    DMMU_ACCESS(Store8, ea, reg_[b] & 0xff, &exception);
     if (exception != kExceptionNone) {
       ThrowException(exception, ea);
     } else {
@@ -693,7 +945,8 @@ bool CPU::RunInstruction(const uint32 instruction) {
     DECODE_A();
     DECODE_B();
     ea = reg_[a] + i;
-    dmmu_.Store16(ea, reg_[b] & 0xffff, &exception, sr_ & kSM);
+    CountEvent<kIsReference, kIsSupervisor>(kEventStore);
+    DMMU_ACCESS(Store16, ea, reg_[b] & 0xffff, &exception);
     if (exception != kExceptionNone) {
       ThrowException(exception, ea);
     } else {
@@ -767,6 +1020,9 @@ bool CPU::RunInstruction(const uint32 instruction) {
     case 0xc9:  // 1110 00DD DDDA AAAA BBBB B-11 ---- 1001 l.div
       if (reg_[b] == 0) {
         reg_[d] = 0;
+      } else if (reg_[a] == 0x80000000 && reg_[b] == 0xffffffff) {
+        // Overflows, and traps on x86 hosts.
+        reg_[d] = 0x80000000;
       } else {
         reg_[d] = static_cast<int32>(reg_[a]) / static_cast<int32>(reg_[b]);
       }
@@ -847,16 +1103,128 @@ void CPU::SetSupReg(uint32 value) {
   SetSpReg(kSpRegSup, value);
 }
 
-void CPU::CheckInterrupts() {
-  const uint32 new_picsr = bus_->Interrupts();
-  if (new_picsr != picsr_) {
-    picsr_ = new_picsr;
-    pending_interrupt_ = picsr_ != 0;
+uint32 CPU::SelectedEventCount(size_t counter) const {
+  const uint32 mode = pcmr_[counter];
+  uint64 count = 0;
+  for (size_t i = 0; i < kEventCount; i++) {
+    if (mode & kPCMREventBits[i]) {
+      if (mode & kPCMRCIUM) {
+        count += EventCount(0, static_cast<Event>(i));
+      }
+      if (mode & kPCMRCISM) {
+        count += EventCount(1, static_cast<Event>(i));
+      }
+    }
+  }
+  return count;
+}
+
+uint32 CPU::PerfCount(size_t counter) const {
+  return pccr_offset_[counter] + SelectedEventCount(counter);
+}
+
+#ifdef SIMCTTY_WASM_BLOCKS
+size_t CPU::RunCompiledBlock(size_t cycles) {
+  // Room for the longest block, which mustn't span a tick timer match.
+  if (cycles < BlockCompiler::kMaxLength || in_delay_slot_) {
+    return 0;
+  }
+  if (ttmr_ >> 30 == 3 && ttmr_ & kTTMRIE &&
+      ((ttmr_ - ttcr_ - 1) & kTTMRTimePeriodMask) <
+      BlockCompiler::kMaxLength) {
+    return 0;
+  }
+
+  // A jump to another page gets here before the engine has fetched from it,
+  // so take the fetch's own fast paths: a page fetched from recently, or
+  // RAM with the MMU off.
+  const uint32 page = pc_ & 0xffffe000;
+  if (page != authed_page_) {
+    const size_t fetch_slot = (pc_ >> 13) % kFetchPageCount;
+    if (sr_ & kIME) {
+      if (fetch_page_[fetch_slot] != page) {
+        return 0;
+      }
+      authed_phy_ = fetch_phy_[fetch_slot];
+    } else if (page <= kMaxRamAddress) {
+      authed_phy_ = page;
+    } else {
+      return 0;
+    }
+    authed_page_ = page;
   }
 
-  if (sr_ & kIEE && pending_interrupt_ && picsr_ & picmr_) {
+  // A return's block is still current if the page hasn't been written to
+  // since it was pushed.
+  RAM* ram = bus_->GetRAM();
+  const uint32 phy = authed_phy_ + (pc_ & 0x1fff);
+  const BlockCache::Block* block = return_block_;
+  return_block_ = nullptr;
+  if (!block || block->phy != phy || !block->is_compiled ||
+      block->generation != return_generation_ ||
+      ram->CodeGeneration(phy) != return_generation_) {
+    block = block_cache_->Lookup(phy, ram);
+    if (!block) {
+      return 0;
+    }
+  }
+
+  // Sets pc_, registers and SR[F].
+  const uint32 result = block_cache_->Run(block, pc_);
+  const size_t retired = result & BlockCompiler::kRetiredMask;
+
+  ttcr_ += retired;
+  uint64* events = events_[sr_ & kSM];
+  events[kEventLoad] += block->compiled.loads[retired];
+  if (result & BlockCompiler::kTaken) {
+    ++events[kEventBranch];
+  }
+
+  if (retired == block->compiled.length && block->compiled.is_branch_ending) {
+    is_block_boundary_ = true;
+
+    const uint32 mode = sr_ & (kSM | kIME);
+    if (block->compiled.is_call_ending) {
+      // r9 holds the return address, usually on this page.
+      ReturnEntry* entry = &return_stack_[return_top_];
+      return_top_ = (return_top_ + 1) % kReturnStackSize;
+      entry->pc = (reg_[9] & 0xffffe000) == authed_page_ ? reg_[9] : 0x1;
+      entry->mode = mode;
+      entry->phy = authed_phy_;
+      entry->block = entry->pc == 0x1 ? nullptr :
+          block_cache_->Find(authed_phy_ + (reg_[9] & 0x1fff), ram);
+      entry->generation = entry->block ? entry->block->generation : 0;
+    } else if (block->compiled.is_return_ending) {
+      return_top_ = (return_top_ - 1) % kReturnStackSize;
+      ReturnEntry* entry = &return_stack_[return_top_];
+      if (entry->pc == pc_ && entry->mode == mode) {
+        // Back on the caller's page, where the next block is compiled.
+        authed_page_ = pc_ & 0xffffe000;
+        authed_phy_ = entry->phy;
+        return_block_ = entry->block;
+        return_generation_ = entry->generation;
+      }
+      entry->pc = 0x1;
+      entry->block = nullptr;
+    }
+  }
+  return retired;
+}
+
+void CPU::ClearReturnStack() {
+  for (size_t i = 0; i < kReturnStackSize; i++) {
+    return_stack_[i].pc = 0x1;
+    return_stack_[i].block = nullptr;
+  }
+  return_top_ = 0;
+  return_block_ = nullptr;
+}
+#endif
+
+void CPU::CheckInterrupts() {
+  // Level triggered, taken again after l.rfe until the device is serviced.
+  if (sr_ & kIEE && pic_->IsPending()) {
     ThrowException(kExceptionExternalInterrupt);
-    pending_interrupt_ = false;
   }
 }
 
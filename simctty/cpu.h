@@ -8,25 +8,41 @@
 
 #include <string>
 
+#ifdef SIMCTTY_WASM_BLOCKS
+#include "simctty/block_cache.h"
+#endif
 #include "simctty/bus.h"
 #include "simctty/mmu.h"
+#include "simctty/pic.h"
 #include "simctty/types.h"
 
 using std::string;
 
 class CPU {
  public:
+  // How Run() executes instructions. The reference engine flushes every fast
+  // path cache before each instruction, so each fetch and data access takes
+  // the full translation path; lockstep.h checks other engines against it.
+  enum Engine {
+    kEngineFast,
+    kEngineReference
+  };
+
   CPU(Bus* bus);
   ~CPU();
 
   bool Run(size_t cycles = 1);
 
+  void SetEngine(Engine engine);
+
   void Reset();
 
   uint32 Reg(reg_t reg) const;
   void SetReg(reg_t reg, uint32 value);
 
   uint32 SpReg(uint16 reg) const;
+  // As the debug unit reads them, whatever the privilege level.
+  uint32 DebugSpReg(uint16 reg) const;
   void SetSpReg(uint16 reg, uint32 value);
   void SetSupReg(uint32 value);
 
@@ -35,6 +51,7 @@ class CPU {
 
   bool IsFlagSet() const;
 
+  // Instructions fetched for execution since reset.
   uint64 InstructionRunCount() const;
 
   // Supervision register bits.
@@ -59,16 +76,11 @@ class CPU {
   const static size_t kRegCount = 32;
 
  private:
-  // System bus.
-  Bus* bus_;
-  uint8* raw_;
-
-  // Memory management units.
-  MMU immu_;  // Instruction MMU.
-  MMU dmmu_;  // Data MMU.
-
-  // Main registers.
-  uint32 reg_[kRegCount];
+  // Hot state, used by nearly every instruction, comes first so it spans as
+  // few cache lines as it can (172 bytes on x86-64, three lines when the
+  // CPU is line aligned) and sits at fixed offsets for generated code
+  // (block_compiler.h). Everything after it is cold, or, like the event
+  // counts, touched by some instructions only.
 
   // Program counter.
   uint32 pc_;
@@ -76,40 +88,164 @@ class CPU {
   // Supervision register.
   uint32 sr_;
 
-  // Other group 0 special registers.
-  uint32 epcr0_;
-  uint32 eear0_;
-  uint32 esr0_;
+  bool in_delay_slot_;
+
+  // Set when control has just transferred (a jump landing, an SR or PICMR
+  // write), where a pending interrupt is checked for.
+  bool is_block_boundary_;
 
-  // Group 9 special registers (programmable interrupt controller).
-  uint32 picmr_;
-  uint32 picsr_;
-  bool pending_interrupt_;
+  uint32 delayed_next_pc_;
+
+  // Instruction fetch fast path: the virtual page last fetched from and the
+  // physical page it maps to, 0x1 if none.
+  uint32 authed_page_;
+  uint32 authed_phy_;
 
   // Group 10 special registers (tick timer).
   uint32 ttmr_;  // Tick Timer Mode Register.
   uint32 ttcr_;  // Tick Timer Count Register. Overflows by design.
 
+  uint8* raw_;
+
+  // Main registers.
+  uint32 reg_[kRegCount];
+
+  // Group 8 special registers (performance counters unit), derived from
+  // event counts kept per privilege level. A PCCR holds the offset from the
+  // sum of the events its PCMR selects, so counting costs one increment per
+  // load, store and branch whatever the guest has programmed. Fetches cost
+  // nothing extra, see fetch_ttcr_. The counts themselves (events_) are kept
+  // with the cold state.
+  enum Event {
+    kEventFetch,
+    kEventLoad,
+    kEventStore,
+    kEventBranch,
+    kEventDTLBMiss,
+    kEventITLBMiss,
+    kEventCount
+  };
+
+  // Every fetch steps ttcr_ already, so fetches aren't counted one by one:
+  // those since ttcr_ was fetch_ttcr_ are added to events_ when SR or TTCR
+  // is written and after each engine run. The rare steps without a fetch (a
+  // tick timer interrupt, a fetch fault) step fetch_ttcr_ too.
+  uint32 fetch_ttcr_;
+  void AddFetches();
+  uint64 EventCount(size_t is_sm, Event event) const;
+
+  // Cold state.
+
+  // System bus.
+  Bus* bus_;
+  PIC* pic_;
+
+  Engine engine_;
+
+  // Other group 0 special registers.
+  uint32 epcr0_;
+  uint32 eear0_;
+  uint32 esr0_;
+
+  // Group 9 special registers live in the programmable interrupt
+  // controller.
+
   const static uint32 kTTMRTimePeriodMask = 0xFFFFFFF;
   const static uint32 kTTMRIP = 1 << 28; // TT Interrupt Pending bit.
   const static uint32 kTTMRIE = 1 << 29; // TT Interrupt Enable bit.
 
-  bool in_delay_slot_;
-  uint32 delayed_next_pc_;
-
-  uint32 authed_page_;
-  uint32 authed_phy_;
+  const static size_t kPerfCounterCount = 8;
+  uint32 pcmr_[kPerfCounterCount];  // Performance Counters Mode Registers.
+  uint32 pccr_offset_[kPerfCounterCount];
+
+  const static uint32 kPCMRCP = 1 << 0;     // Counter Present.
+  const static uint32 kPCMRUMRA = 1 << 1;   // User Mode Read Access.
+  const static uint32 kPCMRCISM = 1 << 2;   // Count In Supervisor Mode.
+  const static uint32 kPCMRCIUM = 1 << 3;   // Count In User Mode.
+
+  // Instruction fetch translations of recently used pages with the IMMU on,
+  // so a jump or branch off the fast path page needn't go back through the
+  // ITLB. Indexed by virtual page number; writing an ITLB set drops the
+  // entries for pages in that set. Instruction translation doesn't depend
+  // on SR[SM] (either execute permission will do), so SR writes keep them.
+  const static size_t kFetchPageCount = 256;  // A multiple of ITLB sets.
+  const static size_t kITLBSetCount = 64;
+  uint32 fetch_page_[kFetchPageCount];  // Virtual page, 0x1 if none.
+  uint32 fetch_phy_[kFetchPageCount];
+  void ClearFetchPages(size_t set);
+
+  // Memory management units, each with 1KB of TLB registers.
+  MMU immu_;  // Instruction MMU.
+  MMU dmmu_;  // Data MMU.
 
+  // Event counts, indexed by SR[SM].
+  uint64 events_[2][kEventCount];
+
+#ifdef SIMCTTY_WASM_BLOCKS
+  // Blocks compiled to wasm, entered at block boundaries.
+  BlockCache* block_cache_;
+  size_t RunCompiledBlock(size_t cycles);
+
+  // Shadow return stack, pushed by compiled calls and popped by compiled
+  // returns (l.jr r9). Each entry holds the return address, the fetch
+  // translation of its page and the block compiled there, so a return to
+  // another page carries straight on into the caller's block after one PC
+  // comparison, without a lookup.
+  struct ReturnEntry {
+    uint32 pc;    // 0x1 if none.
+    uint32 mode;  // SR[SM] and SR[IME] when pushed.
+    uint32 phy;   // Physical page.
+    const BlockCache::Block* block;  // At pc when pushed, nullptr if none.
+    uint32 generation;               // Its generation when pushed.
+  };
+  const static size_t kReturnStackSize = 16;  // A power of 2.
+  ReturnEntry return_stack_[kReturnStackSize];
+  size_t return_top_;
+  void ClearReturnStack();
+
+  // The block a matched return left for the next RunCompiledBlock().
+  const BlockCache::Block* return_block_;
+  uint32 return_generation_;
+#endif
+
+  // Why an engine returned to Run().
+  enum EngineExit {
+    kExitHalt,        // l.nop 1 or l.trap.
+    kExitSliceEnd,    // All the cycles run, or the slice cut short.
+    kExitModeSwitch,  // SR[SM], SR[IME] or SR[DME] changed.
+  };
+
+  // Engines are specialised on the privilege level and whether the MMUs are
+  // enabled, so fetches, loads, stores and event counts don't test them.
+  // Each runs from *i until cycles or until SR switches mode (which always
+  // marks a block boundary). The reference engine, <true, false, false,
+  // false>, isn't: it ignores the mode parameters, reads SR[SM] for every
+  // instruction and goes through the MMUs' own enable checks, so it shares
+  // none of the specialised paths it is checked against.
+  template <bool kIsReference, bool kIsSupervisor, bool kIsIMMUEnabled,
+            bool kIsDMMUEnabled>
+  EngineExit RunEngine(size_t cycles, size_t* i);
+  template <bool kIsReference, bool kIsSupervisor, bool kIsDMMUEnabled>
   bool RunInstruction(const uint32 instruction);
 
   void ThrowException(Exception exception, uint32 effective_address = 0);
   void IncrementPC();
-  void Jump(uint32 next_pc); // returns true if going to delay slot.
+  template <bool kIsReference, bool kIsSupervisor>
+  void Jump(uint32 next_pc);
   void SetCompareFlag(bool flag);
 
   void CheckInterrupts();
 
+  void CountEvent(Event event);
+  template <bool kIsReference, bool kIsSupervisor>
+  void CountEvent(Event event);
+  uint32 SelectedEventCount(size_t counter) const;
+  uint32 PerfCount(size_t counter) const;
+
   FRIEND_TEST(CPUTest, BusException);
+#ifdef SIMCTTY_WASM_BLOCKS
+  friend class CompiledBlockTest;
+#endif
   DISALLOW_COPY_AND_ASSIGN(CPU);
 };
 
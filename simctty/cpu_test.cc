@@ -432,6 +432,93 @@ TEST_F(CPUTest, l_mtspr) {
   ASSERT_EQ(magic, cpu_->SpReg(kSpRegEPCR0));
 }
 
+TEST_F(CPUTest, FetchCountIgnoresTTCRWrites) {
+  asm_.l_ori(kR1, kR0, 0x1234);
+  asm_.l_mtspr(kR0, kR1, (10 << 11) | 1);  // TTCR.
+  asm_.l_nop();
+  asm_.l_trap();
+
+  Run();
+
+  ASSERT_EQ(4U, cpu_->InstructionRunCount());
+  ASSERT_EQ(0x1236U, cpu_->SpReg((10 << 11) | 1));
+}
+
+#ifdef SIMCTTY_WASM_BLOCKS
+TEST_F(CPUTest, InstructionCacheBlockInvalidate) {
+  asm_.l_ori(kR1, kR0, 0x4010);
+  asm_.l_mtspr(kR0, kR1, (4 << 11) | 2);  // ICBIR.
+  asm_.l_trap();
+
+  RAM* ram = system_.GetRAM();
+  ram->SetIsCodePage(0x4000);
+  const uint32 generation = ram->CodeGeneration(0x4000);
+
+  Run();
+
+  ASSERT_NE(generation, ram->CodeGeneration(0x4000));
+}
+#endif
+
+TEST_F(CPUTest, ExternalInterruptAtBlockBoundary) {
+  const uint16 kSpRegPICMR = 9<<11 | 0;
+
+  // Unmask the UART's line and enable interrupts.
+  asm_.l_ori(kR1, kR0, 0x4);
+  asm_.l_mtspr(kR0, kR1, kSpRegPICMR);
+  asm_.l_ori(kR1, kR0, CPU::kFO | CPU::kSM | CPU::kIEE);
+  asm_.l_mtspr(kR0, kR1, kSpRegSup);
+
+  // Enabling the UART's THRE interrupt raises it at once, mid-slice.
+  asm_.l_movhi(kR2, 0x9000);
+  asm_.l_ori(kR3, kR0, 0x2);
+  asm_.l_sb(kR2, kR3, 1);
+  asm_.l_addi(kR4, kR0, 1);  // Runs, not a block boundary.
+  asm_.l_j(2);
+  asm_.l_nop();  // Delay slot.
+  asm_.l_addi(kR5, kR0, 1);  // Interrupted before this.
+  asm_.l_trap();
+
+  asm_.SetAddress(exceptionHandlers[kExceptionExternalInterrupt].pc);
+  asm_.l_trap();
+
+  Run(100);
+
+  ASSERT_EQ(1U, cpu_->Reg(4));
+  ASSERT_EQ(0U, cpu_->Reg(5));
+  ASSERT_EQ(exceptionHandlers[kExceptionExternalInterrupt].pc + 4,
+            cpu_->PC());
+  ASSERT_EQ(0x28U, cpu_->SpReg(kSpRegEPCR0));
+}
+
+TEST_F(CPUTest, PerformanceCounters) {
+  const uint16 kSpRegPCCR0 = 8<<11 | 0;
+  const uint16 kSpRegPCMR0 = 8<<11 | 8;
+
+  // Counter 0 loads, counter 1 stores, in supervisor mode only.
+  asm_.l_ori(kR1, kR0, 0x4 | 0x10);
+  asm_.l_mtspr(kR0, kR1, kSpRegPCMR0);
+  asm_.l_ori(kR1, kR0, 0x4 | 0x20);
+  asm_.l_mtspr(kR0, kR1, kSpRegPCMR0 + 1);
+  asm_.l_ori(kR1, kR0, 100);
+  asm_.l_mtspr(kR0, kR1, kSpRegPCCR0);
+  asm_.l_lwz(kR2, kR0, 0x100);
+  asm_.l_lwz(kR2, kR0, 0x104);
+  asm_.l_sw(kR0, kR2, 0x108);
+  asm_.l_trap();
+
+  Run();
+
+  ASSERT_EQ(102U, cpu_->SpReg(kSpRegPCCR0));
+  ASSERT_EQ(1U, cpu_->SpReg(kSpRegPCCR0 + 1));
+  ASSERT_EQ(0x4U | 0x20U | 0x1U, cpu_->SpReg(kSpRegPCMR0 + 1));
+
+  // Not counting anything stops the count.
+  cpu_->SetSpReg(kSpRegPCMR0, 0);
+  ASSERT_EQ(102U, cpu_->SpReg(kSpRegPCCR0));
+  ASSERT_EQ(10U, cpu_->InstructionRunCount());
+}
+
 const struct SFITestcase sfi_tests[] = {
   {0, 0,             1, 0, 1, 0, 1, 0, 1, 0, 1},
   {1, 0,             0, 1, 1, 0, 0, 1, 1, 0, 0},
@@ -935,6 +1022,82 @@ TEST_F(CPUTest, TLBRoutine) {
   ASSERT_EQ(0xa00U, cpu_->Reg(5));
 }
 
+// The DMMU switched on and off by SR writes part way through one Run().
+TEST_F(CPUTest, DataMMUSwitchedMidRun) {
+  asm_.l_ori(kR1, kR0, 0x1);                       // Page 0, valid.
+  asm_.l_mtspr(kR0, kR1, (1 << 11) | 512);         // DTLBMR0.
+  asm_.l_ori(kR1, kR0, 0x2300);                    // To page 1, SRE, SWE.
+  asm_.l_mtspr(kR0, kR1, (1 << 11) | 640);         // DTLBTR0.
+  asm_.l_ori(kR1, kR0, CPU::kSM | CPU::kFO | CPU::kDME);
+  asm_.l_mtspr(kR0, kR1, 17);
+  asm_.l_lwz(kR3, kR0, 0x10);
+  asm_.l_ori(kR1, kR0, CPU::kSM | CPU::kFO);
+  asm_.l_mtspr(kR0, kR1, 17);
+  asm_.l_lwz(kR4, kR0, 0x10);
+  asm_.l_nop(1);
+  asm_.SetAddress(0x2010);
+  asm_.Data(42);
+
+  Run();
+
+  ASSERT_EQ(42U, cpu_->Reg(3));
+  ASSERT_EQ(GetInstruction(4), cpu_->Reg(4));
+}
+
+// A call to a page whose ITLB entry then changes before a second call.
+TEST_F(CPUTest, BranchTargetRemapped) {
+  asm_.l_ori(kR1, kR0, 0x1);
+  asm_.l_mtspr(kR0, kR1, (2 << 11) | 512);         // ITLBMR0, page 0.
+  asm_.l_ori(kR1, kR0, 0x40);
+  asm_.l_mtspr(kR0, kR1, (2 << 11) | 640);         // ITLBTR0, SXE.
+  asm_.l_ori(kR1, kR0, 0x4001);
+  asm_.l_mtspr(kR0, kR1, (2 << 11) | 514);         // ITLBMR2, page 2.
+  asm_.l_ori(kR1, kR0, 0x6040);
+  asm_.l_mtspr(kR0, kR1, (2 << 11) | 642);         // ITLBTR2, to page 3.
+  asm_.l_ori(kR1, kR0, CPU::kSM | CPU::kFO | CPU::kIME);
+  asm_.l_mtspr(kR0, kR1, 17);
+  asm_.l_jal(0x1000 - asm_.InstructionCount());
+  asm_.l_nop();
+  asm_.l_ori(kR1, kR0, 0x8040);
+  asm_.l_mtspr(kR0, kR1, (2 << 11) | 642);         // ITLBTR2, to page 4.
+  asm_.l_jal(0x1000 - asm_.InstructionCount());
+  asm_.l_nop();
+  asm_.l_nop(1);
+  asm_.SetAddress(0x6000);
+  asm_.l_jr(kR9);
+  asm_.l_ori(kR3, kR0, 3);
+  asm_.SetAddress(0x8000);
+  asm_.l_jr(kR9);
+  asm_.l_ori(kR4, kR0, 4);
+
+  Run(0x20);
+
+  ASSERT_EQ(3U, cpu_->Reg(3));
+  ASSERT_EQ(4U, cpu_->Reg(4));
+}
+
+// Into user mode with l.rfe and back with l.sys, within one Run().
+TEST_F(CPUTest, UserModeSwitchedMidRun) {
+  asm_.l_ori(kR1, kR0, 0x20);
+  asm_.l_mtspr(kR0, kR1, 32);                      // EPCR0.
+  asm_.l_ori(kR1, kR0, CPU::kFO);
+  asm_.l_mtspr(kR0, kR1, 64);                      // ESR0.
+  asm_.l_rfe();
+  asm_.SetAddress(0x20);
+  asm_.l_mfspr(kR3, kR0, 17);                      // Not readable.
+  asm_.l_nop(1);                                   // Doesn't halt.
+  asm_.l_sys();
+  asm_.SetAddress(0xc00);
+  asm_.l_mfspr(kR4, kR0, 17);
+  asm_.l_nop(1);
+
+  Run();
+
+  ASSERT_EQ(0U, cpu_->Reg(3));
+  ASSERT_NE(0U, cpu_->Reg(4) & CPU::kSM);
+  ASSERT_EQ(0xc04U, cpu_->PC());
+}
+
 TEST_F(CPUTest, 10MInstructions) {
   asm_.l_addi(kR1, kR1, 1);
   asm_.l_addi(kR1, kR1, 1);
@@ -945,6 +1108,6 @@ TEST_F(CPUTest, 10MInstructions) {
   asm_.l_addi(kR1, kR1, 1);
 
   Run(10000000);
-  //ASSERT_EQ(10000000U, cpu_->InstructionRunCount());
+  ASSERT_EQ(10000000U, cpu_->InstructionRunCount());
 }
 
@@ -13,6 +13,10 @@ bool sys_run() {
   return sys.Run(cycles_per_iteration);
 }
 
+bool sys_run_cycles(int cycles) {
+  return sys.Run(cycles);
+}
+
 void sys_keypress(uint8 key) {
   sys.GetUART()->Keypress(key);
 }
@@ -24,5 +28,15 @@ bool sys_can_read() {
 uint8 sys_read() {
   return sys.GetUART()->Read();
 }
+
+// Bulk console transfer, a call per slice rather than per byte (see
+// web/simctty_worker.js). Return the number of bytes moved.
+int sys_write_buffer(const uint8* data, int length) {
+  return sys.GetUART()->WriteBuffer(data, length);
+}
+
+int sys_read_buffer(uint8* data, int length) {
+  return sys.GetUART()->ReadBuffer(data, length);
+}
 }
 
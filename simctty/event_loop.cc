@@ -0,0 +1,283 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/event_loop.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+using std::min;
+
+namespace {
+
+// epoll_event.data tags.
+const uint32 kInputEvent = 0;
+const uint32 kTimerEvent = 1;
+const uint32 kConsoleEvent = 2;
+
+uint64 NowNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// Writes all of data to fd, retrying on short writes.
+bool WriteAll(int fd, const uint8* data, size_t length) {
+  while (length > 0) {
+    const ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    data += written;
+    length -= written;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+EventLoop::EventLoop(SerialPort* port, int input_fd, int output_fd)
+  :
+    port_(port),
+    input_fd_(input_fd),
+    output_fd_(output_fd),
+    is_input_always_ready_(false),
+    is_input_watched_(false),
+    console_(nullptr),
+    console_fd_(-1),
+    epoll_fd_(-1),
+    timer_fd_(-1),
+    is_paced_(false),
+    slice_credit_(0),
+    next_poll_ns_(0) {
+}
+
+EventLoop::EventLoop(SerialPort* port, Console* console)
+  :
+    port_(port),
+    input_fd_(-1),
+    output_fd_(-1),
+    is_input_always_ready_(false),
+    is_input_watched_(false),
+    console_(console),
+    console_fd_(-1),
+    epoll_fd_(-1),
+    timer_fd_(-1),
+    is_paced_(false),
+    slice_credit_(0),
+    next_poll_ns_(0) {
+}
+
+EventLoop::~EventLoop() {
+  if (timer_fd_ >= 0) {
+    close(timer_fd_);
+  }
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+}
+
+bool EventLoop::Init() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    perror("epoll_create1");
+    return false;
+  }
+
+  if (input_fd_ >= 0) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = kInputEvent;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, input_fd_, &event) != 0) {
+      if (errno != EPERM) {
+        perror("epoll_ctl input");
+        return false;
+      }
+      is_input_always_ready_ = true;
+    } else {
+      is_input_watched_ = true;
+    }
+  }
+
+  return true;
+}
+
+bool EventLoop::SetPacing(uint64 period_ns) {
+  if (timer_fd_ < 0) {
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_ < 0) {
+      perror("timerfd_create");
+      return false;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = kTimerEvent;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &event) != 0) {
+      perror("epoll_ctl timer");
+      return false;
+    }
+  }
+
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = period_ns / 1000000000;
+  spec.it_interval.tv_nsec = period_ns % 1000000000;
+  spec.it_value = spec.it_interval;
+  if (timerfd_settime(timer_fd_, 0, &spec, NULL) != 0) {
+    perror("timerfd_settime");
+    return false;
+  }
+
+  is_paced_ = period_ns != 0;
+  slice_credit_ = 0;
+  return true;
+}
+
+void EventLoop::AfterSlice() {
+  Flush();
+
+  if (is_paced_ && slice_credit_ == 0) {
+    // Ahead of wall time, sleep until the next slice is due or input arrives.
+    Wait(-1);
+  } else if (NowNs() >= next_poll_ns_) {
+    Wait(0);
+  }
+
+  if (slice_credit_ > 0) {
+    slice_credit_--;
+  }
+}
+
+void EventLoop::Flush() {
+  if (console_) {
+    console_->Flush();
+    return;
+  }
+
+  const size_t kBufferSize = 65536;
+  uint8 buffer[kBufferSize];
+
+  size_t length;
+  while ((length = port_->ReadBuffer(buffer, kBufferSize)) > 0) {
+    WriteAll(output_fd_, buffer, length);
+  }
+}
+
+void EventLoop::Wait(int timeout_ms) {
+  const int kMaxEvents = 3;
+  struct epoll_event events[kMaxEvents];
+
+  if (console_) {
+    WatchConsole();
+  }
+  if (is_input_always_ready_ && input_fd_ >= 0) {
+    ReadInput();
+  } else {
+    WatchInput();
+  }
+
+  const int count = epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+  for (int i = 0; i < count; i++) {
+    switch (events[i].data.u32) {
+    case kInputEvent:
+      ReadInput();
+      break;
+    case kTimerEvent:
+      ReadTimer();
+      break;
+    case kConsoleEvent:
+      console_->Pump();
+      break;
+    }
+  }
+
+  next_poll_ns_ = NowNs() + kPollIntervalNs;
+}
+
+void EventLoop::ReadInput() {
+  const size_t kBufferSize = 4096;
+  uint8 buffer[kBufferSize];
+
+  // Only take what the device can hold, the rest stays queued in the kernel.
+  const size_t space = min(kBufferSize, port_->WriteBufferFree());
+  if (space == 0) {
+    return;
+  }
+
+  const ssize_t length = read(input_fd_, buffer, space);
+  if (length > 0) {
+    port_->WriteBuffer(buffer, length);
+  } else if (length == 0 || (errno != EAGAIN && errno != EINTR)) {
+    // End of input, stop watching it. A non-blocking input another reader
+    // emptied first just has nothing for now.
+    if (is_input_watched_) {
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, input_fd_, NULL);
+      is_input_watched_ = false;
+    }
+    input_fd_ = -1;
+  }
+}
+
+void EventLoop::ReadTimer() {
+  uint64 expirations;
+  if (read(timer_fd_, &expirations, sizeof(expirations)) ==
+      sizeof(expirations)) {
+    slice_credit_ += expirations;
+    if (slice_credit_ > kMaxSliceCredit) {
+      slice_credit_ = kMaxSliceCredit;
+    }
+  }
+}
+
+void EventLoop::WatchInput() {
+  if (input_fd_ < 0) {
+    return;
+  }
+
+  const bool has_room = port_->WriteBufferFree() > 0;
+  if (has_room == is_input_watched_) {
+    return;
+  }
+
+  if (has_room) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = kInputEvent;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, input_fd_, &event);
+  } else {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, input_fd_, NULL);
+  }
+  is_input_watched_ = has_room;
+}
+
+void EventLoop::WatchConsole() {
+  // Changes when a client connects or hangs up. A closed descriptor has
+  // already left the epoll set, so failure to remove it is expected.
+  const int fd = console_->PollFd();
+  if (fd == console_fd_) {
+    return;
+  }
+
+  if (console_fd_ >= 0) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, console_fd_, NULL);
+  }
+
+  console_fd_ = fd;
+  if (console_fd_ >= 0) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = kConsoleEvent;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, console_fd_, &event);
+  }
+}
@@ -0,0 +1,74 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_EVENT_LOOP_H_
+#define SIMCTTY_EVENT_LOOP_H_
+
+#include "simctty/console.h"
+#include "simctty/types.h"
+#include "simctty/serial_port.h"
+
+// Host side of a guest console, run between CPU slices: either a pair of
+// terminal descriptors or a Console backend. Uses epoll for input and timerfd
+// for pacing (Linux only).
+//
+// Guest output is written in bulk after every slice. Input is polled at most
+// once per kPollIntervalNs of wall time, so a slice with no input costs no
+// system calls at all. When paced, the loop sleeps until the next slice is
+// due, waking early if input arrives so the guest sees it immediately.
+class EventLoop {
+ public:
+  EventLoop(SerialPort* port, int input_fd, int output_fd);
+  EventLoop(SerialPort* port, Console* console);
+  ~EventLoop();
+
+  bool Init();
+
+  // Limit the guest to one slice per period_ns of wall time. 0 to run flat
+  // out.
+  bool SetPacing(uint64 period_ns);
+
+  // Call after each CPU slice.
+  void AfterSlice();
+
+  // Write out all pending guest output.
+  void Flush();
+
+ private:
+  SerialPort* port_;
+  int input_fd_;
+  int output_fd_;
+
+  // A regular file (or anything else epoll refuses) is always readable, so
+  // it is read on every poll instead.
+  bool is_input_always_ready_;
+
+  // Whether input_fd_ is in the epoll set. It is left out while the device
+  // has no room, or the level triggered fd would end every paced wait.
+  bool is_input_watched_;
+
+  Console* console_;
+  int console_fd_;  // console_->PollFd() as registered with epoll.
+
+  int epoll_fd_;
+  int timer_fd_;
+
+  // Slices the guest may run before it catches up with wall time. Capped so
+  // a stall on the host doesn't lead to a long burst afterwards.
+  bool is_paced_;
+  uint64 slice_credit_;
+  uint64 next_poll_ns_;
+
+  const static uint64 kPollIntervalNs = 1000000;
+  const static uint64 kMaxSliceCredit = 100;
+
+  void Wait(int timeout_ms);
+  void ReadInput();
+  void ReadTimer();
+  void WatchInput();
+  void WatchConsole();
+
+  DISALLOW_COPY_AND_ASSIGN(EventLoop);
+};
+
+#endif  // SIMCTTY_EVENT_LOOP_H_
@@ -0,0 +1,106 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "simctty/event_loop.h"
+#include "simctty/uart.h"
+
+class EventLoopTest : public ::testing::Test {
+ public:
+  EventLoopTest() {
+    pipe(input_);
+    pipe(output_);
+  }
+
+  ~EventLoopTest() {
+    close(input_[0]);
+    close(input_[1]);
+    close(output_[0]);
+    close(output_[1]);
+  }
+
+  UART uart_;
+  int input_[2];
+  int output_[2];
+};
+
+TEST_F(EventLoopTest, InputAndOutput) {
+  EventLoop loop(&uart_, input_[0], output_[1]);
+  ASSERT_TRUE(loop.Init());
+
+  ASSERT_EQ(3, write(input_[1], "ls\n", 3));
+
+  Exception exception;
+  uart_.Store8(kMinUartAddress, 'o', &exception);
+  uart_.Store8(kMinUartAddress, 'k', &exception);
+
+  loop.AfterSlice();
+
+  // Input moved to the UART.
+  ASSERT_EQ('l', uart_.Load8(kMinUartAddress, &exception));
+  ASSERT_EQ('s', uart_.Load8(kMinUartAddress, &exception));
+  ASSERT_EQ('\n', uart_.Load8(kMinUartAddress, &exception));
+
+  // Output written in one go.
+  char buffer[16];
+  ASSERT_EQ(2, read(output_[0], buffer, sizeof(buffer)));
+  ASSERT_EQ(0, memcmp("ok", buffer, 2));
+}
+
+TEST_F(EventLoopTest, PacedInputWakes) {
+  EventLoop loop(&uart_, input_[0], output_[1]);
+  ASSERT_TRUE(loop.Init());
+
+  // A pacing period far longer than the test: only input can end the wait.
+  ASSERT_TRUE(loop.SetPacing(60ULL * 1000000000));
+  ASSERT_EQ(1, write(input_[1], "x", 1));
+  loop.AfterSlice();
+
+  Exception exception;
+  ASSERT_EQ('x', uart_.Load8(kMinUartAddress, &exception));
+}
+
+TEST_F(EventLoopTest, PacedWaitWithFullDevice) {
+  EventLoop loop(&uart_, input_[0], output_[1]);
+  ASSERT_TRUE(loop.Init());
+
+  // Input the UART has no room for mustn't end the wait early.
+  uint8 fill[64] = {0};
+  while (uart_.WriteBuffer(fill, sizeof(fill)) > 0) {
+  }
+  ASSERT_EQ(1, write(input_[1], "x", 1));
+  ASSERT_TRUE(loop.SetPacing(50000000));
+
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  loop.AfterSlice();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  const int64 elapsed_ns = (end.tv_sec - start.tv_sec) * 1000000000LL +
+      (end.tv_nsec - start.tv_nsec);
+  ASSERT_LE(40000000, elapsed_ns);
+}
+
+TEST_F(EventLoopTest, RegularFileInput) {
+  FILE* file = tmpfile();
+  ASSERT_TRUE(file != nullptr);
+  ASSERT_EQ(2, write(fileno(file), "ok", 2));
+  ASSERT_EQ(0, lseek(fileno(file), 0, SEEK_SET));
+
+  // epoll won't watch a regular file, it is read on every poll instead.
+  EventLoop loop(&uart_, fileno(file), output_[1]);
+  ASSERT_TRUE(loop.Init());
+  loop.AfterSlice();
+
+  Exception exception;
+  ASSERT_EQ('o', uart_.Load8(kMinUartAddress, &exception));
+  ASSERT_EQ('k', uart_.Load8(kMinUartAddress, &exception));
+  fclose(file);
+}
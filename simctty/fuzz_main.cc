@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "simctty/assembler.h"
+#include "simctty/fuzzer.h"
+#include "simctty/lockstep.h"
+
+using std::vector;
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [-m] [-s seed] [-n programs] [-l length]\n"
+          "  -s  first seed (default 1)\n"
+          "  -n  number of programs to run (default 1000)\n"
+          "  -l  instructions per program (default 1000)\n"
+          "  -m  run each program in a mode picked by its seed: user or\n"
+          "      supervisor, each MMU on or off (default supervisor, off)\n"
+          "Runs random programs on the fast engine and the reference engine\n"
+          "and reports the first seed where they differ.\n",
+          argv0);
+}
+
+int main(int argc, char** argv) {
+  uint32 seed = 1;
+  size_t count = 1000;
+  size_t length = 1000;
+  bool is_any_mode = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:n:l:m")) != -1) {
+    switch (opt) {
+    case 's':
+      seed = strtoul(optarg, nullptr, 0);
+      break;
+    case 'n':
+      count = strtoul(optarg, nullptr, 0);
+      break;
+    case 'l':
+      length = strtoul(optarg, nullptr, 0);
+      break;
+    case 'm':
+      is_any_mode = true;
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (size_t i = 0; i < count; i++, seed++) {
+    Assembler a;
+    uint32 mode = CPU::kSM;
+    if (is_any_mode) {
+      mode = (seed & 1 ? CPU::kSM : 0) | (seed & 2 ? CPU::kIME : 0) |
+          (seed & 4 ? CPU::kDME : 0);
+    }
+    Fuzzer fuzzer(seed, mode);
+    fuzzer.Generate(length, &a);
+
+    // Only ever runs forwards, so it has halted well before this.
+    const vector<uint8> image(a.Instructions(), a.Instructions() + a.Size());
+    Lockstep lockstep(image, Fuzzer::kStartAddress, CPU::kEngineFast);
+    lockstep.SetInterval(length);
+    if (!lockstep.Run(4 * a.InstructionCount()) || !lockstep.IsHalted()) {
+      fprintf(stderr, "Seed %u failed\n", seed);
+      return EXIT_FAILURE;
+    }
+  }
+
+  fprintf(stderr, "%zu programs matched\n", count);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,416 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/fuzzer.h"
+
+#include "simctty/cpu.h"
+
+namespace {
+
+const Assembler::RegOpFunction kRegOps[] = {
+  &Assembler::l_add,
+  &Assembler::l_sub,
+  &Assembler::l_and,
+  &Assembler::l_or,
+  &Assembler::l_xor,
+  &Assembler::l_ff1,
+  &Assembler::l_sll,
+  &Assembler::l_srl,
+  &Assembler::l_sra,
+  &Assembler::l_fl1,
+  &Assembler::l_mul,
+  &Assembler::l_div,
+  &Assembler::l_divu,
+};
+
+const Assembler::SFFunction kSFs[] = {
+  &Assembler::l_sfeq,
+  &Assembler::l_sfne,
+  &Assembler::l_sfgtu,
+  &Assembler::l_sfgeu,
+  &Assembler::l_sfltu,
+  &Assembler::l_sfleu,
+  &Assembler::l_sfgts,
+  &Assembler::l_sfges,
+  &Assembler::l_sflts,
+  &Assembler::l_sfles,
+};
+
+const Assembler::SFIFunction kSFIs[] = {
+  &Assembler::l_sfeqi,
+  &Assembler::l_sfnei,
+  &Assembler::l_sfgtui,
+  &Assembler::l_sfgeui,
+  &Assembler::l_sfltui,
+  &Assembler::l_sfleui,
+  &Assembler::l_sfgtsi,
+  &Assembler::l_sfgesi,
+  &Assembler::l_sfltsi,
+  &Assembler::l_sflesi,
+};
+
+// SPRs the generated code reads, (group << 11) | index.
+const uint16 kReadSpRegs[] = {
+  17,                  // SR.
+  32, 48, 64,          // EPCR0, EEAR0, ESR0.
+  (1 << 11) | 512,     // DTLBMR0.
+  (2 << 11) | 640,     // ITLBTR0.
+  (8 << 11) | 0,       // PCCR0.
+  (8 << 11) | 8,       // PCMR0.
+  (9 << 11) | 0,       // PICMR.
+  (10 << 11) | 0,      // TTMR.
+  (10 << 11) | 1,      // TTCR.
+};
+
+const uint32 kTTMRPeriodAndIP = 0x1fffffff;
+
+// Every permission a TLB translate register grants, for data (SRE, SWE, URE,
+// UWE) or instructions (SXE, UXE).
+const uint32 kAllPermissions = 0x3c0;
+
+}  // namespace
+
+Fuzzer::Fuzzer(uint32 seed, uint32 mode)
+  :
+    random_(seed),
+    mode_(mode),
+    last_jump_(0) {
+}
+
+Fuzzer::~Fuzzer() {
+}
+
+void Fuzzer::Generate(size_t length, Assembler* a) {
+  // Any exception halts.
+  for (uint32 vector = 0x100; vector <= 0xf00; vector += 0x100) {
+    a->SetAddress(vector);
+    a->l_nop(1);
+  }
+
+  a->SetAddress(kStartAddress);
+  last_jump_ = 0;
+  if (mode_ != CPU::kSM) {
+    EnterMode(a);
+  }
+  LoadConstant(a, kBase, kDataAddress);
+  for (reg_t reg = 1; reg < kBase; reg++) {
+    LoadConstant(a, reg, Value());
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    switch (Next(16)) {
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+      Alu(a);
+      break;
+    case 4:
+    case 5:
+      Compare(a);
+      break;
+    case 6:
+    case 7:
+      Load(a);
+      break;
+    case 8:
+    case 9:
+      Store(a);
+      break;
+    case 10:
+      MoveFromSpReg(a);
+      break;
+    case 11:
+      MoveToSpReg(a);
+      break;
+    case 12:
+      if (Next(8) == 0) {
+        a->l_sys();
+        break;
+      }
+      Simple(a);
+      break;
+    default:
+      Jump(a);
+      break;
+    }
+  }
+
+  // Somewhere to land for jumps near the end.
+  for (uint32 i = 0; i <= kMaxSkip; i++) {
+    a->l_nop();
+  }
+  if (mode_ & CPU::kSM) {
+    a->l_nop(1);
+  } else {
+    a->l_trap();  // l.nop 1 only halts in supervisor mode.
+  }
+
+  a->SetAddress(kDataAddress);
+  for (uint32 i = 0; i < kDataSize / 4; i++) {
+    a->Data(random_());
+  }
+}
+
+uint32 Fuzzer::Next(uint32 limit) {
+  return random_() % limit;
+}
+
+uint32 Fuzzer::Value() {
+  switch (Next(8)) {
+  case 0:
+    return 0;
+  case 1:
+    return 1;
+  case 2:
+    return 0xffffffff;
+  case 3:
+    return 0x80000000;
+  case 4:
+    return 0x7fffffff;
+  case 5:
+    return Next(64);
+  }
+  return random_();
+}
+
+reg_t Fuzzer::Destination() {
+  return 1 + Next(kBase - 1);
+}
+
+reg_t Fuzzer::Source() {
+  return Next(CPU::kRegCount);
+}
+
+void Fuzzer::LoadConstant(Assembler* a, reg_t d, uint32 value) {
+  a->l_movhi(d, value >> 16);
+  a->l_ori(d, d, value & 0xffff);
+}
+
+// Whether no earlier jump can land part way through building a value in
+// kScratch from here, leaving a stale one to be used.
+bool Fuzzer::CanBuildScratch(const Assembler* a) const {
+  return a->InstructionCount() >= last_jump_ + kMaxSkip;
+}
+
+// Maps every page from 0 to the data area to itself in the ITLB and DTLB,
+// then returns from a pretend exception into mode_.
+void Fuzzer::EnterMode(Assembler* a) {
+  for (uint32 set = 0; set < kFreeSet; set++) {
+    for (uint16 group = 1; group <= 2; group++) {  // DMMU, IMMU.
+      LoadConstant(a, kScratch, set * kPageSize | 0x1);  // Valid.
+      a->l_mtspr(kR0, kScratch, (group << 11) | (512 + set));
+      LoadConstant(a, kScratch, set * kPageSize | kAllPermissions);
+      a->l_mtspr(kR0, kScratch, (group << 11) | (640 + set));
+    }
+  }
+
+  LoadConstant(a, kScratch, CPU::kFO | mode_);
+  a->l_mtspr(kR0, kScratch, 64);  // ESR0.
+  // After the l.rfe.
+  LoadConstant(a, kScratch, (a->InstructionCount() + 4) * 4);
+  a->l_mtspr(kR0, kScratch, 32);  // EPCR0.
+  a->l_rfe();
+}
+
+// One instruction, fit for a delay slot.
+void Fuzzer::Simple(Assembler* a) {
+  switch (Next(5)) {
+  case 0:
+  case 1:
+    Alu(a);
+    break;
+  case 2:
+    Compare(a);
+    break;
+  case 3:
+    Load(a);
+    break;
+  default:
+    Store(a);
+    break;
+  }
+}
+
+void Fuzzer::Alu(Assembler* a) {
+  const reg_t d = Destination();
+  const reg_t s = Source();
+  const uint32 k = random_();
+  switch (Next(10)) {
+  case 0:
+    a->l_addi(d, s, k);
+    break;
+  case 1:
+    a->l_andi(d, s, k);
+    break;
+  case 2:
+    a->l_ori(d, s, k);
+    break;
+  case 3:
+    a->l_xori(d, s, k);
+    break;
+  case 4:
+    a->l_slli(d, s, k & 0x1f);
+    break;
+  case 5:
+    a->l_srli(d, s, k & 0x1f);
+    break;
+  case 6:
+    a->l_srai(d, s, k & 0x1f);
+    break;
+  case 7:
+    a->l_movhi(d, k);
+    break;
+  default:
+    (a->*kRegOps[Next(sizeof(kRegOps) / sizeof(kRegOps[0]))])(d, s,
+                                                               Source());
+    break;
+  }
+}
+
+void Fuzzer::Compare(Assembler* a) {
+  if (Next(2)) {
+    (a->*kSFs[Next(sizeof(kSFs) / sizeof(kSFs[0]))])(Source(), Source());
+  } else {
+    (a->*kSFIs[Next(sizeof(kSFIs) / sizeof(kSFIs[0]))])(Source(), Value());
+  }
+}
+
+void Fuzzer::Load(Assembler* a) {
+  const reg_t d = Destination();
+  const uint32 kind = Next(5);
+  const uint32 size = kind == 0 ? 4 : kind < 3 ? 2 : 1;
+  uint32 offset = Next(kDataSize / size) * size;
+  if (size > 1 && Next(64) == 0) {
+    offset += 1;  // Alignment exception.
+  }
+
+  switch (kind) {
+  case 0:
+    a->l_lwz(d, kBase, offset);
+    break;
+  case 1:
+    a->l_lhz(d, kBase, offset);
+    break;
+  case 2:
+    a->l_lhs(d, kBase, offset);
+    break;
+  case 3:
+    a->l_lbz(d, kBase, offset);
+    break;
+  default:
+    a->l_lbs(d, kBase, offset);
+    break;
+  }
+}
+
+void Fuzzer::Store(Assembler* a) {
+  const uint32 kind = Next(3);
+  const uint32 size = 4 >> kind;
+  const uint32 offset = Next(kDataSize / size) * size;
+
+  switch (kind) {
+  case 0:
+    a->l_sw(kBase, Source(), offset);
+    break;
+  case 1:
+    a->l_sh(kBase, Source(), offset);
+    break;
+  default:
+    a->l_sb(kBase, Source(), offset);
+    break;
+  }
+}
+
+void Fuzzer::MoveFromSpReg(Assembler* a) {
+  a->l_mfspr(Destination(), kR0,
+             kReadSpRegs[Next(sizeof(kReadSpRegs) / sizeof(uint16))]);
+}
+
+void Fuzzer::MoveToSpReg(Assembler* a) {
+  uint32 kind = Next(8);
+  if ((kind == 0 || kind == 2) && !CanBuildScratch(a)) {
+    kind = 1;
+  }
+
+  switch (kind) {
+  case 0:
+    // SR: flags only, staying in mode_ with interrupts off.
+    LoadConstant(a, kScratch, mode_ | CPU::kFO |
+                 (Value() & (CPU::kF | CPU::kCY | CPU::kOV)));
+    a->l_mtspr(kR0, kScratch, 17);
+    break;
+  case 1:
+    a->l_mtspr(kR0, Source(), 32 + 16 * Next(3));  // EPCR0, EEAR0, ESR0.
+    break;
+  case 2:
+    // TTMR, disabled or continuous (the modes the CPU supports), never
+    // interrupting.
+    LoadConstant(a, kScratch, (Next(2) ? 3 << 30 : 0) |
+                 (Value() & kTTMRPeriodAndIP));
+    a->l_mtspr(kR0, kScratch, 10 << 11);
+    break;
+  case 3:
+    a->l_mtspr(kR0, Source(), (10 << 11) | 1);  // TTCR.
+    break;
+  case 4:
+    a->l_mtspr(kR0, Source(), 9 << 11);  // PICMR.
+    break;
+  case 5:
+    a->l_mtspr(kR0, Source(), (8 << 11) | Next(16));  // PCCR, PCMR.
+    break;
+  default:
+    // DTLB or ITLB match and translate registers, dropping their fast
+    // paths. With the MMUs off any will do, but the prologue's mappings
+    // have to stay.
+    if (mode_ == CPU::kSM) {
+      a->l_mtspr(kR0, Source(), ((1 + Next(2)) << 11) | (512 + Next(256)));
+    } else {
+      const uint32 set = kFreeSet + Next(128 - kFreeSet);
+      a->l_mtspr(kR0, Source(), ((1 + Next(2)) << 11) |
+                 ((Next(2) ? 512 : 640) + set));
+    }
+    break;
+  }
+}
+
+void Fuzzer::Jump(Assembler* a) {
+  const uint32 n = 1 + Next(kMaxSkip);
+
+  uint32 kind = Next(6);
+  if (kind >= 4 && !CanBuildScratch(a)) {
+    kind = 0;
+  }
+
+  switch (kind) {
+  case 0:
+    a->l_j(n);
+    break;
+  case 1:
+    a->l_jal(n);
+    break;
+  case 2:
+    a->l_bf(n);
+    break;
+  case 3:
+    a->l_bnf(n);
+    break;
+  default:
+    {
+      // To an absolute address, n instructions on from the jump.
+      const uint32 target = (a->InstructionCount() + 2 + n) * 4;
+      LoadConstant(a, kScratch, target);
+      if (Next(2)) {
+        a->l_jr(kScratch);
+      } else {
+        a->l_jalr(kScratch);
+      }
+    }
+    break;
+  }
+
+  last_jump_ = a->InstructionCount() - 1;
+
+  // Delay slot.
+  Simple(a);
+}
@@ -0,0 +1,81 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_FUZZER_H_
+#define SIMCTTY_FUZZER_H_
+
+#include <random>
+
+#include "simctty/assembler.h"
+#include "simctty/cpu.h"
+#include "simctty/types.h"
+
+// Random programs for checking execution engines against each other
+// (lockstep.h).
+//
+// A program is a run of ALU, compare, load, store, mfspr and mtspr
+// instructions with forward jumps and branches (each with its delay slot)
+// mixed in, so it always runs off the end. Loads and stores stay within a
+// data area, and the SPR writes leave interrupts disabled. Register values
+// are biased towards edge cases. Every exception vector and the end of the
+// program halt the CPU (l.nop 1, or l.trap in user mode), so an occasional
+// deliberate exception (a misaligned access or l.sys) ends the program
+// early.
+//
+// A program runs in mode, any of SR[SM], SR[IME] and SR[DME]. Unless that
+// is supervisor mode with the MMUs off, a prologue maps the code pages and
+// the data area 1:1 in both TLBs and enters the mode with l.rfe; SR and TLB
+// writes then keep to the mode and leave those entries alone.
+class Fuzzer {
+ public:
+  explicit Fuzzer(uint32 seed, uint32 mode = CPU::kSM);
+  ~Fuzzer();
+
+  // Writes a program of length random instructions, with its exception
+  // vectors and data, to an empty Assembler.
+  void Generate(size_t length, Assembler* a);
+
+  const static uint32 kStartAddress = 0x2000;
+
+ private:
+  const static uint32 kDataAddress = 0x10000;
+  const static uint32 kDataSize = 0x1000;
+
+  // TLB sets up to and including the data area's are mapped in the
+  // prologue, the code below it included.
+  const static uint32 kPageSize = 0x2000;
+  const static uint32 kFreeSet = kDataAddress / kPageSize + 1;
+
+  // Never written by the generated instructions: the data area base and a
+  // scratch register for building SPR numbers, values and jump targets.
+  const static reg_t kBase = 30;
+  const static reg_t kScratch = 31;
+
+  // Longest forward jump or branch, in instructions.
+  const static uint32 kMaxSkip = 6;
+
+  std::mt19937 random_;
+  const uint32 mode_;
+  size_t last_jump_;  // Instruction index.
+
+  uint32 Next(uint32 limit);
+  uint32 Value();
+  reg_t Destination();
+  reg_t Source();
+
+  void LoadConstant(Assembler* a, reg_t d, uint32 value);
+  bool CanBuildScratch(const Assembler* a) const;
+  void EnterMode(Assembler* a);
+  void Simple(Assembler* a);
+  void Alu(Assembler* a);
+  void Compare(Assembler* a);
+  void Load(Assembler* a);
+  void Store(Assembler* a);
+  void MoveFromSpReg(Assembler* a);
+  void MoveToSpReg(Assembler* a);
+  void Jump(Assembler* a);
+
+  DISALLOW_COPY_AND_ASSIGN(Fuzzer);
+};
+
+#endif  // SIMCTTY_FUZZER_H_
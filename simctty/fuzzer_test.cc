@@ -0,0 +1,84 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "simctty/assembler.h"
+#include "simctty/fuzzer.h"
+#include "simctty/lockstep.h"
+#include "simctty/system.h"
+
+using std::vector;
+
+TEST(FuzzerTest, EnginesMatch) {
+  for (uint32 seed = 1; seed <= 50; seed++) {
+    Assembler a;
+    Fuzzer fuzzer(seed);
+    fuzzer.Generate(500, &a);
+
+    const vector<uint8> image(a.Instructions(), a.Instructions() + a.Size());
+    Lockstep lockstep(image, Fuzzer::kStartAddress, CPU::kEngineFast);
+    lockstep.SetInterval(100);
+    ASSERT_TRUE(lockstep.Run(4 * a.InstructionCount())) << "seed " << seed;
+    ASSERT_TRUE(lockstep.IsHalted()) << "seed " << seed;
+  }
+}
+
+// User and supervisor mode, each MMU on or off.
+uint32 Mode(uint32 i) {
+  return (i & 1 ? CPU::kSM : 0) | (i & 2 ? CPU::kIME : 0) |
+      (i & 4 ? CPU::kDME : 0);
+}
+
+TEST(FuzzerTest, EnginesMatchInEveryMode) {
+  for (uint32 seed = 1; seed <= 40; seed++) {
+    Assembler a;
+    Fuzzer fuzzer(seed, Mode(seed));
+    fuzzer.Generate(500, &a);
+
+    const vector<uint8> image(a.Instructions(), a.Instructions() + a.Size());
+    Lockstep lockstep(image, Fuzzer::kStartAddress, CPU::kEngineFast);
+    lockstep.SetInterval(100);
+    ASSERT_TRUE(lockstep.Run(4 * a.InstructionCount())) << "seed " << seed;
+    ASSERT_TRUE(lockstep.IsHalted()) << "seed " << seed;
+  }
+}
+
+// Programs that run to their end (rather than halting on an exception
+// vector) are still in the mode they were generated for.
+TEST(FuzzerTest, RunsInMode) {
+  for (uint32 i = 0; i < 8; i++) {
+    size_t ended = 0;
+    for (uint32 seed = 1; seed <= 20; seed++) {
+      Assembler a;
+      Fuzzer(seed, Mode(i)).Generate(50, &a);
+
+      System system;
+      system.GetRAM()->LoadImage(a.Instructions(), a.Size());
+      CPU* cpu = system.GetCPU();
+      cpu->SetPC(Fuzzer::kStartAddress);
+      ASSERT_FALSE(system.Run(4 * a.InstructionCount()));
+      if (cpu->PC() >= Fuzzer::kStartAddress) {
+        ended++;
+        ASSERT_EQ(Mode(i), cpu->DebugSpReg(17) & (CPU::kSM | CPU::kIME |
+                                                   CPU::kDME))
+            << "seed " << seed;
+      }
+    }
+    ASSERT_LE(5U, ended) << "mode " << Mode(i);
+  }
+}
+
+TEST(FuzzerTest, SameSeedSameProgram) {
+  Assembler a;
+  Fuzzer(7).Generate(100, &a);
+  Assembler b;
+  Fuzzer(7).Generate(100, &b);
+
+  ASSERT_EQ(a.Size(), b.Size());
+  ASSERT_TRUE(std::equal(a.Instructions(), a.Instructions() + a.Size(),
+                         b.Instructions()));
+}
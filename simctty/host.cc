@@ -0,0 +1,160 @@
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "simctty/console.h"
+#include "simctty/net_backend.h"
+#include "simctty/scheduler.h"
+#include "simctty/system.h"
+
+using std::string;
+using std::vector;
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [-n vms] [-j workers] [-s socket_dir] [-N] [image]\n"
+          "  -n  number of VMs to run (default 1)\n"
+          "  -j  number of worker threads (default: one per core)\n"
+          "  -s  give each VM a Unix socket console socket_dir/vmN.sock\n"
+          "      instead of a pty\n"
+          "  -N  connect the VMs' network devices to one in-process switch\n",
+          argv0);
+}
+
+// Parses a count of at least 1, the whole of text.
+bool parse_count(const char* text, size_t* count) {
+  char* end;
+  const long value = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || value < 1 || value > INT_MAX) {
+    return false;
+  }
+  *count = value;
+  return true;
+}
+
+bool read_file(const char* filename, vector<uint8>* data) {
+  FILE* file = fopen(filename, "rb");
+  if (!file) {
+    fprintf(stderr, "Can't open %s\n", filename);
+    return false;
+  }
+
+  const size_t kBufferSize = 65536;
+  uint8 buffer[kBufferSize];
+  size_t len;
+  while ((len = fread(buffer, sizeof(uint8), kBufferSize, file)) != 0) {
+    data->insert(data->end(), buffer, buffer + len);
+  }
+
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* default_filename = "vmlinux.bin";
+  const char* filename;
+  size_t vm_count = 1;
+  size_t worker_count = std::thread::hardware_concurrency();
+  const char* socket_dir = nullptr;
+  bool is_networked = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:j:s:N")) != -1) {
+    switch (opt) {
+    case 'n':
+      if (!parse_count(optarg, &vm_count)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'j':
+      if (!parse_count(optarg, &worker_count)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 's':
+      socket_dir = optarg;
+      break;
+    case 'N':
+      is_networked = true;
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind < argc) {
+    filename = argv[optind];
+  } else {
+    filename = default_filename;
+  }
+
+  // hardware_concurrency() is 0 when it can't tell.
+  if (worker_count == 0) {
+    worker_count = 1;
+  }
+
+  // Every VM boots the same image, read it once.
+  vector<uint8> image;
+  if (!read_file(filename, &image)) {
+    return EXIT_FAILURE;
+  }
+
+  // A client going away mid-write shouldn't kill us.
+  signal(SIGPIPE, SIG_IGN);
+
+  // Declared before the scheduler, so it outlives the VMs' ports.
+  NetSwitch net_switch;
+
+  const uint64 cycles_per_iteration = 20000000 / 1000;
+  Scheduler scheduler(worker_count, cycles_per_iteration);
+
+  for (size_t i = 0; i < vm_count; i++) {
+    System* system = new System();
+    system->LoadImage(image.data(), image.size(), 0x100);
+
+    if (is_networked) {
+      // Each VM gets its own address, 52:54:00:12:xx:xx.
+      const uint8 mac[6] = { 0x52, 0x54, 0x00, 0x12,
+                             static_cast<uint8>(i >> 8),
+                             static_cast<uint8>(i) };
+      system->GetVirtioNet()->SetMacAddress(mac);
+      system->GetVirtioNet()->SetBackend(net_switch.CreatePort());
+    }
+
+    Console* console;
+    if (socket_dir) {
+      const string path = string(socket_dir) + "/vm" + std::to_string(i) +
+          ".sock";
+      console = new UnixSocketConsole(system->GetUART(), path.c_str());
+    } else {
+      console = new PtyConsole(system->GetUART());
+    }
+
+    if (!console->Open()) {
+      delete console;
+      delete system;
+      return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, "vm %zu: %s\n", i, console->Path().c_str());
+    scheduler.Add(system, console);
+  }
+  fflush(stdout);
+
+  scheduler.Run();
+
+  fprintf(stderr, "%zu quanta on %zu workers, %zu steals\n",
+          static_cast<size_t>(scheduler.QuantaRun()), scheduler.WorkerCount(),
+          static_cast<size_t>(scheduler.StealCount()));
+
+  return EXIT_SUCCESS;
+}
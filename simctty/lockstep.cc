@@ -0,0 +1,292 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/lockstep.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "simctty/ram.h"
+
+using std::max;
+using std::min;
+
+namespace {
+
+// Guest wall clock: a fixed epoch (2014-01-01) plus 50ns per instruction.
+class InstructionClock : public WallClock {
+ public:
+  explicit InstructionClock(const CPU* cpu) : cpu_(cpu) {}
+
+  virtual uint64 NowNs() {
+    return 1388534400ull * 1000000000 + cpu_->InstructionRunCount() * 50;
+  }
+
+ private:
+  const CPU* cpu_;
+};
+
+// SPRs compared, as runs of indices within a group.
+struct SpRegRun {
+  uint16 group;
+  uint16 index;
+  uint16 count;
+};
+
+const SpRegRun kComparedSpRegs[] = {
+  {0, 17, 1},    // SR.
+  {0, 32, 1},    // EPCR0.
+  {0, 48, 1},    // EEAR0.
+  {0, 64, 1},    // ESR0.
+  {1, 0, 1},     // DMMUCR.
+  {1, 512, 256}, // DTLB match and translate registers.
+  {2, 0, 1},     // IMMUCR.
+  {2, 512, 256}, // ITLB match and translate registers.
+  {8, 0, 16},    // PCCR and PCMR.
+  {9, 0, 1},     // PICMR.
+  {9, 2, 1},     // PICSR.
+  {10, 0, 2},    // TTMR and TTCR.
+};
+
+const size_t kPageSize = 0x2000;
+
+string Format(const char* format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+string Format(const char* format, ...) {
+  char buffer[128];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  return buffer;
+}
+
+}  // namespace
+
+Lockstep::Lockstep(const vector<uint8>& image, uint32 start_address,
+                   CPU::Engine candidate)
+  :
+    image_(image),
+    start_address_(start_address),
+    candidate_(candidate),
+    interval_(1000000),
+    targets_(),
+    divergent_instruction_(0) {
+  for (size_t side = 0; side < kSideCount; side++) {
+    systems_[side] = nullptr;
+    clocks_[side] = nullptr;
+    is_halted_[side] = false;
+  }
+}
+
+Lockstep::~Lockstep() {
+  Stop();
+}
+
+void Lockstep::SetInterval(uint64 interval) {
+  interval_ = max<uint64>(interval, 1);
+}
+
+bool Lockstep::Run(uint64 count) {
+  if (!systems_[0]) {
+    Start();
+  }
+
+  const uint64 end = InstructionCount() + count;
+  while (!IsHalted() && InstructionCount() < end) {
+    const uint64 from = InstructionCount();
+    Advance(min(end, from + interval_));
+
+    string difference;
+    if (!Compare(&difference)) {
+      Locate(from, difference);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool Lockstep::IsHalted() const {
+  return is_halted_[0] || is_halted_[1];
+}
+
+uint64 Lockstep::InstructionCount() const {
+  return systems_[0] ? systems_[0]->GetCPU()->InstructionRunCount() : 0;
+}
+
+uint64 Lockstep::DivergentInstruction() const {
+  return divergent_instruction_;
+}
+
+void Lockstep::Boot(System* system, bool is_candidate) {
+  system->LoadImage(image_.data(), image_.size(), start_address_);
+}
+
+void Lockstep::Start() {
+  Stop();
+
+  for (size_t side = 0; side < kSideCount; side++) {
+    System* system = new System();
+    CPU* cpu = system->GetCPU();
+    cpu->SetEngine(side == 0 ? CPU::kEngineReference : candidate_);
+    clocks_[side] = new InstructionClock(cpu);
+    system->GetRTC()->SetClock(clocks_[side]);
+    Boot(system, side != 0);
+    systems_[side] = system;
+    is_halted_[side] = false;
+  }
+  targets_.clear();
+}
+
+void Lockstep::Stop() {
+  for (size_t side = 0; side < kSideCount; side++) {
+    delete systems_[side];
+    delete clocks_[side];
+    systems_[side] = nullptr;
+    clocks_[side] = nullptr;
+  }
+}
+
+void Lockstep::Advance(uint64 target) {
+  targets_.push_back(target);
+
+  for (size_t side = 0; side < kSideCount; side++) {
+    System* system = systems_[side];
+    const CPU* cpu = system->GetCPU();
+    while (!is_halted_[side] && cpu->InstructionRunCount() < target) {
+      is_halted_[side] = !system->Run(target - cpu->InstructionRunCount());
+    }
+  }
+}
+
+bool Lockstep::Compare(string* difference) const {
+  CPU* reference = systems_[0]->GetCPU();
+  CPU* candidate = systems_[1]->GetCPU();
+
+  if (reference->InstructionRunCount() != candidate->InstructionRunCount()) {
+    *difference = Format(
+        "instruction count %llu != %llu",
+        static_cast<unsigned long long>(reference->InstructionRunCount()),
+        static_cast<unsigned long long>(candidate->InstructionRunCount()));
+    return false;
+  } else if (is_halted_[0] != is_halted_[1]) {
+    *difference = is_halted_[0] ? "only the reference halted"
+                                : "only the candidate halted";
+    return false;
+  } else if (reference->PC() != candidate->PC()) {
+    *difference = Format("pc %#x != %#x", reference->PC(), candidate->PC());
+    return false;
+  }
+
+  for (reg_t reg = 0; reg < CPU::kRegCount; reg++) {
+    if (reference->Reg(reg) != candidate->Reg(reg)) {
+      *difference = Format("r%d %#x != %#x", reg, reference->Reg(reg),
+                           candidate->Reg(reg));
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < sizeof(kComparedSpRegs) / sizeof(SpRegRun); i++) {
+    const SpRegRun& run = kComparedSpRegs[i];
+    for (uint16 index = run.index; index < run.index + run.count; index++) {
+      const uint16 reg = (run.group << 11) | index;
+      const uint32 expected = reference->DebugSpReg(reg);
+      const uint32 actual = candidate->DebugSpReg(reg);
+      if (expected != actual) {
+        *difference = Format("spr group %d index %d %#x != %#x", run.group,
+                             index, expected, actual);
+        return false;
+      }
+    }
+  }
+
+  const uint8* reference_ram = systems_[0]->GetRAM()->Raw();
+  const uint8* candidate_ram = systems_[1]->GetRAM()->Raw();
+  const size_t size = systems_[0]->GetRAM()->Size();
+  for (size_t page = 0; page < size; page += kPageSize) {
+    if (memcmp(reference_ram + page, candidate_ram + page, kPageSize) == 0) {
+      continue;
+    }
+
+    // RAM holds words in host order, report the first differing word.
+    size_t offset = page;
+    while (memcmp(reference_ram + offset, candidate_ram + offset, 4) == 0) {
+      offset += 4;
+    }
+    uint32 expected;
+    uint32 actual;
+    memcpy(&expected, reference_ram + offset, 4);
+    memcpy(&actual, candidate_ram + offset, 4);
+    *difference = Format("ram at %#zx %#x != %#x", offset, expected, actual);
+    return false;
+  }
+
+  return true;
+}
+
+void Lockstep::Locate(uint64 from, string difference) {
+  uint64 to = targets_.back();
+  vector<uint64> path(targets_.begin(), targets_.end() - 1);
+
+  // Each pass runs back to the last matching state and steps through to the
+  // mismatch in kLocateSteps smaller steps.
+  while (to - from > 1) {
+    const uint64 step = max<uint64>((to - from) / kLocateSteps, 1);
+
+    Start();
+    for (size_t i = 0; i < path.size(); i++) {
+      Advance(path[i]);
+    }
+
+    bool is_found = false;
+    while (!IsHalted() && InstructionCount() < to) {
+      const uint64 step_from = InstructionCount();
+      Advance(min(to, step_from + step));
+      if (!Compare(&difference)) {
+        from = step_from;
+        to = targets_.back();
+        path.assign(targets_.begin(), targets_.end() - 1);
+        is_found = true;
+        break;
+      }
+    }
+
+    if (!is_found) {
+      // Doesn't show up in finer steps, the state is now the matching one.
+      break;
+    }
+  }
+
+  divergent_instruction_ = to;
+  Report(difference, from, to);
+}
+
+void Lockstep::Report(const string& difference, uint64 from,
+                      uint64 to) const {
+  if (to - from > 1) {
+    fprintf(stderr, "Engines diverged between instructions %llu and %llu "
+            "(not reproduced in finer steps): %s\n",
+            static_cast<unsigned long long>(from),
+            static_cast<unsigned long long>(to), difference.c_str());
+  } else {
+    fprintf(stderr, "Engines diverged at instruction %llu: %s\n",
+            static_cast<unsigned long long>(to), difference.c_str());
+  }
+
+  const char* const kNames[kSideCount] = {"reference", "candidate"};
+  for (size_t side = 0; side < kSideCount; side++) {
+    const CPU* cpu = systems_[side]->GetCPU();
+    fprintf(stderr, "%s: count %llu pc %#x sr %#x\n", kNames[side],
+            static_cast<unsigned long long>(cpu->InstructionRunCount()),
+            cpu->PC(), cpu->DebugSpReg(17));
+    for (reg_t reg = 0; reg < CPU::kRegCount; reg++) {
+      fprintf(stderr, "  r%-2d %08x%s", reg, cpu->Reg(reg),
+              reg % 4 == 3 ? "\n" : "");
+    }
+  }
+}
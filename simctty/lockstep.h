@@ -0,0 +1,91 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_LOCKSTEP_H_
+#define SIMCTTY_LOCKSTEP_H_
+
+#include <string>
+#include <vector>
+
+#include "simctty/cpu.h"
+#include "simctty/rtc.h"
+#include "simctty/system.h"
+#include "simctty/types.h"
+
+using std::string;
+using std::vector;
+
+// Differential check of an execution engine against the reference one.
+//
+// Boots the same image on two Systems, one on CPU::kEngineReference and one
+// on the candidate engine, and runs them in lockstep. Both are driven
+// identically (same slices, same device polling, a wall clock derived from
+// the instruction count) so any difference comes from the engines. Every
+// interval instructions the GPRs, PC, SPRs, instruction count and RAM are
+// compared.
+//
+// On a mismatch the pair is booted again and run back to the last check
+// that matched, then on in finer steps, until the first instruction after
+// which they differ is found; it is reported along with both states. The
+// finer steps change when pending interrupts are taken (at the start of
+// every System::Run()), so a difference that depends on interrupt timing
+// may only be found to within the step it was seen in.
+class Lockstep {
+ public:
+  Lockstep(const vector<uint8>& image, uint32 start_address,
+           CPU::Engine candidate);
+  virtual ~Lockstep();
+
+  // Instructions between checks.
+  void SetInterval(uint64 interval);
+
+  // Runs for count instructions or until the guest halts. Returns false,
+  // having printed a report to stderr, if the engines diverged.
+  bool Run(uint64 count);
+
+  bool IsHalted() const;
+
+  // Reference instruction count.
+  uint64 InstructionCount() const;
+
+  // After Run() has returned false, the instruction count after which the
+  // states first differed.
+  uint64 DivergentInstruction() const;
+
+ protected:
+  // Sets up a freshly made System before it is run.
+  virtual void Boot(System* system, bool is_candidate);
+
+ private:
+  const static size_t kSideCount = 2;  // Reference, candidate.
+
+  // How many steps an interval is split into when looking for the first
+  // divergent instruction.
+  const static uint64 kLocateSteps = 1024;
+
+  const vector<uint8> image_;
+  const uint32 start_address_;
+  const CPU::Engine candidate_;
+  uint64 interval_;
+
+  System* systems_[kSideCount];
+  WallClock* clocks_[kSideCount];
+  bool is_halted_[kSideCount];
+
+  // Every instruction count each side has been run to, in order, so the
+  // same path can be followed again.
+  vector<uint64> targets_;
+
+  uint64 divergent_instruction_;
+
+  void Start();
+  void Stop();
+  void Advance(uint64 target);
+  bool Compare(string* difference) const;
+  void Locate(uint64 from, string difference);
+  void Report(const string& difference, uint64 from, uint64 to) const;
+
+  DISALLOW_COPY_AND_ASSIGN(Lockstep);
+};
+
+#endif  // SIMCTTY_LOCKSTEP_H_
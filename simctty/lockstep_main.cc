@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "simctty/lockstep.h"
+
+using std::vector;
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [-i interval] [-n instructions] [image]\n"
+          "  -i  instructions between state comparisons (default 1000000)\n"
+          "  -n  instructions to run, unless the guest halts first\n"
+          "      (default 100000000)\n"
+          "Runs the image on the fast engine and the reference engine in\n"
+          "lockstep and reports the first instruction where they differ.\n",
+          argv0);
+}
+
+bool read_file(const char* filename, vector<uint8>* data) {
+  FILE* file = fopen(filename, "rb");
+  if (!file) {
+    fprintf(stderr, "Can't open %s\n", filename);
+    return false;
+  }
+
+  const size_t kBufferSize = 65536;
+  uint8 buffer[kBufferSize];
+  size_t len;
+  while ((len = fread(buffer, sizeof(uint8), kBufferSize, file)) != 0) {
+    data->insert(data->end(), buffer, buffer + len);
+  }
+
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* default_filename = "vmlinux.bin";
+  const char* filename;
+  uint64 interval = 1000000;
+  uint64 count = 100000000;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+    switch (opt) {
+    case 'i':
+      interval = strtoull(optarg, nullptr, 0);
+      break;
+    case 'n':
+      count = strtoull(optarg, nullptr, 0);
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind < argc) {
+    filename = argv[optind];
+  } else {
+    filename = default_filename;
+  }
+
+  vector<uint8> image;
+  if (!read_file(filename, &image)) {
+    return EXIT_FAILURE;
+  }
+
+  Lockstep lockstep(image, 0x100, CPU::kEngineFast);
+  lockstep.SetInterval(interval);
+  if (!lockstep.Run(count)) {
+    return EXIT_FAILURE;
+  }
+
+  fprintf(stderr, "%llu instructions matched%s\n",
+          static_cast<unsigned long long>(lockstep.InstructionCount()),
+          lockstep.IsHalted() ? ", guest halted" : "");
+  return EXIT_SUCCESS;
+}
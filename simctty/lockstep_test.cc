@@ -0,0 +1,60 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "simctty/assembler.h"
+#include "simctty/lockstep.h"
+#include "simctty/uart.h"
+
+using std::vector;
+
+namespace {
+
+// Counts to 1000, then polls the UART's line status (instruction 4002).
+vector<uint8> Program() {
+  Assembler a;
+  a.l_movhi(kR1, 0x9000);
+  a.l_addi(kR3, kR3, 1);
+  a.l_sfnei(kR3, 1000);
+  a.l_bf(-2);
+  a.l_nop();
+  a.l_lbz(kR2, kR1, 5);
+  a.l_sw(kR0, kR2, 0x1000);
+  a.l_j(0);
+  a.l_nop();
+  return vector<uint8>(a.Instructions(), a.Instructions() + a.Size());
+}
+
+// Gives the candidate a key in its UART, standing in for an engine bug.
+class SkewedLockstep : public Lockstep {
+ public:
+  SkewedLockstep() : Lockstep(Program(), 0, CPU::kEngineFast) {}
+
+ protected:
+  virtual void Boot(System* system, bool is_candidate) {
+    Lockstep::Boot(system, is_candidate);
+    if (is_candidate) {
+      const uint8 key = 'x';
+      system->GetUART()->WriteBuffer(&key, 1);
+    }
+  }
+};
+
+}  // namespace
+
+TEST(LockstepTest, EnginesMatch) {
+  Lockstep lockstep(Program(), 0, CPU::kEngineFast);
+  lockstep.SetInterval(100);
+  ASSERT_TRUE(lockstep.Run(10000));
+  ASSERT_EQ(10000U, lockstep.InstructionCount());
+}
+
+TEST(LockstepTest, FindsFirstDivergentInstruction) {
+  SkewedLockstep lockstep;
+  lockstep.SetInterval(3000);
+  ASSERT_FALSE(lockstep.Run(10000));
+  ASSERT_EQ(4002U, lockstep.DivergentInstruction());
+}
@@ -1,73 +1,248 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "simctty/console.h"
+#include "simctty/event_loop.h"
+#include "simctty/net_backend.h"
+#include "simctty/replay.h"
 #include "simctty/system.h"
 
-bool keychar(uint8* key) {
-  struct timeval tv;
-  fd_set fds;
-  tv.tv_sec = 0;
-  tv.tv_usec = 0;
-  FD_ZERO(&fds);
-  FD_SET(STDIN_FILENO, &fds);
-  select(STDIN_FILENO+1, &fds, NULL, NULL, &tv);
-  if (FD_ISSET(0, &fds)) {
-    const bool ok = read(STDIN_FILENO, key, 1) == 1;
-    return ok;
+// Opens the console output named on the command line: "stdout", "stderr",
+// "fd:N" for an inherited descriptor (e.g. a socket), or a path such as a pty
+// slave. Returns -1 on failure.
+int open_output(const char* name) {
+  if (strcmp(name, "stdout") == 0) {
+    return STDOUT_FILENO;
+  } else if (strcmp(name, "stderr") == 0) {
+    return STDERR_FILENO;
+  } else if (strncmp(name, "fd:", 3) == 0) {
+    char* end;
+    const long fd = strtol(name + 3, &end, 10);
+    if (end == name + 3 || *end != '\0' || fd < 0 || fd > INT_MAX) {
+      return -1;
+    }
+    return fd;
   }
 
-  return false;
+  return open(name, O_WRONLY | O_NOCTTY | O_CREAT | O_APPEND, 0644);
+}
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [-r] [-u] [-v] [-o stdout|stderr|fd:N|path] "
+          "[-c pty|unix:path] [-d disk] [-n pcap:path|unix:path] "
+          "[-R log | -P log] [image]\n"
+          "  -r  pace the guest to its nominal 20MHz instead of flat out\n"
+          "  -o  where console output goes (default stderr), not with -c\n"
+          "  -c  attach the console to a new pty or a listening Unix socket\n"
+          "      instead of the terminal\n"
+          "  -u  model a 16750 UART with 64 byte FIFOs instead of a 16550A\n"
+          "  -v  attach to the virtio console (hvc0) instead of the UART\n"
+          "  -d  disk image for the virtio block device (vda), not written\n"
+          "      with -R or -P\n"
+          "  -n  connect the virtio network device (eth0) to a capture file\n"
+          "      or a listening Unix stream socket\n"
+          "  -R  record console input and clock reads to a log\n"
+          "  -P  play a log back, ignoring input, then carry on live\n",
+          argv0);
 }
 
 int main(int argc, char** argv) {
   const char* default_filename = "vmlinux.bin";
   const char* filename;
+  const char* output_name = nullptr;
+  const char* console_spec = nullptr;
+  const char* disk_filename = nullptr;
+  const char* net_spec = nullptr;
+  const char* record_filename = nullptr;
+  const char* play_filename = nullptr;
+  bool is_paced = false;
+  bool is_virtio_console = false;
+  size_t uart_fifo_size = UART::kFifoSize16550;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:c:d:n:R:P:ruv")) != -1) {
+    switch (opt) {
+    case 'o':
+      output_name = optarg;
+      break;
+    case 'c':
+      console_spec = optarg;
+      break;
+    case 'd':
+      disk_filename = optarg;
+      break;
+    case 'n':
+      net_spec = optarg;
+      break;
+    case 'R':
+      record_filename = optarg;
+      break;
+    case 'P':
+      play_filename = optarg;
+      break;
+    case 'r':
+      is_paced = true;
+      break;
+    case 'u':
+      uart_fifo_size = UART::kFifoSize16750;
+      break;
+    case 'v':
+      is_virtio_console = true;
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
 
-  if (argc >= 2) {
-    filename = argv[1];
+  // Network traffic isn't logged, so can't be replayed.
+  const bool is_replay = record_filename || play_filename;
+  // The console carries its own output.
+  if ((record_filename && play_filename) || (is_replay && net_spec) ||
+      (console_spec && output_name)) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (optind < argc) {
+    filename = argv[optind];
   } else {
     filename = default_filename;
   }
 
-  System system;
+  System system(uart_fifo_size);
 
   if (!system.LoadImageFile(filename, 0x100)) {
     fprintf(stderr, "Unable to load image\n");
     return EXIT_FAILURE;
   }
 
+  // Each run has to start from the same disk, so replay never writes it.
+  if (disk_filename &&
+      !system.GetVirtioBlock()->Open(disk_filename, is_replay)) {
+    fprintf(stderr, "Unable to open disk image\n");
+    return EXIT_FAILURE;
+  }
+
+  if (net_spec) {
+    NetBackend* backend = NetBackend::Create(net_spec);
+    if (!backend) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    } else if (!backend->Open()) {
+      delete backend;
+      return EXIT_FAILURE;
+    }
+    system.GetVirtioNet()->SetBackend(backend);
+  }
+
+  SerialPort* port;
+  if (is_virtio_console) {
+    port = system.GetVirtioConsole();
+  } else {
+    port = system.GetUART();
+  }
+
+  Replay replay(system.GetCPU(), port);
+  if (is_replay) {
+    if (record_filename ? !replay.Record(record_filename)
+                        : !replay.Play(play_filename)) {
+      return EXIT_FAILURE;
+    }
+    system.GetRTC()->SetClock(&replay);
+    port = &replay;
+  }
+
+  // A client going away mid-write shouldn't kill us.
+  signal(SIGPIPE, SIG_IGN);
+
+  Console* console = nullptr;
+  int output_fd = -1;
+  if (console_spec) {
+    console = Console::Create(console_spec, port);
+    if (!console) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    } else if (!console->Open()) {
+      delete console;
+      return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "Console on %s\n", console->Path().c_str());
+  } else {
+    if (!output_name) {
+      output_name = "stderr";
+    }
+    output_fd = open_output(output_name);
+    if (output_fd < 0) {
+      fprintf(stderr, "Can't open output %s\n", output_name);
+      return EXIT_FAILURE;
+    }
+  }
+
   struct termios termios_p;
   tcgetattr(fileno(stdin), &termios_p);
   struct termios termios_p_saved = termios_p;
 
-  termios_p.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP
-                 | INLCR | IGNCR | ICRNL | IXON);
-  termios_p.c_oflag &= ~OPOST;
-  termios_p.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
-  termios_p.c_cflag &= ~(CSIZE | PARENB);
-  termios_p.c_cflag |= CS8;
-  tcsetattr(fileno(stdin), 0, &termios_p);
+  if (!console) {
+    termios_p.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP
+                   | INLCR | IGNCR | ICRNL | IXON);
+    termios_p.c_oflag &= ~OPOST;
+    termios_p.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    termios_p.c_cflag &= ~(CSIZE | PARENB);
+    termios_p.c_cflag |= CS8;
+    tcsetattr(fileno(stdin), 0, &termios_p);
+  }
 
   uint64 cycle_count = 0;
   const uint64 cycles_per_iteration = 20000000 / 1000;
-  while (system.Run(cycles_per_iteration)) {
 
-    cycle_count += cycles_per_iteration;
+  EventLoop* loop;
+  if (console) {
+    loop = new EventLoop(port, console);
+  } else {
+    loop = new EventLoop(port, STDIN_FILENO, output_fd);
+  }
 
-    uint8 key;
-    while (keychar(&key)) {
-      system.GetUART()->Keypress(key);
+  if (!loop->Init() || (is_paced && !loop->SetPacing(1000000))) {
+    delete loop;
+    delete console;
+    if (!console_spec) {
+      tcsetattr(fileno(stdin), 0, &termios_p_saved);
     }
+    return EXIT_FAILURE;
+  }
 
-    while (system.GetUART()->CanRead()) {
-      fprintf(stderr, "%c", system.GetUART()->Read());
+  while (system.Run(cycles_per_iteration)) {
+    cycle_count += cycles_per_iteration;
+    if (is_replay) {
+      // Disk completions are taken at the start of the next slice.
+      system.GetVirtioBlock()->Drain();
+      replay.AfterSlice();
     }
+    loop->AfterSlice();
+  }
+
+  // Anything written by the final instructions.
+  if (is_replay) {
+    replay.AfterSlice();
   }
+  loop->Flush();
 
-  tcsetattr(fileno(stdin), 0, &termios_p_saved);
+  delete loop;
+  delete console;
+
+  if (!console_spec) {
+    tcsetattr(fileno(stdin), 0, &termios_p_saved);
+  }
 
   return EXIT_SUCCESS;
 }
@@ -3,19 +3,42 @@
 
 #include "simctty/mmu.h"
 
+namespace {
+
+const uint32 kDataURE = 0x40;
+const uint32 kDataUWE = 0x80;
+const uint32 kDataSRE = 0x100;
+const uint32 kDataSWE = 0x200;
+const uint32 kInstructionUXE = 0x80;
+const uint32 kInstructionSXE = 0x40;
+
+}  // namespace
+
 MMU::MMU(Bus* bus, enum Type type)
   :
     bus_(bus),
     ram_(bus_->GetRAM()),
     raw_(ram_->Raw()),
+    authed_page_(1),
+    authed_phy_(0),
+    stats_fast_hit_(0),
+    stats_fast_miss_(0),
     verbose_(false),
     verbose_store_(false),
     type_(type),
     is_enabled_(false),
-    authed_page_(1),
-    authed_phy_(0),
-    stats_fast_hit_(0),
-    stats_fast_miss_(0) {
+    miss_exception_(type == kData ? kExceptionDTLBMiss : kExceptionITLBMiss),
+    fault_exception_(type == kData ? kExceptionDataPageFault
+                                   : kExceptionInstructionPageFault) {
+  if (type_ == kInstruction) {
+    permissions_[0][0] = kInstructionSXE | kInstructionUXE;
+    permissions_[1][0] = kInstructionSXE | kInstructionUXE;
+  } else {
+    permissions_[0][0] = kDataURE;
+    permissions_[1][0] = kDataSRE | kDataURE;
+  }
+  permissions_[0][1] = kDataUWE;
+  permissions_[1][1] = kDataSWE | kDataUWE;
   Reset();
 }
 
@@ -23,8 +46,10 @@ MMU::~MMU() {
 }
 
 void MMU::Reset() {
+  control_register_ = 0;
   for (size_t i = 0; i < kSetCount; i++) {
     match_reg_[i] = 0;
+    translate_reg_[i] = 0;
   }
   ClearFastAuthCache();
 }
@@ -46,9 +71,15 @@ void MMU::SetVerboseStore(bool verbose) {
   verbose_store_ = verbose;
 }
 
+uint8 MMU::Load8(uint32 address, Exception* exception, bool is_sm) const {
+  return is_enabled_ ? Load8<true>(address, exception, is_sm)
+                     : Load8<false>(address, exception, is_sm);
+}
+
+template <bool kIsEnabled>
 uint8 MMU::Load8(uint32 address, Exception* exception, bool is_sm) const {
   bool is_ram;
-  const uint32 phy_address = MapAddress(address, exception, is_sm, false, &is_ram);
+  const uint32 phy_address = MapAddress<kIsEnabled, false>(address, exception, is_sm, &is_ram);
 
   if (*exception != kExceptionNone) {
     return 0;
@@ -69,9 +100,18 @@ uint8 MMU::Load8(uint32 address, Exception* exception, bool is_sm) const {
   return device->Load8(phy_address, exception);
 }
 
+void MMU::Store8(uint32 address, uint8 value, Exception* exception, bool is_sm) {
+  if (is_enabled_) {
+    Store8<true>(address, value, exception, is_sm);
+  } else {
+    Store8<false>(address, value, exception, is_sm);
+  }
+}
+
+template <bool kIsEnabled>
 void MMU::Store8(uint32 address, uint8 value, Exception* exception, bool is_sm) {
   bool is_ram;
-  const uint32 phy_address = MapAddress(address, exception, is_sm, true, &is_ram);
+  const uint32 phy_address = MapAddress<kIsEnabled, true>(address, exception, is_sm, &is_ram);
 
   if (*exception != kExceptionNone) {
     return;
@@ -91,6 +131,12 @@ void MMU::Store8(uint32 address, uint8 value, Exception* exception, bool is_sm)
   device->Store8(phy_address, value, exception);
 }
 
+uint16 MMU::Load16(uint32 address, Exception* exception, bool is_sm) const {
+  return is_enabled_ ? Load16<true>(address, exception, is_sm)
+                     : Load16<false>(address, exception, is_sm);
+}
+
+template <bool kIsEnabled>
 uint16 MMU::Load16(uint32 address, Exception* exception, bool is_sm) const {
   if ((address & 0x1) != 0) {
     *exception = kExceptionAlignment;
@@ -98,7 +144,7 @@ uint16 MMU::Load16(uint32 address, Exception* exception, bool is_sm) const {
   }
 
   bool is_ram;
-  const uint32 phy_address = MapAddress(address, exception, is_sm, false, &is_ram);
+  const uint32 phy_address = MapAddress<kIsEnabled, false>(address, exception, is_sm, &is_ram);
 
   if (*exception != kExceptionNone) {
     return 0;
@@ -118,6 +164,15 @@ uint16 MMU::Load16(uint32 address, Exception* exception, bool is_sm) const {
   return device->Load16(phy_address, exception);
 }
 
+void MMU::Store16(uint32 address, uint16 value, Exception* exception, bool is_sm) {
+  if (is_enabled_) {
+    Store16<true>(address, value, exception, is_sm);
+  } else {
+    Store16<false>(address, value, exception, is_sm);
+  }
+}
+
+template <bool kIsEnabled>
 void MMU::Store16(uint32 address, uint16 value, Exception* exception, bool is_sm) {
   if ((address & 0x1) != 0) {
     *exception = kExceptionAlignment;
@@ -125,7 +180,7 @@ void MMU::Store16(uint32 address, uint16 value, Exception* exception, bool is_sm
   }
 
   bool is_ram;
-  const uint32 phy_address = MapAddress(address, exception, is_sm, true, &is_ram);
+  const uint32 phy_address = MapAddress<kIsEnabled, true>(address, exception, is_sm, &is_ram);
 
   if (*exception != kExceptionNone) {
     return;
@@ -146,7 +201,13 @@ void MMU::Store16(uint32 address, uint16 value, Exception* exception, bool is_sm
 }
 
 uint32 MMU::Load32(uint32 address, Exception* exception, bool is_sm) const {
-  if ((address & 0xffffe000) == authed_page_) {
+  return is_enabled_ ? Load32<true>(address, exception, is_sm)
+                     : Load32<false>(address, exception, is_sm);
+}
+
+template <bool kIsEnabled>
+uint32 MMU::Load32(uint32 address, Exception* exception, bool is_sm) const {
+  if (kIsEnabled && (address & 0xffffe000) == authed_page_) {
     const uint32* u32address = reinterpret_cast<const uint32*>(raw_ + authed_phy_ + (address&0x1fff));
     *exception = kExceptionNone;
 
@@ -157,7 +218,7 @@ uint32 MMU::Load32(uint32 address, Exception* exception, bool is_sm) const {
   }
 
   bool is_ram;
-  const uint32 phy_address = MapAddress(address, exception, is_sm, false, &is_ram);
+  const uint32 phy_address = MapAddress<kIsEnabled, false>(address, exception, is_sm, &is_ram);
 
   if (*exception != kExceptionNone) {
     return 0;
@@ -179,6 +240,15 @@ uint32 MMU::Load32(uint32 address, Exception* exception, bool is_sm) const {
   return device->Load32(phy_address, exception);
 }
 
+void MMU::Store32(uint32 address, uint32 value, Exception* exception, bool is_sm) {
+  if (is_enabled_) {
+    Store32<true>(address, value, exception, is_sm);
+  } else {
+    Store32<false>(address, value, exception, is_sm);
+  }
+}
+
+template <bool kIsEnabled>
 void MMU::Store32(uint32 address, uint32 value, Exception* exception, bool is_sm) {
   if ((address & 0x3) != 0) {
     *exception = kExceptionAlignment;
@@ -186,7 +256,7 @@ void MMU::Store32(uint32 address, uint32 value, Exception* exception, bool is_sm
   }
 
   bool is_ram;
-  const uint32 phy_address = MapAddress(address, exception, is_sm, true, &is_ram);
+  const uint32 phy_address = MapAddress<kIsEnabled, true>(address, exception, is_sm, &is_ram);
 
   if (*exception != kExceptionNone) {
     return;
@@ -236,8 +306,9 @@ uint32 MMU::Reg(reg_t index) const {
   }
 }
 
-uint32 MMU::MapAddress(uint32 address, Exception* exception, bool is_sm, bool is_write, bool* is_ram) const {
-  if (!is_enabled_) {
+template <bool kIsEnabled, bool kIsWrite>
+uint32 MMU::MapAddress(uint32 address, Exception* exception, bool is_sm, bool* is_ram) const {
+  if (!kIsEnabled) {
     *exception = kExceptionNone;
     *is_ram = address <= kMaxRamAddress;
     return address;
@@ -253,34 +324,7 @@ uint32 MMU::MapAddress(uint32 address, Exception* exception, bool is_sm, bool is
   if (mr & 0x1 && mr >> 0xd == page) {
     const uint32 tr = translate_reg_[set];
 
-    const static uint32 kDataURE = 0x40;
-    const static uint32 kDataUWE = 0x80;
-    const static uint32 kDataSRE = 0x100;
-    const static uint32 kDataSWE = 0x200;
-    const static uint32 kInstructionUXE = 0x80;
-    const static uint32 kInstructionSXE = 0x40;
-
-    bool ok = false;
-
-    if (type_ == kInstruction) {
-      ok = tr & (kInstructionSXE | kInstructionUXE);
-    } else {
-      if (is_sm) {
-        if (is_write) {
-          ok = tr & (kDataSWE | kDataUWE);
-        } else {
-          ok = tr & (kDataSRE | kDataURE);
-        }
-      } else {
-        if (is_write) {
-          ok = tr & kDataUWE;
-        } else {
-          ok = tr & kDataURE;
-        }
-      }
-    }
-
-    if (ok) {
+    if (tr & permissions_[is_sm][kIsWrite]) {
       phy_address = (tr & 0xffffe000) | (address & 0x1fff);
       *exception = kExceptionNone;
 
@@ -292,17 +336,33 @@ uint32 MMU::MapAddress(uint32 address, Exception* exception, bool is_sm, bool is
       }
       *is_ram = phy_address <= kMaxRamAddress;
     } else {
-      *exception = type_ == kData ? kExceptionDataPageFault : kExceptionInstructionPageFault;
+      *exception = fault_exception_;
       *is_ram = false;
     }
   } else {
-    *exception = type_ == kData ? kExceptionDTLBMiss : kExceptionITLBMiss;
+    *exception = miss_exception_;
     *is_ram = false;
   }
 
   return phy_address;
 }
 
+bool MMU::Translate(uint32 address, uint32* phy_address) const {
+  if (!is_enabled_) {
+    *phy_address = address;
+    return true;
+  }
+
+  const uint32 set = (address >> 0xd) % kUsedSetCount;
+  const uint32 mr = match_reg_[set];
+  if (!(mr & 0x1) || mr >> 0xd != address >> 0xd) {
+    return false;
+  }
+
+  *phy_address = (translate_reg_[set] & 0xffffe000) | (address & 0x1fff);
+  return true;
+}
+
 void MMU::Print() const {
   for (size_t i = 0; i < kSetCount; i++) {
     const uint32 mr = match_reg_[i];
@@ -319,6 +379,14 @@ void MMU::ClearFastAuthCache() {
   authed_page_ = 1;
 }
 
+const uint32* MMU::FastAuthPage() const {
+  return &authed_page_;
+}
+
+const uint32* MMU::FastAuthPhy() const {
+  return &authed_phy_;
+}
+
 void MMU::SetFastAuthCache(uint32 page, uint32 phy) {
   authed_page_ = page;
   authed_phy_ = phy;
@@ -332,3 +400,18 @@ uint64 MMU::StatsFastMissCount() const {
   return stats_fast_miss_;
 }
 
+// The specialisations CPU uses.
+template uint32 MMU::MapAddress<false, false>(uint32, Exception*, bool, bool*) const;
+template uint32 MMU::MapAddress<true, false>(uint32, Exception*, bool, bool*) const;
+template uint8 MMU::Load8<false>(uint32, Exception*, bool) const;
+template uint8 MMU::Load8<true>(uint32, Exception*, bool) const;
+template uint16 MMU::Load16<false>(uint32, Exception*, bool) const;
+template uint16 MMU::Load16<true>(uint32, Exception*, bool) const;
+template uint32 MMU::Load32<false>(uint32, Exception*, bool) const;
+template uint32 MMU::Load32<true>(uint32, Exception*, bool) const;
+template void MMU::Store8<false>(uint32, uint8, Exception*, bool);
+template void MMU::Store8<true>(uint32, uint8, Exception*, bool);
+template void MMU::Store16<false>(uint32, uint16, Exception*, bool);
+template void MMU::Store16<true>(uint32, uint16, Exception*, bool);
+template void MMU::Store32<false>(uint32, uint32, Exception*, bool);
+template void MMU::Store32<true>(uint32, uint32, Exception*, bool);
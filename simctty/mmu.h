@@ -41,6 +41,22 @@ class MMU {
   void Store16(uint32 address, uint16 value, Exception* exception, bool is_sm);
   void Store32(uint32 address, uint32 value, Exception* exception, bool is_sm);
 
+  // As above, for callers that know whether the MMU is enabled (kIsEnabled
+  // must match IsEnabled()), such as CPU engines built for each state.
+  template <bool kIsEnabled>
+  uint8 Load8(uint32 address, Exception* exception, bool is_sm) const;
+  template <bool kIsEnabled>
+  uint16 Load16(uint32 address, Exception* exception, bool is_sm) const;
+  template <bool kIsEnabled>
+  uint32 Load32(uint32 address, Exception* exception, bool is_sm) const;
+
+  template <bool kIsEnabled>
+  void Store8(uint32 address, uint8 value, Exception* exception, bool is_sm);
+  template <bool kIsEnabled>
+  void Store16(uint32 address, uint16 value, Exception* exception, bool is_sm);
+  template <bool kIsEnabled>
+  void Store32(uint32 address, uint32 value, Exception* exception, bool is_sm);
+
   bool SetReg(reg_t index, uint32 value);
   uint32 Reg(reg_t index) const;
 
@@ -48,22 +64,45 @@ class MMU {
 
   void ClearFastAuthCache();
 
+  // The fast path page and the physical page it maps to, for compiled code
+  // to check directly (block_compiler.h).
+  const uint32* FastAuthPage() const;
+  const uint32* FastAuthPhy() const;
+
   uint64 StatsFastHitCount() const;
   uint64 StatsFastMissCount() const;
 
-  uint32 MapAddress(uint32 address, Exception* exception, bool is_sm, bool is_write, bool* is_ram) const;
+  // The physical address an access to address goes to, from the TLB alone,
+  // with no permission check or exception. Returns false on a TLB miss.
+  bool Translate(uint32 address, uint32* phy_address) const;
+
+  template <bool kIsEnabled, bool kIsWrite>
+  uint32 MapAddress(uint32 address, Exception* exception, bool is_sm, bool* is_ram) const;
 
  private:
+  // The fast path state comes first, ahead of the TLB registers.
   Bus* bus_;
   RAM* ram_;
   uint8* raw_;
 
+  mutable uint32 authed_page_;
+  mutable uint32 authed_phy_;
+
+  mutable uint64 stats_fast_hit_;
+  mutable uint64 stats_fast_miss_;
+
   bool verbose_;
   bool verbose_store_;
 
   const Type type_;
   bool is_enabled_;
 
+  // What a translate register must allow, by [is_sm][is_write], and the
+  // exceptions raised, all fixed by type_.
+  uint32 permissions_[2][2];
+  const Exception miss_exception_;
+  const Exception fault_exception_;
+
   uint32 control_register_;
 
   const static reg_t kMatchRegOffset = 512;
@@ -76,13 +115,8 @@ class MMU {
 
   bool VerboseLoadStore(const char* type, uint32 ea, uint32 phy, uint32 val) const;
 
-  mutable uint32 authed_page_;
-  mutable uint32 authed_phy_;
   void SetFastAuthCache(uint32 page, uint32 phy);
 
-  mutable uint64 stats_fast_hit_;
-  mutable uint64 stats_fast_miss_;
-
   DISALLOW_COPY_AND_ASSIGN(MMU);
 };  // MMU
 
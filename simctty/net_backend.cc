@@ -0,0 +1,342 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/net_backend.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using std::lock_guard;
+using std::mutex;
+using std::vector;
+
+namespace {
+
+const size_t kEthernetHeaderSize = 14;
+
+uint64 MacAddress(const uint8* bytes) {
+  uint64 address = 0;
+  for (size_t i = 0; i < 6; i++) {
+    address = (address << 8) | bytes[i];
+  }
+  return address;
+}
+
+}  // namespace
+
+NetBackend* NetBackend::Create(const char* spec) {
+  if (strncmp(spec, "pcap:", 5) == 0) {
+    return new PcapBackend(spec + 5);
+  } else if (strncmp(spec, "unix:", 5) == 0) {
+    return new StreamBackend(spec + 5);
+  }
+
+  return nullptr;
+}
+
+NetSwitch::NetSwitch() {
+}
+
+NetSwitch::~NetSwitch() {
+}
+
+SwitchPort* NetSwitch::CreatePort() {
+  SwitchPort* port = new SwitchPort(this);
+
+  lock_guard<mutex> lock(mutex_);
+  ports_.push_back(port);
+  return port;
+}
+
+void NetSwitch::Forward(SwitchPort* source, const uint8* frame,
+                        size_t length) {
+  if (length < kEthernetHeaderSize) {
+    return;
+  }
+
+  lock_guard<mutex> lock(mutex_);
+  addresses_[MacAddress(frame + 6)] = source;
+
+  // Unicast to a known address goes to its port only, everything else is
+  // flooded.
+  if (!(frame[0] & 0x1)) {
+    const auto destination = addresses_.find(MacAddress(frame));
+    if (destination != addresses_.end()) {
+      if (destination->second != source) {
+        destination->second->Deliver(frame, length);
+      }
+      return;
+    }
+  }
+
+  for (size_t i = 0; i < ports_.size(); i++) {
+    if (ports_[i] != source) {
+      ports_[i]->Deliver(frame, length);
+    }
+  }
+}
+
+void NetSwitch::RemovePort(SwitchPort* port) {
+  lock_guard<mutex> lock(mutex_);
+  for (size_t i = 0; i < ports_.size(); i++) {
+    if (ports_[i] == port) {
+      ports_.erase(ports_.begin() + i);
+      break;
+    }
+  }
+
+  for (auto it = addresses_.begin(); it != addresses_.end();) {
+    if (it->second == port) {
+      it = addresses_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+SwitchPort::SwitchPort(NetSwitch* net_switch)
+  :
+    NetBackend(),
+    net_switch_(net_switch),
+    queued_(0) {
+}
+
+SwitchPort::~SwitchPort() {
+  net_switch_->RemovePort(this);
+}
+
+void SwitchPort::Send(const uint8* frame, size_t length) {
+  net_switch_->Forward(this, frame, length);
+}
+
+size_t SwitchPort::Receive(uint8* frame, size_t size) {
+  if (queued_ == 0) {
+    return 0;
+  }
+
+  lock_guard<mutex> lock(mutex_);
+  size_t length = 0;
+  while (length == 0 && !queue_.empty()) {
+    // Frames too big for the caller are dropped.
+    const vector<uint8>& next = queue_.front();
+    if (next.size() <= size) {
+      length = next.size();
+      memcpy(frame, next.data(), length);
+    }
+    queue_.pop_front();
+  }
+  queued_ = queue_.size();
+
+  return length;
+}
+
+void SwitchPort::Deliver(const uint8* frame, size_t length) {
+  lock_guard<mutex> lock(mutex_);
+  if (queue_.size() < kMaxQueuedFrames) {
+    queue_.push_back(vector<uint8>(frame, frame + length));
+    queued_ = queue_.size();
+  }
+}
+
+PcapBackend::PcapBackend(const char* path)
+  :
+    NetBackend(),
+    path_(path),
+    file_(nullptr) {
+}
+
+PcapBackend::~PcapBackend() {
+  if (file_) {
+    fclose(file_);
+  }
+}
+
+bool PcapBackend::Open() {
+  file_ = fopen(path_.c_str(), "wb");
+  if (!file_) {
+    perror(path_.c_str());
+    return false;
+  }
+
+  // Host byte order, readers go by the magic number.
+  struct {
+    uint32 magic;
+    uint16 version_major;
+    uint16 version_minor;
+    int32 gmt_offset;
+    uint32 accuracy;
+    uint32 snapshot_length;
+    uint32 link_type;
+  } header = { 0xa1b2c3d4, 2, 4, 0, 0, 65535, 1 };  // Ethernet.
+
+  return fwrite(&header, sizeof(header), 1, file_) == 1;
+}
+
+void PcapBackend::Send(const uint8* frame, size_t length) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+
+  const uint32 record[] = {
+    static_cast<uint32>(now.tv_sec),
+    static_cast<uint32>(now.tv_usec),
+    static_cast<uint32>(length),
+    static_cast<uint32>(length),
+  };
+  fwrite(record, sizeof(record), 1, file_);
+  fwrite(frame, length, 1, file_);
+}
+
+size_t PcapBackend::Receive(uint8* frame, size_t size) {
+  return 0;
+}
+
+StreamBackend::StreamBackend(const char* path)
+  :
+    NetBackend(),
+    path_(path),
+    fd_(-1),
+    buffer_length_(0) {
+}
+
+StreamBackend::~StreamBackend() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool StreamBackend::Open() {
+  struct sockaddr_un address;
+  if (path_.size() >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path_.c_str());
+    return false;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path_.c_str(), sizeof(address.sun_path) - 1);
+
+  fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd_ < 0) {
+    perror("socket");
+    return false;
+  }
+
+  if (connect(fd_, reinterpret_cast<struct sockaddr*>(&address),
+              sizeof(address)) != 0) {
+    perror(path_.c_str());
+    return false;
+  }
+
+  // Connected, from here on never block the guest.
+  fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+void StreamBackend::Send(const uint8* frame, size_t length) {
+  if (fd_ < 0 || !FlushUnsent()) {
+    return;
+  }
+
+  const uint8 header[4] = {
+    static_cast<uint8>(length >> 24),
+    static_cast<uint8>(length >> 16),
+    static_cast<uint8>(length >> 8),
+    static_cast<uint8>(length),
+  };
+
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<uint8*>(header);
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = const_cast<uint8*>(frame);
+  iov[1].iov_len = length;
+
+  ssize_t written = writev(fd_, iov, 2);
+  if (written < 0) {
+    if (errno != EAGAIN && errno != EINTR) {
+      Hangup();
+    }
+    // Peer is behind, drop the frame.
+    return;
+  }
+
+  // Keep the tail so the next frame starts on a boundary.
+  if (static_cast<size_t>(written) < sizeof(header)) {
+    unsent_.insert(unsent_.end(), header + written, header + sizeof(header));
+    written = 0;
+  } else {
+    written -= sizeof(header);
+  }
+  unsent_.insert(unsent_.end(), frame + written, frame + length);
+}
+
+size_t StreamBackend::Receive(uint8* frame, size_t size) {
+  if (fd_ < 0) {
+    return 0;
+  }
+
+  FlushUnsent();
+
+  if (fd_ >= 0 && buffer_length_ < kBufferSize) {
+    const ssize_t length = read(fd_, buffer_ + buffer_length_,
+                                kBufferSize - buffer_length_);
+    if (length > 0) {
+      buffer_length_ += length;
+    } else if (length == 0 || (errno != EAGAIN && errno != EINTR)) {
+      Hangup();
+      return 0;
+    }
+  }
+
+  // Frames too big for the caller are dropped.
+  size_t received = 0;
+  while (received == 0 && buffer_length_ >= 4) {
+    const size_t length = static_cast<size_t>(buffer_[0]) << 24 |
+        buffer_[1] << 16 | buffer_[2] << 8 | buffer_[3];
+    if (length > kBufferSize - 4) {
+      fprintf(stderr, "%s: bad frame length %zu\n", path_.c_str(), length);
+      Hangup();
+      return 0;
+    } else if (buffer_length_ < 4 + length) {
+      return 0;
+    }
+
+    if (length <= size) {
+      received = length;
+      memcpy(frame, buffer_ + 4, received);
+    }
+
+    buffer_length_ -= 4 + length;
+    memmove(buffer_, buffer_ + 4 + length, buffer_length_);
+  }
+  return received;
+}
+
+bool StreamBackend::FlushUnsent() {
+  if (unsent_.empty()) {
+    return true;
+  }
+
+  const ssize_t written = write(fd_, unsent_.data(), unsent_.size());
+  if (written < 0) {
+    if (errno != EAGAIN && errno != EINTR) {
+      Hangup();
+    }
+    return false;
+  }
+
+  unsent_.erase(unsent_.begin(), unsent_.begin() + written);
+  return unsent_.empty();
+}
+
+void StreamBackend::Hangup() {
+  close(fd_);
+  fd_ = -1;
+  buffer_length_ = 0;
+  unsent_.clear();
+}
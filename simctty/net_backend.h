@@ -0,0 +1,147 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_NET_BACKEND_H_
+#define SIMCTTY_NET_BACKEND_H_
+
+#include <stdio.h>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "simctty/types.h"
+
+using std::string;
+
+// Host end of a guest network interface: moves whole Ethernet frames.
+//
+// Both calls come from the thread running the guest and must not block.
+// Send() may drop a frame it can't take, as a congested link would.
+class NetBackend {
+ public:
+  NetBackend() {}
+  virtual ~NetBackend() {}
+
+  // Creates a backend from a command line spec: "pcap:PATH" or "unix:PATH".
+  // Returns null for an unknown spec.
+  static NetBackend* Create(const char* spec);
+
+  virtual bool Open() { return true; }
+
+  virtual void Send(const uint8* frame, size_t length) = 0;
+
+  // Copies the next frame for the guest to frame. Returns its length, 0 if
+  // there is none. Frames longer than size are dropped.
+  virtual size_t Receive(uint8* frame, size_t size) = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NetBackend);
+};
+
+class SwitchPort;
+
+// In-process learning Ethernet switch connecting VMs in the same host.
+//
+// Ports may be used from different threads. A frame is flooded to every other
+// port until its destination address has been seen as a source.
+class NetSwitch {
+ public:
+  NetSwitch();
+  ~NetSwitch();
+
+  // A new port, owned by the caller. Must not outlive the switch.
+  SwitchPort* CreatePort();
+
+ private:
+  friend class SwitchPort;
+
+  std::mutex mutex_;
+  std::vector<SwitchPort*> ports_;
+  std::map<uint64, SwitchPort*> addresses_;
+
+  void Forward(SwitchPort* source, const uint8* frame, size_t length);
+  void RemovePort(SwitchPort* port);
+
+  DISALLOW_COPY_AND_ASSIGN(NetSwitch);
+};
+
+class SwitchPort : public NetBackend {
+ public:
+  ~SwitchPort();
+
+  virtual void Send(const uint8* frame, size_t length);
+  virtual size_t Receive(uint8* frame, size_t size);
+
+ private:
+  friend class NetSwitch;
+
+  // Frames queued towards a guest that isn't taking them are dropped.
+  const static size_t kMaxQueuedFrames = 256;
+
+  explicit SwitchPort(NetSwitch* net_switch);
+
+  void Deliver(const uint8* frame, size_t length);
+
+  NetSwitch* net_switch_;
+
+  std::mutex mutex_;
+  std::deque<std::vector<uint8> > queue_;
+  std::atomic<size_t> queued_;  // Lets Receive() skip the lock when empty.
+
+  DISALLOW_COPY_AND_ASSIGN(SwitchPort);
+};
+
+// Writes every frame the guest sends to a pcap capture file. Receives
+// nothing.
+class PcapBackend : public NetBackend {
+ public:
+  explicit PcapBackend(const char* path);
+  ~PcapBackend();
+
+  virtual bool Open();
+  virtual void Send(const uint8* frame, size_t length);
+  virtual size_t Receive(uint8* frame, size_t size);
+
+ private:
+  const string path_;
+  FILE* file_;
+
+  DISALLOW_COPY_AND_ASSIGN(PcapBackend);
+};
+
+// Frames over a connected Unix stream socket, each preceded by its length
+// as a 32 bit big endian word (as QEMU's "-netdev stream").
+class StreamBackend : public NetBackend {
+ public:
+  explicit StreamBackend(const char* path);
+  ~StreamBackend();
+
+  virtual bool Open();
+  virtual void Send(const uint8* frame, size_t length);
+  virtual size_t Receive(uint8* frame, size_t size);
+
+ private:
+  const static size_t kBufferSize = 65536 + 4;
+
+  const string path_;
+  int fd_;
+
+  // Partially received frames.
+  uint8 buffer_[kBufferSize];
+  size_t buffer_length_;
+
+  // The rest of frames the socket took only part of, so framing survives a
+  // short write.
+  std::vector<uint8> unsent_;
+
+  bool FlushUnsent();
+  void Hangup();
+
+  DISALLOW_COPY_AND_ASSIGN(StreamBackend);
+};
+
+#endif  // SIMCTTY_NET_BACKEND_H_
@@ -0,0 +1,135 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include "simctty/net_backend.h"
+
+using std::unique_ptr;
+
+namespace {
+
+// Ethernet header only, from src to dst (last address byte).
+void MakeFrame(uint8 dst, uint8 src, uint8* frame) {
+  memset(frame, 0, 14);
+  frame[5] = dst;
+  frame[11] = src;
+  frame[12] = 0x08;
+}
+
+}  // namespace
+
+TEST(NetBackendTest, SwitchFloodsThenLearns) {
+  NetSwitch net_switch;
+  unique_ptr<SwitchPort> a(net_switch.CreatePort());
+  unique_ptr<SwitchPort> b(net_switch.CreatePort());
+  unique_ptr<SwitchPort> c(net_switch.CreatePort());
+
+  uint8 frame[14];
+  uint8 received[64];
+
+  // Destination unknown, flooded to every other port.
+  MakeFrame(2, 1, frame);
+  a->Send(frame, sizeof(frame));
+  ASSERT_EQ(0u, a->Receive(received, sizeof(received)));
+  ASSERT_EQ(14u, b->Receive(received, sizeof(received)));
+  ASSERT_EQ(14u, c->Receive(received, sizeof(received)));
+
+  // a has been learnt, the reply only goes there.
+  MakeFrame(1, 2, frame);
+  b->Send(frame, sizeof(frame));
+  ASSERT_EQ(14u, a->Receive(received, sizeof(received)));
+  ASSERT_EQ(0, memcmp(frame, received, sizeof(frame)));
+  ASSERT_EQ(0u, c->Receive(received, sizeof(received)));
+
+  // Broadcast always floods.
+  MakeFrame(0xff, 2, frame);
+  frame[0] = 0xff;
+  b->Send(frame, sizeof(frame));
+  ASSERT_EQ(14u, a->Receive(received, sizeof(received)));
+  ASSERT_EQ(14u, c->Receive(received, sizeof(received)));
+
+  // A frame too big for the caller is skipped, not reported as none.
+  uint8 big[32] = {0};
+  MakeFrame(1, 2, big);
+  b->Send(big, sizeof(big));
+  MakeFrame(1, 2, frame);
+  b->Send(frame, sizeof(frame));
+  ASSERT_EQ(14u, a->Receive(received, 16));
+}
+
+TEST(NetBackendTest, PcapRecords) {
+  char path[] = "/tmp/simctty-pcap-XXXXXX";
+  close(mkstemp(path));
+
+  {
+    PcapBackend pcap(path);
+    ASSERT_TRUE(pcap.Open());
+
+    uint8 frame[60] = {0};
+    pcap.Send(frame, sizeof(frame));
+  }
+
+  // Global header, record header, frame.
+  struct stat st;
+  ASSERT_EQ(0, stat(path, &st));
+  ASSERT_EQ(24 + 16 + 60, st.st_size);
+  unlink(path);
+}
+
+TEST(NetBackendTest, StreamFraming) {
+  char path[] = "/tmp/simctty-net-XXXXXX";
+  close(mkstemp(path));
+  unlink(path);
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+  const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(0, bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address),
+                    sizeof(address)));
+  ASSERT_EQ(0, listen(listen_fd, 1));
+
+  StreamBackend stream(path);
+  ASSERT_TRUE(stream.Open());
+  const int peer = accept(listen_fd, NULL, NULL);
+  ASSERT_GE(peer, 0);
+
+  // Guest to peer, length prefixed.
+  const uint8 frame[] = { 1, 2, 3, 4, 5 };
+  stream.Send(frame, sizeof(frame));
+  uint8 wire[9];
+  ASSERT_EQ(9, read(peer, wire, sizeof(wire)));
+  const uint8 expected[] = { 0, 0, 0, 5, 1, 2, 3, 4, 5 };
+  ASSERT_EQ(0, memcmp(expected, wire, sizeof(wire)));
+
+  // Peer to guest, split across writes.
+  uint8 received[64];
+  ASSERT_EQ(6, write(peer, expected, 6));
+  ASSERT_EQ(0u, stream.Receive(received, sizeof(received)));
+  ASSERT_EQ(3, write(peer, expected + 6, 3));
+  ASSERT_EQ(5u, stream.Receive(received, sizeof(received)));
+  ASSERT_EQ(0, memcmp(frame, received, sizeof(frame)));
+
+  // A frame too big for the caller is skipped, not reported as none.
+  ASSERT_EQ(9, write(peer, expected, 9));
+  const uint8 small[] = { 0, 0, 0, 2, 6, 7 };
+  ASSERT_EQ(6, write(peer, small, 6));
+  ASSERT_EQ(2u, stream.Receive(received, 4));
+  ASSERT_EQ(6, received[0]);
+
+  close(peer);
+  close(listen_fd);
+  unlink(path);
+}
@@ -0,0 +1,77 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/pic.h"
+
+using std::memory_order_relaxed;
+
+PIC::PIC()
+  :
+    lines_(0),
+    latched_(0),
+    edge_triggered_(0),
+    mask_(0),
+    seen_(0xffffffff) {
+}
+
+PIC::~PIC() {
+}
+
+void PIC::Reset() {
+  latched_.store(0, memory_order_relaxed);
+  mask_.store(0, memory_order_relaxed);
+  seen_ = 0xffffffff;
+}
+
+void PIC::SetLine(uint32 line, bool is_asserted) {
+  const uint32 bit = 1u << line;
+  if (!is_asserted) {
+    lines_.fetch_and(~bit, memory_order_relaxed);
+    return;
+  }
+
+  const uint32 previous = lines_.fetch_or(bit, memory_order_relaxed);
+  if (!(previous & bit) &&
+      edge_triggered_.load(memory_order_relaxed) & bit) {
+    latched_.fetch_or(bit, memory_order_relaxed);
+  }
+}
+
+void PIC::SetEdgeTriggered(uint32 line, bool is_edge_triggered) {
+  const uint32 bit = 1u << line;
+  if (is_edge_triggered) {
+    edge_triggered_.fetch_or(bit, memory_order_relaxed);
+  } else {
+    edge_triggered_.fetch_and(~bit, memory_order_relaxed);
+    latched_.fetch_and(~bit, memory_order_relaxed);
+  }
+}
+
+uint32 PIC::Mask() const {
+  return mask_.load(memory_order_relaxed);
+}
+
+void PIC::SetMask(uint32 value) {
+  mask_.store(value, memory_order_relaxed);
+}
+
+uint32 PIC::Status() const {
+  seen_ = CurrentStatus();
+  return seen_;
+}
+
+void PIC::SetStatus(uint32 value) {
+  // Write 0 to clear, 1 leaves a latched edge as it is. Level triggered
+  // lines can't be cleared this way, only by the device lowering them.
+  latched_.fetch_and(~(seen_ & ~value), memory_order_relaxed);
+}
+
+bool PIC::IsPending() const {
+  return (CurrentStatus() & Mask()) != 0;
+}
+
+uint32 PIC::CurrentStatus() const {
+  const uint32 edge_triggered = edge_triggered_.load(memory_order_relaxed);
+  return (lines_.load(memory_order_relaxed) & ~edge_triggered) |
+      latched_.load(memory_order_relaxed);
+}
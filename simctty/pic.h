@@ -0,0 +1,61 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_PIC_H_
+#define SIMCTTY_PIC_H_
+
+#include <atomic>
+
+#include "simctty/types.h"
+
+// Programmable interrupt controller, SPR group 9 (PICMR/PICSR).
+//
+// Devices drive 32 interrupt lines. A level triggered line shows in PICSR for
+// as long as it is asserted. An edge triggered line latches on assertion and
+// stays in PICSR until the guest clears it by writing a 0 to its bit, as the
+// OR1200 does and Linux expects (mtspr(PICSR, mfspr(PICSR) & ~bit)). Only
+// bits the guest last read as set are cleared, so an edge that latches
+// between that read and write isn't lost to the 0 the guest never saw.
+//
+// Lines may be driven from any thread. The CPU polls IsPending(), which is a
+// couple of loads.
+class PIC {
+ public:
+  const static uint32 kLineCount = 32;
+
+  PIC();
+  ~PIC();
+
+  // Clears the mask and latched edges. Lines keep their level, that's up to
+  // the devices.
+  void Reset();
+
+  // Device side.
+  void SetLine(uint32 line, bool is_asserted);
+  void SetEdgeTriggered(uint32 line, bool is_edge_triggered);
+
+  // CPU side.
+  uint32 Mask() const;
+  void SetMask(uint32 value);
+  uint32 Status() const;
+  void SetStatus(uint32 value);
+
+  // An unmasked interrupt is waiting.
+  bool IsPending() const;
+
+ private:
+  std::atomic<uint32> lines_;    // Current level of every line.
+  std::atomic<uint32> latched_;  // Edges seen and not yet cleared.
+  std::atomic<uint32> edge_triggered_;
+  std::atomic<uint32> mask_;
+
+  // What the last Status() returned, all ones before the first. CPU thread
+  // only.
+  mutable uint32 seen_;
+
+  uint32 CurrentStatus() const;
+
+  DISALLOW_COPY_AND_ASSIGN(PIC);
+};
+
+#endif  // SIMCTTY_PIC_H_
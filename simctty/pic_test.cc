@@ -0,0 +1,83 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include "simctty/pic.h"
+
+TEST(PICTest, LevelTriggered) {
+  PIC pic;
+  pic.SetLine(3, true);
+  ASSERT_EQ(0x8u, pic.Status());
+  ASSERT_FALSE(pic.IsPending());
+
+  pic.SetMask(0x8);
+  ASSERT_TRUE(pic.IsPending());
+
+  // Can't be cleared while the device holds it.
+  pic.SetStatus(0);
+  ASSERT_TRUE(pic.IsPending());
+
+  pic.SetLine(3, false);
+  ASSERT_EQ(0u, pic.Status());
+  ASSERT_FALSE(pic.IsPending());
+}
+
+TEST(PICTest, EdgeTriggered) {
+  PIC pic;
+  pic.SetEdgeTriggered(5, true);
+  pic.SetMask(0xffffffff);
+
+  // Latched on assertion, stays after the line drops.
+  pic.SetLine(5, true);
+  pic.SetLine(5, false);
+  ASSERT_EQ(0x20u, pic.Status());
+  ASSERT_TRUE(pic.IsPending());
+
+  // Writing 1 leaves it, writing 0 clears it.
+  pic.SetStatus(0x20);
+  ASSERT_EQ(0x20u, pic.Status());
+  pic.SetStatus(pic.Status() & ~0x20u);
+  ASSERT_EQ(0u, pic.Status());
+
+  // Acking one edge leaves the others latched.
+  pic.SetEdgeTriggered(6, true);
+  pic.SetLine(5, true);
+  pic.SetLine(5, false);
+  pic.SetLine(6, true);
+  pic.SetLine(6, false);
+  pic.SetStatus(pic.Status() & ~0x20u);
+  ASSERT_EQ(0x40u, pic.Status());
+  pic.SetStatus(0);
+
+  // Held high is one edge, not many.
+  pic.SetLine(5, true);
+  pic.SetStatus(pic.Status() & ~0x20u);
+  pic.SetLine(5, true);
+  ASSERT_EQ(0u, pic.Status());
+}
+
+TEST(PICTest, EdgeBetweenReadAndWrite) {
+  PIC pic;
+  pic.SetEdgeTriggered(5, true);
+  pic.SetEdgeTriggered(6, true);
+  pic.SetLine(5, true);
+
+  // Line 6 latches after the guest reads PICSR, its write of 0 for the bit
+  // it didn't see leaves it.
+  const uint32 status = pic.Status();
+  ASSERT_EQ(0x20u, status);
+  pic.SetLine(6, true);
+  pic.SetStatus(status & ~0x20u);
+  ASSERT_EQ(0x40u, pic.Status());
+}
+
+TEST(PICTest, ResetKeepsLines) {
+  PIC pic;
+  pic.SetMask(0x1);
+  pic.SetLine(0, true);
+  pic.Reset();
+
+  ASSERT_EQ(0u, pic.Mask());
+  ASSERT_EQ(0x1u, pic.Status());
+}
@@ -12,6 +12,12 @@ RAM::RAM()
     BusDevice(),
     size_(kMaxRamAddress + 1),
     ram_(new uint8[size_]) {
+#ifdef SIMCTTY_WASM_BLOCKS
+  for (size_t i = 0; i < kCodePageCount; i++) {
+    is_code_page_[i] = 0;
+    code_generation_[i] = 0;
+  }
+#endif
 }
 
 RAM::~RAM() {
@@ -57,9 +63,20 @@ bool RAM::LoadImage(const uint8* data, size_t len, size_t offset) {
     ram_[offset + i + 3] = last_data[B32ENDIANSWAPB3];
   }
 
+  InvalidateCode(offset, len);
   return true;
 }
 
+// Stores check the page map inline, as pages holding code are rarely
+// written to. Without compiled blocks there is nothing to check.
+inline void RAM::Written(uint32 address) {
+#ifdef SIMCTTY_WASM_BLOCKS
+  if (is_code_page_[address >> kCodePageShift]) {
+    InvalidateCode(address, 1);
+  }
+#endif
+}
+
 uint8 RAM::Load8(uint32 address, Exception* exception) const {
   *exception = kExceptionNone;
   return ram_[address ^ 0x3];
@@ -69,6 +86,7 @@ uint8 RAM::Load8(uint32 address, Exception* exception) const {
 void RAM::Store8(uint32 address, uint8 value, Exception* exception) {
   *exception = kExceptionNone;
   ram_[address ^ 0x3] = value;
+  Written(address);
 }
 
 uint16 RAM::Load16(uint32 address, Exception* exception) const {
@@ -81,6 +99,7 @@ void RAM::Store16(uint32 address, uint16 value, Exception* exception) {
   *exception = kExceptionNone;
   uint16* u16address = reinterpret_cast<uint16*>(ram_ + (address^0x2));
   *u16address = value;
+  Written(address);
 }
 
 uint32 RAM::Load32(uint32 address, Exception* exception) const {
@@ -95,6 +114,7 @@ void RAM::Store32(uint32 address, uint32 value, Exception* exception) {
 
   *exception = kExceptionNone;
   *u32address = value;
+  Written(address);
 }
 
 void RAM::DumpU8(const char* filename) const {
@@ -111,5 +131,28 @@ void RAM::DumpU8(const char* filename) const {
   fclose(file);
 }
 
+void RAM::InvalidateCode(uint32 address, size_t length) {
+#ifdef SIMCTTY_WASM_BLOCKS
+  if (length == 0) {
+    return;
+  }
+
+  const size_t last = (address + length - 1) >> kCodePageShift;
+  for (size_t page = address >> kCodePageShift; page <= last; page++) {
+    if (is_code_page_[page]) {
+      is_code_page_[page] = 0;
+      ++code_generation_[page];
+    }
+  }
+#endif
+}
 
+#ifdef SIMCTTY_WASM_BLOCKS
+void RAM::SetIsCodePage(uint32 address) {
+  is_code_page_[address >> kCodePageShift] = 1;
+}
 
+uint32 RAM::CodeGeneration(uint32 address) const {
+  return code_generation_[address >> kCodePageShift];
+}
+#endif
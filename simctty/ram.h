@@ -31,10 +31,31 @@ class RAM : public BusDevice {
 
   void DumpU8(const char* filename="dump8") const;
 
+  // Writes that bypass the stores above (DMA, image loads) call this. It
+  // does nothing unless compiled blocks are built in.
+  void InvalidateCode(uint32 address, size_t length);
+
+#ifdef SIMCTTY_WASM_BLOCKS
+  // Pages code has been translated from (block_cache.h), by physical
+  // address. Writing to one moves its generation on, so translations made
+  // before the write can be told apart and dropped, page by page.
+  void SetIsCodePage(uint32 address);
+  uint32 CodeGeneration(uint32 address) const;
+#endif
+
  private:
   const size_t size_;
   uint8* ram_;
 
+#ifdef SIMCTTY_WASM_BLOCKS
+  const static uint32 kCodePageShift = 13;
+  const static size_t kCodePageCount = (kMaxRamAddress + 1) >> kCodePageShift;
+  uint8 is_code_page_[kCodePageCount];
+  uint32 code_generation_[kCodePageCount];
+#endif
+
+  void Written(uint32 address);
+
   DISALLOW_COPY_AND_ASSIGN(RAM);
 };
 
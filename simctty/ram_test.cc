@@ -21,3 +21,30 @@ TEST(RAMTest, 20MLoad32) {
 
   ASSERT_EQ(0U, sum);
 }
+
+#ifdef SIMCTTY_WASM_BLOCKS
+TEST(RAMTest, CodePageWritten) {
+  RAM ram;
+  Exception exception;
+
+  ram.SetIsCodePage(0x4000);
+  const uint32 generation = ram.CodeGeneration(0x4000);
+
+  // Other pages, and reads, leave it be.
+  ram.Store32(0x2000, 0, &exception);
+  ram.Load32(0x4000, &exception);
+  ASSERT_EQ(generation, ram.CodeGeneration(0x4000));
+
+  ram.Store8(0x5fff, 0, &exception);
+  ASSERT_NE(generation, ram.CodeGeneration(0x4000));
+
+  // No longer a code page until marked again.
+  const uint32 written = ram.CodeGeneration(0x4000);
+  ram.Store16(0x4000, 0, &exception);
+  ASSERT_EQ(written, ram.CodeGeneration(0x4000));
+
+  ram.SetIsCodePage(0x4000);
+  ram.InvalidateCode(0x3ffc, 8);
+  ASSERT_NE(written, ram.CodeGeneration(0x4000));
+}
+#endif
@@ -0,0 +1,272 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/replay.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+using std::min;
+
+namespace {
+
+// File header, followed by the version.
+const char kMagic[] = "SIMCTTYR";
+const size_t kMagicLength = 8;
+const uint32 kVersion = 1;
+
+// Event header: type (1 byte), count (8 bytes), length (4 bytes), all little
+// endian, followed by the data.
+const size_t kEventHeaderLength = 13;
+
+// Input taken and dropped while playing.
+const size_t kIgnoredInputFree = 4096;
+
+void PutLE(uint8* data, uint64 value, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    data[i] = static_cast<uint8>(value >> (8 * i));
+  }
+}
+
+uint64 GetLE(const uint8* data, size_t length) {
+  uint64 value = 0;
+  for (size_t i = 0; i < length; i++) {
+    value |= static_cast<uint64>(data[i]) << (8 * i);
+  }
+  return value;
+}
+
+}  // namespace
+
+Replay::Replay(const CPU* cpu, SerialPort* port)
+  :
+    SerialPort(),
+    WallClock(),
+    cpu_(cpu),
+    port_(port),
+    file_(nullptr),
+    mode_(kLive),
+    is_diverged_(false),
+    next_(),
+    output_(),
+    output_offset_(0) {
+}
+
+Replay::~Replay() {
+  GoLive();
+}
+
+bool Replay::Record(const char* path) {
+  GoLive();
+
+  file_ = fopen(path, "wb");
+  if (!file_) {
+    perror(path);
+    return false;
+  }
+
+  uint8 header[kMagicLength + 4];
+  memcpy(header, kMagic, kMagicLength);
+  PutLE(header + kMagicLength, kVersion, 4);
+  if (fwrite(header, sizeof(header), 1, file_) != 1) {
+    perror(path);
+    GoLive();
+    return false;
+  }
+
+  mode_ = kRecording;
+  return true;
+}
+
+bool Replay::Play(const char* path) {
+  GoLive();
+
+  file_ = fopen(path, "rb");
+  if (!file_) {
+    perror(path);
+    return false;
+  }
+
+  uint8 header[kMagicLength + 4];
+  if (fread(header, sizeof(header), 1, file_) != 1
+      || memcmp(header, kMagic, kMagicLength) != 0
+      || GetLE(header + kMagicLength, 4) != kVersion) {
+    fprintf(stderr, "%s: not a replay log\n", path);
+    GoLive();
+    return false;
+  }
+
+  mode_ = kPlaying;
+  is_diverged_ = false;
+  if (!ReadEvent()) {
+    GoLive();
+  }
+  return true;
+}
+
+void Replay::AfterSlice() {
+  const uint64 now = cpu_->InstructionRunCount();
+
+  // Clock reads belong to the next slice's Poll() or to the guest.
+  while (mode_ == kPlaying && next_.type != kEventClock) {
+    if (next_.count > now) {
+      return;
+    } else if (next_.count < now) {
+      Diverge("console traffic missed");
+      return;
+    }
+
+    if (next_.type == kEventInput) {
+      if (port_->WriteBuffer(next_.data.data(), next_.data.size())
+          != next_.data.size()) {
+        Diverge("input not accepted");
+        return;
+      }
+    } else {
+      const size_t length = next_.data.size();
+      const size_t offset = output_.size();
+      output_.resize(offset + length);
+      const size_t read = port_->ReadBuffer(&output_[offset], length);
+      output_.resize(offset + read);
+      if (read != length
+          || memcmp(&output_[offset], next_.data.data(), length) != 0) {
+        // The host still sees what the guest did write.
+        Diverge("output differs");
+        return;
+      }
+    }
+
+    if (!ReadEvent()) {
+      GoLive();
+    }
+  }
+
+  if (mode_ == kPlaying && next_.count < now) {
+    Diverge("clock read missed");
+  }
+}
+
+bool Replay::HasDiverged() const {
+  return is_diverged_;
+}
+
+size_t Replay::WriteBuffer(const uint8* data, size_t length) {
+  if (mode_ == kPlaying) {
+    return length;
+  }
+
+  const size_t written = port_->WriteBuffer(data, length);
+  if (mode_ == kRecording && written > 0) {
+    Log(kEventInput, data, written);
+  }
+  return written;
+}
+
+size_t Replay::WriteBufferFree() const {
+  if (mode_ == kPlaying) {
+    return kIgnoredInputFree;
+  }
+  return port_->WriteBufferFree();
+}
+
+size_t Replay::ReadBuffer(uint8* data, size_t length) {
+  size_t read = 0;
+  if (output_offset_ < output_.size()) {
+    read = min(length, output_.size() - output_offset_);
+    memcpy(data, &output_[output_offset_], read);
+    output_offset_ += read;
+    if (output_offset_ == output_.size()) {
+      output_.clear();
+      output_offset_ = 0;
+    }
+  }
+
+  if (mode_ == kPlaying || read == length) {
+    return read;
+  }
+
+  const size_t port_read = port_->ReadBuffer(data + read, length - read);
+  if (mode_ == kRecording && port_read > 0) {
+    Log(kEventOutput, data + read, port_read);
+  }
+  return read + port_read;
+}
+
+bool Replay::CanRead() const {
+  if (output_offset_ < output_.size()) {
+    return true;
+  }
+  return mode_ != kPlaying && port_->CanRead();
+}
+
+uint64 Replay::NowNs() {
+  if (mode_ == kPlaying) {
+    if (next_.type != kEventClock
+        || next_.count != cpu_->InstructionRunCount()) {
+      Diverge("unexpected clock read");
+    } else {
+      const uint64 now = GetLE(next_.data.data(), 8);
+      if (!ReadEvent()) {
+        GoLive();
+      }
+      return now;
+    }
+  }
+
+  const uint64 now = WallClock::NowNs();
+  if (mode_ == kRecording) {
+    uint8 data[8];
+    PutLE(data, now, 8);
+    Log(kEventClock, data, 8);
+  }
+  return now;
+}
+
+void Replay::Log(uint8 type, const uint8* data, size_t length) {
+  uint8 header[kEventHeaderLength];
+  header[0] = type;
+  PutLE(header + 1, cpu_->InstructionRunCount(), 8);
+  PutLE(header + 9, length, 4);
+  if (fwrite(header, sizeof(header), 1, file_) != 1
+      || fwrite(data, length, 1, file_) != 1) {
+    perror("replay log");
+    GoLive();
+  }
+}
+
+bool Replay::ReadEvent() {
+  uint8 header[kEventHeaderLength];
+  if (fread(header, sizeof(header), 1, file_) != 1) {
+    return false;
+  }
+
+  next_.type = header[0];
+  next_.count = GetLE(header + 1, 8);
+  const size_t length = GetLE(header + 9, 4);
+  if (next_.type < kEventInput || next_.type > kEventClock
+      || (next_.type == kEventClock && length != 8)
+      || length > kMaxEventLength) {
+    fprintf(stderr, "Replay log corrupt\n");
+    return false;
+  }
+
+  next_.data.resize(length);
+  return length == 0 || fread(next_.data.data(), length, 1, file_) == 1;
+}
+
+void Replay::Diverge(const char* reason) {
+  fprintf(stderr, "Replay diverged at instruction %llu: %s\n",
+          static_cast<unsigned long long>(cpu_->InstructionRunCount()),
+          reason);
+  is_diverged_ = true;
+  GoLive();
+}
+
+void Replay::GoLive() {
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+  mode_ = kLive;
+}
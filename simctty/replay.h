@@ -0,0 +1,100 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_REPLAY_H_
+#define SIMCTTY_REPLAY_H_
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "simctty/cpu.h"
+#include "simctty/rtc.h"
+#include "simctty/serial_port.h"
+#include "simctty/types.h"
+
+using std::vector;
+
+// Deterministic record and replay of a guest session.
+//
+// Sits between a console device and its host side, and is the RTC's clock.
+// When recording, every byte the host gives the guest, every byte the host
+// takes from it and every wall clock read is logged against the CPU's
+// instruction count. When playing, host input is ignored and the log is fed
+// back at the same instruction counts, so the guest runs exactly as it did.
+//
+// Console traffic only happens between slices, so the host must call
+// AfterSlice() after each slice before pumping the console. The guest must
+// not depend on anything else nondeterministic: disk completions must be
+// drained every slice, the disk image must be the same on every run (so
+// opened with VirtioBlock::Open(path, true), which keeps writes off it) and
+// there is no network.
+//
+// If the guest does something the log doesn't expect (a different count or
+// different output) the replay has diverged: the rest of the log is dropped
+// and the session carries on live, as it also does at the end of the log.
+//
+// Not thread safe, use from the thread running the CPU.
+class Replay : public SerialPort, public WallClock {
+ public:
+  Replay(const CPU* cpu, SerialPort* port);
+  virtual ~Replay();
+
+  bool Record(const char* path);
+  bool Play(const char* path);
+
+  // Applies any logged console traffic due at the current count.
+  void AfterSlice();
+
+  bool HasDiverged() const;
+
+  virtual size_t WriteBuffer(const uint8* data, size_t length);
+  virtual size_t WriteBufferFree() const;
+  virtual size_t ReadBuffer(uint8* data, size_t length);
+  virtual bool CanRead() const;
+
+  virtual uint64 NowNs();
+
+ private:
+  enum Mode {
+    kLive,
+    kRecording,
+    kPlaying
+  };
+
+  enum EventType {
+    kEventInput = 1,   // Bytes given to the guest.
+    kEventOutput = 2,  // Bytes taken from the guest.
+    kEventClock = 3    // Wall clock read, 8 bytes.
+  };
+
+  struct Event {
+    uint8 type;
+    uint64 count;
+    vector<uint8> data;
+  };
+
+  const static size_t kMaxEventLength = 1 << 20;
+
+  const CPU* cpu_;
+  SerialPort* port_;
+  FILE* file_;
+  Mode mode_;
+  bool is_diverged_;
+
+  // Next event to play, valid while mode_ is kPlaying.
+  Event next_;
+
+  // Guest output taken by a played event, not yet read by the host.
+  vector<uint8> output_;
+  size_t output_offset_;
+
+  void Log(uint8 type, const uint8* data, size_t length);
+  bool ReadEvent();
+  void Diverge(const char* reason);
+  void GoLive();
+
+  DISALLOW_COPY_AND_ASSIGN(Replay);
+};
+
+#endif  // SIMCTTY_REPLAY_H_
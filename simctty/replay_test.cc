@@ -0,0 +1,132 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "simctty/assembler.h"
+#include "simctty/replay.h"
+#include "simctty/system.h"
+
+using std::string;
+using std::unique_ptr;
+
+// A guest echoing the UART, counting how long it waited for each key and
+// stamping it with the RTC.
+class ReplayTest : public ::testing::Test {
+ public:
+  ReplayTest() {
+    char path[] = "/tmp/simctty_replay_XXXXXX";
+    const int fd = mkstemp(path);
+    close(fd);
+    path_ = path;
+  }
+
+  ~ReplayTest() {
+    unlink(path_.c_str());
+  }
+
+  // Starts a fresh system running the echo loop, plus the key's offset if
+  // it isn't echoed verbatim.
+  void Boot(uint8 echo_offset = 0) {
+    system_.reset(new System());
+    replay_.reset(new Replay(system_->GetCPU(), system_->GetUART()));
+    system_->GetRTC()->SetClock(replay_.get());
+
+    Assembler a;
+    a.l_movhi(kR1, 0x9000);        // UART.
+    a.l_movhi(kR7, 0x9200);
+    a.l_ori(kR7, kR7, 0x3000);     // RTC.
+    a.l_lbz(kR2, kR1, 5);          // LSR.
+    a.l_andi(kR2, kR2, 1);
+    a.l_sfeqi(kR2, 0);
+    a.l_bf(-3);
+    a.l_addi(kR4, kR4, 1);         // Delay slot, polls so far.
+    a.l_lbz(kR3, kR1, 0);
+    a.l_addi(kR3, kR3, echo_offset);
+    a.l_sb(kR1, kR3, 0);
+    a.l_lwz(kR6, kR7, 0);          // TIME_LOW.
+    a.l_add(kR5, kR5, kR6);
+    a.l_j(-10);
+    a.l_nop();
+    system_->LoadImage(a.Instructions(), a.Size(), 0);
+  }
+
+  // Runs 100 slices, typing keys at slice 10, 20 and 30, and returns the
+  // output.
+  string Run(const char* keys) {
+    string output;
+    for (size_t slice = 0; slice < 100; slice++) {
+      system_->Run(1000);
+      replay_->AfterSlice();
+
+      if (slice == 10 || slice == 20 || slice == 30) {
+        const uint8 key = keys[slice / 10 - 1];
+        replay_->WriteBuffer(&key, 1);
+      }
+
+      uint8 buffer[16];
+      size_t length;
+      while ((length = replay_->ReadBuffer(buffer, sizeof(buffer))) > 0) {
+        output.append(reinterpret_cast<char*>(buffer), length);
+      }
+    }
+    return output;
+  }
+
+ protected:
+  string path_;
+  unique_ptr<System> system_;
+  unique_ptr<Replay> replay_;
+};
+
+TEST_F(ReplayTest, ReplaysIdenticalState) {
+  Boot();
+  ASSERT_TRUE(replay_->Record(path_.c_str()));
+  ASSERT_EQ("abc", Run("abc"));
+
+  CPU* cpu = system_->GetCPU();
+  const uint32 polls = cpu->Reg(kR4);
+  const uint32 stamps = cpu->Reg(kR5);
+  const uint32 pc = cpu->PC();
+  replay_.reset();
+
+  // Keys typed during the replay are ignored.
+  Boot();
+  ASSERT_TRUE(replay_->Play(path_.c_str()));
+  ASSERT_EQ("abc", Run("xyz"));
+  ASSERT_FALSE(replay_->HasDiverged());
+
+  cpu = system_->GetCPU();
+  ASSERT_EQ(polls, cpu->Reg(kR4));
+  ASSERT_EQ(stamps, cpu->Reg(kR5));
+  ASSERT_EQ(pc, cpu->PC());
+}
+
+TEST_F(ReplayTest, GoesLiveOnDivergence) {
+  Boot();
+  ASSERT_TRUE(replay_->Record(path_.c_str()));
+  ASSERT_EQ("abc", Run("abc"));
+  replay_.reset();
+
+  // The guest now echoes something else, which is still passed on, and
+  // later keys are taken live.
+  Boot(1);
+  ASSERT_TRUE(replay_->Play(path_.c_str()));
+  ASSERT_EQ("bz{", Run("xyz"));
+  ASSERT_TRUE(replay_->HasDiverged());
+}
+
+TEST_F(ReplayTest, RejectsOtherFiles) {
+  FILE* file = fopen(path_.c_str(), "wb");
+  fputs("not a log", file);
+  fclose(file);
+
+  Boot();
+  ASSERT_FALSE(replay_->Play(path_.c_str()));
+}
@@ -0,0 +1,117 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/ring_buffer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::memory_order_release;
+using std::min;
+
+namespace {
+
+uint32 RoundUpToPowerOfTwo(size_t value) {
+  uint32 result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+}  // namespace
+
+RingBuffer::RingBuffer(size_t capacity)
+  :
+    mask_(RoundUpToPowerOfTwo(capacity) - 1),
+    data_(new uint8[mask_ + 1]) {
+  head_.value.store(0, memory_order_relaxed);
+  tail_.value.store(0, memory_order_relaxed);
+}
+
+RingBuffer::~RingBuffer() {
+  delete[] data_;
+}
+
+size_t RingBuffer::Capacity() const {
+  return mask_ + 1;
+}
+
+size_t RingBuffer::Size() const {
+  const uint32 tail = tail_.value.load(memory_order_acquire);
+  const uint32 head = head_.value.load(memory_order_acquire);
+  return head - tail;
+}
+
+size_t RingBuffer::Free() const {
+  return Capacity() - Size();
+}
+
+bool RingBuffer::IsEmpty() const {
+  return Size() == 0;
+}
+
+bool RingBuffer::IsFull() const {
+  return Size() == Capacity();
+}
+
+bool RingBuffer::Push(uint8 value) {
+  const uint32 head = head_.value.load(memory_order_relaxed);
+  const uint32 tail = tail_.value.load(memory_order_acquire);
+  if (head - tail > mask_) {
+    return false;
+  }
+
+  data_[head & mask_] = value;
+  head_.value.store(head + 1, memory_order_release);
+  return true;
+}
+
+size_t RingBuffer::Write(const uint8* data, size_t length) {
+  const uint32 head = head_.value.load(memory_order_relaxed);
+  const uint32 tail = tail_.value.load(memory_order_acquire);
+  const size_t count = min(length, Capacity() - (head - tail));
+
+  // Copy in at most two runs, either side of the wrap point.
+  const size_t offset = head & mask_;
+  const size_t first = min(count, Capacity() - offset);
+  memcpy(data_ + offset, data, first);
+  memcpy(data_, data + first, count - first);
+
+  head_.value.store(head + count, memory_order_release);
+  return count;
+}
+
+bool RingBuffer::Pop(uint8* value) {
+  const uint32 tail = tail_.value.load(memory_order_relaxed);
+  const uint32 head = head_.value.load(memory_order_acquire);
+  if (head == tail) {
+    return false;
+  }
+
+  *value = data_[tail & mask_];
+  tail_.value.store(tail + 1, memory_order_release);
+  return true;
+}
+
+size_t RingBuffer::Read(uint8* data, size_t length) {
+  const uint32 tail = tail_.value.load(memory_order_relaxed);
+  const uint32 head = head_.value.load(memory_order_acquire);
+  const size_t count = min(length, static_cast<size_t>(head - tail));
+
+  const size_t offset = tail & mask_;
+  const size_t first = min(count, Capacity() - offset);
+  memcpy(data, data_ + offset, first);
+  memcpy(data + first, data_, count - first);
+
+  tail_.value.store(tail + count, memory_order_release);
+  return count;
+}
+
+void RingBuffer::Clear() {
+  tail_.value.store(head_.value.load(memory_order_acquire),
+                    memory_order_release);
+}
@@ -0,0 +1,56 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_RING_BUFFER_H_
+#define SIMCTTY_RING_BUFFER_H_
+
+#include <atomic>
+
+#include "simctty/types.h"
+
+// Fixed capacity byte FIFO.
+//
+// Safe for exactly one producer thread (Push/Write) and one consumer thread
+// (Pop/Read/Clear) to use concurrently without locking. The capacity is
+// rounded up to a power of two.
+class RingBuffer {
+ public:
+  explicit RingBuffer(size_t capacity);
+  ~RingBuffer();
+
+  size_t Capacity() const;
+
+  // Number of bytes currently queued. Exact when called from the producer or
+  // consumer thread, a snapshot otherwise.
+  size_t Size() const;
+  size_t Free() const;
+  bool IsEmpty() const;
+  bool IsFull() const;
+
+  // Producer side. Returns false/the number of bytes accepted when full.
+  bool Push(uint8 value);
+  size_t Write(const uint8* data, size_t length);
+
+  // Consumer side. Returns false/the number of bytes read when empty.
+  bool Pop(uint8* value);
+  size_t Read(uint8* data, size_t length);
+  void Clear();
+
+ private:
+  const uint32 mask_;
+  uint8* data_;
+
+  // Free running index, only the low bits (& mask_) address data_. Padded so
+  // the producer and consumer indices don't share a cache line.
+  struct Index {
+    std::atomic<uint32> value;
+    uint8 padding[64 - sizeof(std::atomic<uint32>)];
+  };
+
+  Index head_;  // Next write, owned by the producer.
+  Index tail_;  // Next read, owned by the consumer.
+
+  DISALLOW_COPY_AND_ASSIGN(RingBuffer);
+};
+
+#endif  // SIMCTTY_RING_BUFFER_H_
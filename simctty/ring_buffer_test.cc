@@ -0,0 +1,60 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+
+#include "simctty/ring_buffer.h"
+
+TEST(RingBufferTest, CapacityRoundsUp) {
+  RingBuffer buffer(100);
+  ASSERT_EQ(128U, buffer.Capacity());
+  ASSERT_TRUE(buffer.IsEmpty());
+  ASSERT_EQ(128U, buffer.Free());
+}
+
+TEST(RingBufferTest, PushPop) {
+  RingBuffer buffer(4);
+
+  for (uint8 i = 0; i < 4; i++) {
+    ASSERT_TRUE(buffer.Push(i));
+  }
+  ASSERT_TRUE(buffer.IsFull());
+  ASSERT_FALSE(buffer.Push(4));
+
+  uint8 value;
+  for (uint8 i = 0; i < 4; i++) {
+    ASSERT_TRUE(buffer.Pop(&value));
+    ASSERT_EQ(i, value);
+  }
+  ASSERT_FALSE(buffer.Pop(&value));
+}
+
+TEST(RingBufferTest, BulkWrap) {
+  RingBuffer buffer(8);
+  uint8 in[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  uint8 out[8] = {0};
+
+  // Move the indices so the next write wraps.
+  ASSERT_EQ(5U, buffer.Write(in, 5));
+  ASSERT_EQ(5U, buffer.Read(out, 8));
+
+  ASSERT_EQ(8U, buffer.Write(in, 8));
+  ASSERT_EQ(0U, buffer.Write(in, 1));
+  ASSERT_EQ(8U, buffer.Size());
+
+  ASSERT_EQ(8U, buffer.Read(out, 8));
+  for (size_t i = 0; i < 8; i++) {
+    ASSERT_EQ(in[i], out[i]);
+  }
+  ASSERT_TRUE(buffer.IsEmpty());
+}
+
+TEST(RingBufferTest, Clear) {
+  RingBuffer buffer(8);
+  buffer.Push(1);
+  buffer.Push(2);
+  buffer.Clear();
+  ASSERT_TRUE(buffer.IsEmpty());
+}
@@ -0,0 +1,130 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/rtc.h"
+
+#include <time.h>
+
+#include "simctty/bitwise.h"
+
+namespace {
+
+// Registers, offsets into the window.
+const uint32 kTimeLow = 0x00;
+const uint32 kTimeHigh = 0x04;
+const uint32 kAlarmLow = 0x08;
+const uint32 kAlarmHigh = 0x0c;
+const uint32 kIrqEnabled = 0x10;
+const uint32 kClearAlarm = 0x14;
+const uint32 kAlarmStatus = 0x18;
+const uint32 kClearInterrupt = 0x1c;
+
+}  // namespace
+
+uint64 WallClock::NowNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return static_cast<uint64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+GoldfishRTC::GoldfishRTC()
+  :
+    BusDevice(),
+    host_clock_(),
+    clock_(&host_clock_),
+    time_high_(0),
+    alarm_high_(0),
+    alarm_(0),
+    is_alarm_armed_(false),
+    is_interrupt_enabled_(false),
+    is_interrupt_pending_(false) {
+}
+
+GoldfishRTC::~GoldfishRTC() {
+}
+
+uint32 GoldfishRTC::Load32(uint32 address, Exception* exception) const {
+  address -= kMinRtcAddress;
+  *exception = kExceptionNone;
+
+  uint32 value = 0;
+  switch (address) {
+  case kTimeLow: {
+    const uint64 now = clock_->NowNs();
+    time_high_ = now >> 32;
+    value = now;
+    break;
+  }
+  case kTimeHigh:
+    value = time_high_;
+    break;
+  case kAlarmLow:
+    value = alarm_;
+    break;
+  case kAlarmHigh:
+    value = alarm_ >> 32;
+    break;
+  case kIrqEnabled:
+    value = is_interrupt_enabled_;
+    break;
+  case kAlarmStatus:
+    value = is_alarm_armed_;
+    break;
+  default:
+    break;
+  }
+
+  // Little endian registers, the guest (readl) byte swaps them.
+  return B32ENDIANSWAP(value);
+}
+
+void GoldfishRTC::Store32(uint32 address, uint32 value, Exception* exception) {
+  address -= kMinRtcAddress;
+  *exception = kExceptionNone;
+  value = B32ENDIANSWAP(value);
+
+  switch (address) {
+  case kAlarmLow:
+    alarm_ = static_cast<uint64>(alarm_high_) << 32 | value;
+    is_alarm_armed_ = true;
+    // An alarm already in the past fires at once.
+    Poll();
+    break;
+  case kAlarmHigh:
+    alarm_high_ = value;
+    break;
+  case kIrqEnabled:
+    is_interrupt_enabled_ = value & 0x1;
+    UpdateInterrupt();
+    break;
+  case kClearAlarm:
+    is_alarm_armed_ = false;
+    break;
+  case kClearInterrupt:
+    is_interrupt_pending_ = false;
+    UpdateInterrupt();
+    break;
+  default:
+    break;
+  }
+}
+
+bool GoldfishRTC::IsInterruptAsserted() const {
+  return is_interrupt_enabled_ && is_interrupt_pending_;
+}
+
+void GoldfishRTC::Poll() {
+  if (is_alarm_armed_ && clock_->NowNs() >= alarm_) {
+    is_alarm_armed_ = false;
+    is_interrupt_pending_ = true;
+    UpdateInterrupt();
+  }
+}
+
+void GoldfishRTC::SetClock(WallClock* clock) {
+  clock_ = clock ? clock : &host_clock_;
+}
+
+void GoldfishRTC::UpdateInterrupt() {
+  SetInterrupt(IsInterruptAsserted());
+}
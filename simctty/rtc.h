@@ -0,0 +1,69 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_RTC_H_
+#define SIMCTTY_RTC_H_
+
+#include "simctty/bus_device.h"
+#include "simctty/exception.h"
+#include "simctty/types.h"
+
+const static uint32 kMinRtcAddress = 0x92003000;
+const static uint32 kMaxRtcAddress = 0x9200301f;
+
+// Interrupt line, PICSR bit.
+const static uint32 kRtcIrq = 6;
+
+// Where the RTC gets the time, so it can be replaced (replay.h, tests).
+class WallClock {
+ public:
+  WallClock() {}
+  virtual ~WallClock() {}
+
+  // Nanoseconds since the epoch, from the host's clock by default.
+  virtual uint64 NowNs();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(WallClock);
+};
+
+// Goldfish RTC ("google,goldfish-rtc", Linux rtc-goldfish) on the host's
+// wall clock.
+//
+// Time is nanoseconds since the epoch, read low word first (which latches
+// the high word). It is independent of how fast or how steadily the guest
+// has been run, so the guest can resync after being paused, throttled or
+// fast-forwarded through idle. One alarm, checked by Poll() between slices.
+class GoldfishRTC : public BusDevice {
+ public:
+  GoldfishRTC();
+  virtual ~GoldfishRTC();
+
+  virtual uint32 Load32(uint32 address, Exception* exception) const;
+  virtual void Store32(uint32 address, uint32 value, Exception* exception);
+
+  bool IsInterruptAsserted() const;
+
+  // Fire the alarm if it is due.
+  void Poll();
+
+  // Not owned, nullptr for the host clock.
+  void SetClock(WallClock* clock);
+
+ private:
+  WallClock host_clock_;
+  WallClock* clock_;
+
+  mutable uint32 time_high_;  // Latched by reading the low word.
+  uint32 alarm_high_;         // Held until the low word is written.
+  uint64 alarm_;
+  bool is_alarm_armed_;
+  bool is_interrupt_enabled_;
+  bool is_interrupt_pending_;
+
+  void UpdateInterrupt();
+
+  DISALLOW_COPY_AND_ASSIGN(GoldfishRTC);
+};
+
+#endif  // SIMCTTY_RTC_H_
@@ -0,0 +1,97 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include "simctty/bitwise.h"
+#include "simctty/exception.h"
+#include "simctty/pic.h"
+#include "simctty/rtc.h"
+
+namespace {
+
+class FakeClock : public WallClock {
+ public:
+  FakeClock() : now_(0) {}
+
+  uint64 now_;
+
+  virtual uint64 NowNs() {
+    return now_;
+  }
+};
+
+}  // namespace
+
+class RTCTest : public ::testing::Test {
+ public:
+  RTCTest() {
+    rtc_.SetClock(&clock_);
+    rtc_.ConnectInterrupt(&pic_, kRtcIrq);
+    pic_.SetMask(0xffffffff);
+  }
+
+  // As the guest's readl()/writel() see them, little endian.
+  uint32 Load(uint32 reg) {
+    Exception exception;
+    return B32ENDIANSWAP(rtc_.Load32(kMinRtcAddress + reg, &exception));
+  }
+
+  void Store(uint32 reg, uint32 value) {
+    Exception exception;
+    rtc_.Store32(kMinRtcAddress + reg, B32ENDIANSWAP(value), &exception);
+  }
+
+ protected:
+  PIC pic_;
+  FakeClock clock_;
+  GoldfishRTC rtc_;
+};
+
+TEST_F(RTCTest, TimeLatchesHighWord) {
+  clock_.now_ = 0x123456789abcdef0ull;
+  ASSERT_EQ(0x9abcdef0u, Load(0x00));
+
+  // A carry between the two reads doesn't tear the value.
+  clock_.now_ = 0x1234567a00000000ull;
+  ASSERT_EQ(0x12345678u, Load(0x04));
+}
+
+TEST_F(RTCTest, Alarm) {
+  clock_.now_ = 1000;
+  Store(0x10, 1);
+  Store(0x0c, 0);
+  Store(0x08, 2000);
+  ASSERT_EQ(1u, Load(0x18));
+
+  rtc_.Poll();
+  ASSERT_FALSE(pic_.IsPending());
+
+  clock_.now_ = 2000;
+  rtc_.Poll();
+  ASSERT_EQ(0u, Load(0x18));
+  ASSERT_TRUE(pic_.IsPending());
+
+  Store(0x1c, 1);
+  ASSERT_FALSE(pic_.IsPending());
+}
+
+TEST_F(RTCTest, PastAlarmFiresAtOnce) {
+  clock_.now_ = 5000;
+  Store(0x10, 1);
+  Store(0x0c, 0);
+  Store(0x08, 10);
+  ASSERT_TRUE(pic_.IsPending());
+}
+
+TEST_F(RTCTest, ClearAlarm) {
+  Store(0x10, 1);
+  Store(0x0c, 1);
+  Store(0x08, 0);
+  Store(0x14, 1);
+  ASSERT_EQ(0u, Load(0x18));
+
+  clock_.now_ = 0x100000000ull;
+  rtc_.Poll();
+  ASSERT_FALSE(pic_.IsPending());
+}
@@ -0,0 +1,129 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/scheduler.h"
+
+#include <chrono>
+
+using std::lock_guard;
+using std::unique_lock;
+
+Scheduler::Scheduler(size_t worker_count, size_t quantum_cycles)
+  :
+    quantum_cycles_(quantum_cycles),
+    running_count_(0),
+    quanta_run_(0),
+    steal_count_(0) {
+  for (size_t i = 0; i < worker_count; i++) {
+    workers_.push_back(unique_ptr<Worker>(new Worker()));
+  }
+}
+
+Scheduler::~Scheduler() {
+}
+
+void Scheduler::Add(System* system, Console* console) {
+  VM* vm = new VM();
+  vm->system.reset(system);
+  vm->console.reset(console);
+
+  // Deal the VMs out round robin to begin with.
+  workers_[vms_.size() % workers_.size()]->queue.push_back(vm);
+  vms_.push_back(unique_ptr<VM>(vm));
+  running_count_++;
+}
+
+void Scheduler::Run() {
+  vector<thread> threads;
+  for (size_t i = 0; i < workers_.size(); i++) {
+    threads.push_back(thread(&Scheduler::WorkerLoop, this, i));
+  }
+
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+}
+
+size_t Scheduler::WorkerCount() const {
+  return workers_.size();
+}
+
+uint64 Scheduler::QuantaRun() const {
+  return quanta_run_;
+}
+
+uint64 Scheduler::StealCount() const {
+  return steal_count_;
+}
+
+void Scheduler::WorkerLoop(size_t index) {
+  while (running_count_ > 0) {
+    VM* vm = Take(index);
+    if (!vm) {
+      // Every live VM is running on another worker. Nap until one of them
+      // powers off or is requeued.
+      unique_lock<mutex> lock(idle_mutex_);
+      idle_.wait_for(lock, std::chrono::milliseconds(1));
+      continue;
+    }
+
+    const bool is_running = vm->system->Run(quantum_cycles_);
+    quanta_run_++;
+
+    if (vm->console) {
+      vm->console->Pump();
+    }
+
+    if (is_running) {
+      Requeue(index, vm);
+    } else {
+      // Powered off. Flush its last words; it stays owned by vms_.
+      if (vm->console) {
+        vm->console->Pump();
+      }
+      running_count_--;
+      idle_.notify_all();
+    }
+  }
+}
+
+Scheduler::VM* Scheduler::Take(size_t index) {
+  {
+    Worker* own = workers_[index].get();
+    lock_guard<mutex> lock(own->queue_mutex);
+    if (!own->queue.empty()) {
+      VM* vm = own->queue.front();
+      own->queue.pop_front();
+      return vm;
+    }
+  }
+
+  // Steal, starting with the next worker along so victims are spread out.
+  for (size_t i = 1; i < workers_.size(); i++) {
+    Worker* victim = workers_[(index + i) % workers_.size()].get();
+    lock_guard<mutex> lock(victim->queue_mutex);
+    if (!victim->queue.empty()) {
+      VM* vm = victim->queue.back();
+      victim->queue.pop_back();
+      steal_count_++;
+      return vm;
+    }
+  }
+
+  return nullptr;
+}
+
+void Scheduler::Requeue(size_t index, VM* vm) {
+  Worker* own = workers_[index].get();
+  size_t queued;
+  {
+    lock_guard<mutex> lock(own->queue_mutex);
+    own->queue.push_back(vm);
+    queued = own->queue.size();
+  }
+
+  // More than this worker can run at once, someone may want to steal.
+  if (queued > 1) {
+    idle_.notify_one();
+  }
+}
@@ -0,0 +1,79 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_SCHEDULER_H_
+#define SIMCTTY_SCHEDULER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "simctty/console.h"
+#include "simctty/system.h"
+#include "simctty/types.h"
+
+using std::atomic;
+using std::deque;
+using std::mutex;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+// Runs many independent Systems on a fixed pool of worker threads.
+//
+// Each worker owns a run queue. It repeatedly takes the VM at the front, runs
+// it for one quantum, pumps its console and requeues it at the back. A worker
+// whose queue is empty steals from the back of another's, so VMs migrate
+// towards idle cores. A VM only ever runs on one worker at a time.
+class Scheduler {
+ public:
+  Scheduler(size_t worker_count, size_t quantum_cycles);
+  ~Scheduler();
+
+  // Takes ownership of system and console (which may be null). Must be
+  // called before Run().
+  void Add(System* system, Console* console);
+
+  // Returns once every VM has powered off.
+  void Run();
+
+  size_t WorkerCount() const;
+  uint64 QuantaRun() const;
+  uint64 StealCount() const;
+
+ private:
+  struct VM {
+    unique_ptr<System> system;
+    unique_ptr<Console> console;
+  };
+
+  struct Worker {
+    mutex queue_mutex;
+    deque<VM*> queue;
+  };
+
+  const size_t quantum_cycles_;
+
+  vector<unique_ptr<VM> > vms_;
+  vector<unique_ptr<Worker> > workers_;
+
+  atomic<size_t> running_count_;
+  atomic<uint64> quanta_run_;
+  atomic<uint64> steal_count_;
+
+  // Idle workers sleep here until there might be something to steal.
+  mutex idle_mutex_;
+  std::condition_variable idle_;
+
+  void WorkerLoop(size_t index);
+  VM* Take(size_t index);
+  void Requeue(size_t index, VM* vm);
+
+  DISALLOW_COPY_AND_ASSIGN(Scheduler);
+};
+
+#endif  // SIMCTTY_SCHEDULER_H_
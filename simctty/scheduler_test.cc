@@ -0,0 +1,49 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "simctty/assembler.h"
+#include "simctty/scheduler.h"
+#include "simctty/system.h"
+
+using std::vector;
+
+TEST(SchedulerTest, RunsEveryVMToCompletion) {
+  const size_t kVMCount = 8;
+  const int16 kLoopCount = 1000;
+
+  // Count r1 down to zero, then power off with l.nop 1.
+  Assembler asm_;
+  asm_.l_addi(kR1, kR0, kLoopCount);
+  asm_.l_addi(kR1, kR1, -1);
+  asm_.l_sfnei(kR1, 0);
+  asm_.l_bf(-2);
+  asm_.l_nop();
+  asm_.l_nop(1);
+
+  Scheduler scheduler(3, 100);
+  vector<System*> systems;
+  for (size_t i = 0; i < kVMCount; i++) {
+    System* system = new System();
+    system->LoadImage(asm_.Instructions(), asm_.Size(), 0);
+    system->GetCPU()->SetReg(kR2, i);
+    systems.push_back(system);
+    scheduler.Add(system, nullptr);
+  }
+
+  scheduler.Run();
+
+  // Each loop iteration is 4 instructions, so many 100 cycle quanta each.
+  ASSERT_LT(kVMCount * kLoopCount * 4 / 100, scheduler.QuantaRun());
+
+  for (size_t i = 0; i < kVMCount; i++) {
+    EXPECT_EQ(0U, systems[i]->GetCPU()->Reg(kR1));
+    EXPECT_EQ(i, systems[i]->GetCPU()->Reg(kR2));
+    EXPECT_EQ(5U * 4, systems[i]->GetCPU()->PC());
+  }
+}
@@ -0,0 +1,30 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_SERIAL_PORT_H_
+#define SIMCTTY_SERIAL_PORT_H_
+
+#include "simctty/types.h"
+
+// Host side of a guest console device (UART, virtio console).
+//
+// May be called from a different thread to the one running the CPU, by one
+// host thread at a time.
+class SerialPort {
+ public:
+  SerialPort() {}
+  virtual ~SerialPort() {}
+
+  // Input to the guest. Returns the number of bytes accepted.
+  virtual size_t WriteBuffer(const uint8* data, size_t length) = 0;
+  virtual size_t WriteBufferFree() const = 0;
+
+  // Output from the guest. Returns the number of bytes read.
+  virtual size_t ReadBuffer(uint8* data, size_t length) = 0;
+  virtual bool CanRead() const = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SerialPort);
+};
+
+#endif  // SIMCTTY_SERIAL_PORT_H_
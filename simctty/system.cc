@@ -11,9 +11,9 @@
 using std::ifstream;
 using std::string;
 
-System::System()
+System::System(size_t uart_fifo_size)
   :
-    bus_(),
+    bus_(uart_fifo_size),
     cpu_(&bus_) {
 }
 
@@ -40,6 +40,22 @@ UART* System::GetUART() {
   return bus_.GetUART();
 }
 
+VirtioConsole* System::GetVirtioConsole() {
+  return bus_.GetVirtioConsole();
+}
+
+VirtioBlock* System::GetVirtioBlock() {
+  return bus_.GetVirtioBlock();
+}
+
+VirtioNet* System::GetVirtioNet() {
+  return bus_.GetVirtioNet();
+}
+
+GoldfishRTC* System::GetRTC() {
+  return bus_.GetRTC();
+}
+
 bool System::LoadImageFile(const char* filename, uint32 start_address) {
   cpu_.Reset();
   cpu_.SetPC(start_address);
@@ -75,6 +91,7 @@ size_t System::LoadImage(const uint8* data, size_t length, uint32 start_address)
 }
 
 bool System::Run(size_t cycles) {
+  bus_.Poll();
   return cpu_.Run(cycles);
 }
 
@@ -11,7 +11,7 @@
 class RAM;
 class System {
  public:
-  System();
+  explicit System(size_t uart_fifo_size = UART::kFifoSize16550);
   ~System();
 
   CPU* GetCPU();
@@ -19,6 +19,10 @@ class System {
   RAM* GetRAM();
   Bus* GetBus();
   UART* GetUART();
+  VirtioConsole* GetVirtioConsole();
+  VirtioBlock* GetVirtioBlock();
+  VirtioNet* GetVirtioNet();
+  GoldfishRTC* GetRTC();
 
   bool LoadImageFile(const char* filename, uint32 start_address);
   size_t LoadImage(const uint8* data, size_t length, uint32 start_address);
@@ -5,16 +5,19 @@
 
 #include <stdarg.h>
 
-UART::UART()
+UART::UART(size_t fifo_size)
   :
     BusDevice(),
+    keypress_fifo_(kKeypressFifoSize),
+    display_fifo_(kDisplayFifoSize),
+    fifo_size_(fifo_size),
     ier_(0),
+    fcr_(0),
     lcr_(3),
     mcr_(0),
     dll_(0),
     dlm_(0),
-    transmit_ready_interrupt_(false),
-    pretend_enable_fifos_(false) {
+    transmit_ready_interrupt_(false) {
 }
 
 UART::~UART() {
@@ -34,24 +37,26 @@ uint8 UART::Load8(uint32 address, Exception* exception) const {
   }
 
   uint32 value;
+  uint8 key;
   switch (address) {
   case 0:
-    if (keypress_fifo_.empty()) {
+    if (!keypress_fifo_.Pop(&key)) {
       return 0;
-    } else {
-      value = keypress_fifo_.front();
-      keypress_fifo_.pop_front();
-      return value;
     }
-    break;
+    UpdateInterrupt();
+    return key;
   case 1:
     return ier_;
   case 2:
-    value = (pretend_enable_fifos_ ? 0xc0 : 0x00) |
-      (IsInterruptAsserted() ? 0x0 : 0x1) |
-      (IsDataReadyInterrupt() ? 0x4 :
-       IsTransmitReadyInterrupt() ? 0x2 : 0);
-    transmit_ready_interrupt_ = false;
+    value =
+      (IsFifoEnabled() ? 0xc0 : 0x00) |
+      (Is64ByteFifoEnabled() ? 0x20 : 0x00) |
+      InterruptId();
+    // Reading IIR only acknowledges a transmit interrupt it reports.
+    if ((value & 0xf) == 0x2) {
+      transmit_ready_interrupt_ = false;
+      UpdateInterrupt();
+    }
     return value;
   case 3:
     return lcr_;
@@ -60,8 +65,8 @@ uint8 UART::Load8(uint32 address, Exception* exception) const {
   case 5:
     // Line Status register.
     return
-      0x60 |                           // Can always transmit.
-      (keypress_fifo_.empty() ? 0x0 : 0x1);  // Data available to read.
+      (CanTransmit() ? 0x60 : 0x0) |           // Transmit FIFO empty.
+      (keypress_fifo_.IsEmpty() ? 0x0 : 0x1);  // Data available to read.
   case 6:
     return 0;
   }
@@ -86,18 +91,29 @@ void UART::Store8(uint32 address, uint8 value, Exception* exception) {
 
   switch (address) {
   case 0:
-    display_fifo_.push_back(value);
-    if (ier_ & 0x2) {
-      transmit_ready_interrupt_ = true;
-    } else {
-      transmit_ready_interrupt_ = false;
-    }
+    // Overrun, dropped if the guest ignored a busy line in LSR.
+    display_fifo_.Push(value);
+
+    // Transmitted instantly, so the FIFO is empty again. One interrupt covers
+    // however many bytes the guest writes before it next looks at IIR.
+    transmit_ready_interrupt_ = ier_ & 0x2;
     break;
   case 1:
+    // Enabling the THRE interrupt with the FIFO empty raises it at once.
+    if (value & ~ier_ & 0x2) {
+      transmit_ready_interrupt_ = true;
+    }
     ier_ = value;
     break;
   case 2:
-    pretend_enable_fifos_ = value & 0x1;
+    // Enable and trigger level bits. The 64 byte FIFO bit can only be changed
+    // with DLAB set.
+    fcr_ = (value & 0xc1) | ((lcr_ & 0x80 ? value : fcr_) & 0x20);
+    if (value & 0x2) {
+      // Clear receive FIFO.
+      keypress_fifo_.Clear();
+    }
+    // Clearing the transmit FIFO is a no-op, it never holds anything.
     break;
   case 3:
     lcr_ = value;
@@ -108,6 +124,8 @@ void UART::Store8(uint32 address, uint8 value, Exception* exception) {
   default:
     break;
   }
+
+  UpdateInterrupt();
 }
 
 bool UART::IsInterruptAsserted() const {
@@ -119,30 +137,87 @@ bool UART::IsInterruptAsserted() const {
   return false;
 }
 
+void UART::UpdateInterrupt() const {
+  SetInterrupt(IsInterruptAsserted());
+}
+
+bool UART::IsFifoEnabled() const {
+  return fcr_ & 0x1;
+}
+
+bool UART::Is64ByteFifoEnabled() const {
+  return fifo_size_ == kFifoSize16750 && (fcr_ & 0x21) == 0x21;
+}
+
+size_t UART::TransmitFifoSize() const {
+  if (!IsFifoEnabled()) {
+    return 1;
+  }
+
+  return Is64ByteFifoEnabled() ? kFifoSize16750 : kFifoSize16550;
+}
+
+size_t UART::ReceiveTriggerLevel() const {
+  if (!IsFifoEnabled()) {
+    return 1;
+  }
+
+  const static size_t kTriggerLevels16550[] = {1, 4, 8, 14};
+  const static size_t kTriggerLevels16750[] = {1, 16, 32, 56};
+  return Is64ByteFifoEnabled() ?
+      kTriggerLevels16750[fcr_ >> 6] : kTriggerLevels16550[fcr_ >> 6];
+}
+
+bool UART::CanTransmit() const {
+  // Room on the host side for a full FIFO, so the guest can't overrun it.
+  return display_fifo_.Free() >= TransmitFifoSize();
+}
+
 bool UART::IsDataReadyInterrupt() const {
-  return !keypress_fifo_.empty() && ier_ & 0x1;
+  return !keypress_fifo_.IsEmpty() && ier_ & 0x1;
 }
 
 bool UART::IsTransmitReadyInterrupt() const {
-  return ier_ & 0x2 && transmit_ready_interrupt_;
+  // Held off while the host is behind, so the guest is interrupted again once
+  // there is room.
+  return ier_ & 0x2 && transmit_ready_interrupt_ && CanTransmit();
+}
+
+uint8 UART::InterruptId() const {
+  if (IsDataReadyInterrupt()) {
+    // Below the trigger level the FIFO reports a character timeout instead.
+    // Input arrives in bursts or at typing speed, so the timeout is treated
+    // as having already expired rather than delaying the guest.
+    return keypress_fifo_.Size() >= ReceiveTriggerLevel() ? 0x4 : 0xc;
+  } else if (IsTransmitReadyInterrupt()) {
+    return 0x2;
+  }
+
+  return 0x1;  // No interrupt pending.
 }
 
 void UART::Keypress(uint8 c) {
-  keypress_fifo_.push_back(c);
+  keypress_fifo_.Push(c);
 }
 
-uint8 UART::Read() {
-  if (display_fifo_.empty()) {
-    return 0;
-  }
+size_t UART::WriteBuffer(const uint8* data, size_t length) {
+  return keypress_fifo_.Write(data, length);
+}
 
-  uint8 key = display_fifo_.front();
-  display_fifo_.pop_front();
+size_t UART::WriteBufferFree() const {
+  return keypress_fifo_.Free();
+}
+
+uint8 UART::Read() {
+  uint8 c;
+  return display_fifo_.Pop(&c) ? c : 0;
+}
 
-  return key;
+size_t UART::ReadBuffer(uint8* data, size_t length) {
+  return display_fifo_.Read(data, length);
 }
 
 bool UART::CanRead() const {
-  return !display_fifo_.empty();
+  return !display_fifo_.IsEmpty();
 }
 
@@ -4,20 +4,28 @@
 #ifndef SIMCTTY_UART_H_
 #define SIMCTTY_UART_H_
 
-#include <list>
-
 #include "simctty/bus_device.h"
 #include "simctty/exception.h"
+#include "simctty/ring_buffer.h"
+#include "simctty/serial_port.h"
 #include "simctty/types.h"
 
-using std::list;
-
 const static uint32 kMinUartAddress = 0x90000000;
 const static uint32 kMaxUartAddress = 0x90000100;
 
-class UART : public BusDevice {
+// 16550A compatible UART, or 16750 with a 64 byte FIFO.
+//
+// The transmitter is infinitely fast: a byte written to THR goes straight to
+// the host buffer. The transmit FIFO is modelled by only reporting it empty
+// (LSR THRE, and the THRE interrupt) while the host buffer can take a whole
+// FIFO's worth, so the guest driver can write a full burst per interrupt
+// without overrunning.
+class UART : public BusDevice, public SerialPort {
  public:
-  UART();
+  const static size_t kFifoSize16550 = 16;
+  const static size_t kFifoSize16750 = 64;
+
+  explicit UART(size_t fifo_size = kFifoSize16550);
   ~UART();
 
   virtual uint8 Load8(uint32 address, Exception* exception) const;
@@ -25,17 +33,32 @@ class UART : public BusDevice {
 
   bool IsInterruptAsserted() const;
 
+  // Drives the interrupt line from the current state. Guest register
+  // accesses do this themselves; host side changes are picked up when the
+  // bus calls it between slices.
+  void UpdateInterrupt() const;
+
+  // Host side of the serial line.
   void Keypress(uint8 c);
+  virtual size_t WriteBuffer(const uint8* data, size_t length);
+  virtual size_t WriteBufferFree() const;
+
   uint8 Read();
-  bool CanRead() const;
+  virtual size_t ReadBuffer(uint8* data, size_t length);
+  virtual bool CanRead() const;
 
  private:
-  mutable list<uint8> keypress_fifo_;
-  list<uint8> display_fifo_;
+  const static size_t kKeypressFifoSize = 4096;
+  const static size_t kDisplayFifoSize = 65536;
+
+  mutable RingBuffer keypress_fifo_;
+  RingBuffer display_fifo_;
+
+  const size_t fifo_size_;
 
   uint8 ier_;  // Interrupt enable register. R/W
   // IID is R only.
-  // FCO is W only.
+  uint8 fcr_;  // FIFO control register. W only.
 
   uint8 lcr_;  // Line control register. R/W.
   uint8 mcr_;  // Modem control register. R/W.
@@ -48,11 +71,20 @@ class UART : public BusDevice {
   const static size_t kIELineStatusChange = 2;
   const static size_t kIEModemStatusChange = 3;
 
+  bool IsFifoEnabled() const;
+  bool Is64ByteFifoEnabled() const;
+  size_t TransmitFifoSize() const;
+  size_t ReceiveTriggerLevel() const;
+
+  bool CanTransmit() const;
+
   bool IsDataReadyInterrupt() const;
   bool IsTransmitReadyInterrupt() const;
+  uint8 InterruptId() const;
 
+  // Set when the transmit FIFO empties, cleared by writing THR or by reading
+  // IIR while it is the reported interrupt.
   mutable bool transmit_ready_interrupt_;
-  bool pretend_enable_fifos_;
 
   DISALLOW_COPY_AND_ASSIGN(UART);
 };
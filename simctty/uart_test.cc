@@ -0,0 +1,142 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "simctty/exception.h"
+#include "simctty/system.h"
+#include "simctty/uart.h"
+
+class UARTTest : public ::testing::Test {
+ public:
+  uint8 Load(uint32 reg) {
+    Exception exception;
+    return uart_.Load8(kMinUartAddress + reg, &exception);
+  }
+
+  void Store(uint32 reg, uint8 value) {
+    Exception exception;
+    uart_.Store8(kMinUartAddress + reg, value, &exception);
+  }
+
+  UART uart_;
+
+  const static uint32 kTHR = 0;
+  const static uint32 kIER = 1;
+  const static uint32 kIIR = 2;
+  const static uint32 kFCR = 2;
+  const static uint32 kLCR = 3;
+  const static uint32 kLSR = 5;
+};
+
+TEST_F(UARTTest, FifoEnable) {
+  ASSERT_EQ(0x01, Load(kIIR));
+
+  Store(kFCR, 0x01);
+  ASSERT_EQ(0xc1, Load(kIIR));
+
+  // No 64 byte FIFO on a 16550A.
+  Store(kLCR, 0x83);
+  Store(kFCR, 0x21);
+  Store(kLCR, 0x03);
+  ASSERT_EQ(0xc1, Load(kIIR));
+}
+
+TEST_F(UARTTest, ReceiveTriggerLevel) {
+  Store(kFCR, 0x81);  // Trigger at 8 bytes.
+  Store(kIER, 0x01);
+
+  const uint8 keys[] = "abcdefgh";
+  uart_.WriteBuffer(keys, 4);
+  ASSERT_TRUE(uart_.IsInterruptAsserted());
+  ASSERT_EQ(0xcc, Load(kIIR));  // Character timeout.
+
+  uart_.WriteBuffer(keys + 4, 4);
+  ASSERT_EQ(0xc4, Load(kIIR));  // Data available.
+}
+
+TEST_F(UARTTest, TransmitInterruptOncePerBurst) {
+  Store(kFCR, 0x01);
+
+  // Enabling THRE with the FIFO empty raises it straight away.
+  Store(kIER, 0x02);
+  ASSERT_TRUE(uart_.IsInterruptAsserted());
+  ASSERT_EQ(0xc2, Load(kIIR));
+  ASSERT_FALSE(uart_.IsInterruptAsserted());
+
+  for (size_t i = 0; i < UART::kFifoSize16550; i++) {
+    Store(kTHR, 'x');
+  }
+  ASSERT_EQ(0xc2, Load(kIIR));
+  ASSERT_EQ(0xc1, Load(kIIR));
+}
+
+TEST_F(UARTTest, TransmitHeldOffUntilFifoFits) {
+  Store(kFCR, 0x01);
+  Store(kIER, 0x02);
+
+  // Fill the host side until a full FIFO no longer fits.
+  while (Load(kLSR) & 0x20) {
+    Store(kTHR, 'x');
+  }
+  ASSERT_FALSE(uart_.IsInterruptAsserted());
+
+  uint8 buffer[UART::kFifoSize16550];
+  uart_.ReadBuffer(buffer, sizeof(buffer));
+  ASSERT_EQ(0x60, Load(kLSR) & 0x60);
+  ASSERT_TRUE(uart_.IsInterruptAsserted());
+}
+
+TEST_F(UARTTest, HostBuffers) {
+  const uint8 keys[] = {'l', 's', '\n'};
+  ASSERT_EQ(3U, uart_.WriteBuffer(keys, sizeof(keys)));
+  for (size_t i = 0; i < sizeof(keys); i++) {
+    ASSERT_EQ(keys[i], Load(kTHR));
+  }
+
+  const char* text = "hello";
+  for (const char* c = text; *c; c++) {
+    Store(kTHR, *c);
+  }
+
+  uint8 out[16];
+  ASSERT_EQ(5U, uart_.ReadBuffer(out, sizeof(out)));
+  ASSERT_EQ(0, memcmp(text, out, 5));
+  ASSERT_FALSE(uart_.CanRead());
+}
+
+TEST(UART16750Test, SixtyFourByteFifo) {
+  UART uart(UART::kFifoSize16750);
+  Exception exception;
+
+  // FCR bit 5 only sticks with DLAB set.
+  uart.Store8(kMinUartAddress + 2, 0x21, &exception);
+  ASSERT_EQ(0xc1, uart.Load8(kMinUartAddress + 2, &exception));
+
+  uart.Store8(kMinUartAddress + 3, 0x83, &exception);
+  uart.Store8(kMinUartAddress + 2, 0xe1, &exception);
+  uart.Store8(kMinUartAddress + 3, 0x03, &exception);
+  ASSERT_EQ(0xe1, uart.Load8(kMinUartAddress + 2, &exception));
+
+  // Trigger at 56 bytes.
+  uart.Store8(kMinUartAddress + 1, 0x01, &exception);
+  uint8 keys[56] = {0};
+  uart.WriteBuffer(keys, 55);
+  ASSERT_EQ(0xec, uart.Load8(kMinUartAddress + 2, &exception));
+  uart.WriteBuffer(keys, 1);
+  ASSERT_EQ(0xe4, uart.Load8(kMinUartAddress + 2, &exception));
+}
+
+TEST(UART16750Test, SelectedBySystem) {
+  System system(UART::kFifoSize16750);
+  UART* uart = system.GetUART();
+  Exception exception;
+
+  uart->Store8(kMinUartAddress + 3, 0x83, &exception);
+  uart->Store8(kMinUartAddress + 2, 0x21, &exception);
+  uart->Store8(kMinUartAddress + 3, 0x03, &exception);
+  ASSERT_EQ(0xe1, uart->Load8(kMinUartAddress + 2, &exception));
+}
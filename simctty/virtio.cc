@@ -0,0 +1,407 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/virtio.h"
+
+#include <string.h>
+
+#include "simctty/bitwise.h"
+
+namespace {
+
+// Transport registers, offsets into the window.
+const uint32 kMagicValue = 0x000;
+const uint32 kVersion = 0x004;
+const uint32 kDeviceId = 0x008;
+const uint32 kVendorId = 0x00c;
+const uint32 kHostFeatures = 0x010;
+const uint32 kHostFeaturesSel = 0x014;
+const uint32 kGuestFeatures = 0x020;
+const uint32 kGuestFeaturesSel = 0x024;
+const uint32 kGuestPageSize = 0x028;
+const uint32 kQueueSel = 0x030;
+const uint32 kQueueNumMax = 0x034;
+const uint32 kQueueNum = 0x038;
+const uint32 kQueueAlign = 0x03c;
+const uint32 kQueuePFN = 0x040;
+const uint32 kQueueNotify = 0x050;
+const uint32 kInterruptStatus = 0x060;
+const uint32 kInterruptACK = 0x064;
+const uint32 kStatus = 0x070;
+const uint32 kConfig = 0x100;
+
+const uint32 kMagic = 0x74726976;  // "virt"
+const uint32 kVendor = 0x554d4551;  // "QEMU", as everyone else uses.
+
+const uint32 kInterruptUsedBuffer = 0x1;
+
+const uint32 kStatusDriverOk = 0x4;
+
+// Descriptor flags.
+const uint16 kDescNext = 0x1;
+const uint16 kDescWrite = 0x2;
+
+// Available ring flags.
+const uint16 kAvailNoInterrupt = 0x1;
+
+const uint32 kDescSize = 16;
+
+bool IsInRam(uint32 address, uint32 length) {
+  return address <= kMaxRamAddress && length <= kMaxRamAddress + 1 - address;
+}
+
+}  // namespace
+
+void CopyFromGuest(RAM* ram, uint32 address, uint8* data, size_t length) {
+  const uint8* raw = ram->Raw();
+
+  // Odd bytes up to a word boundary, then whole words, then the tail.
+  while (length > 0 && (address & 0x3) != 0) {
+    *data++ = raw[address++ ^ 0x3];
+    length--;
+  }
+  for (; length >= 4; length -= 4) {
+    uint32 word;
+    memcpy(&word, raw + address, 4);
+    word = B32ENDIANSWAP(word);
+    memcpy(data, &word, 4);
+    address += 4;
+    data += 4;
+  }
+  while (length > 0) {
+    *data++ = raw[address++ ^ 0x3];
+    length--;
+  }
+}
+
+void CopyToGuest(RAM* ram, uint32 address, const uint8* data, size_t length) {
+  ram->InvalidateCode(address, length);
+  CopyToGuestUntracked(ram, address, data, length);
+}
+
+void CopyToGuestUntracked(RAM* ram, uint32 address, const uint8* data,
+                          size_t length) {
+  uint8* raw = ram->Raw();
+
+  while (length > 0 && (address & 0x3) != 0) {
+    raw[address++ ^ 0x3] = *data++;
+    length--;
+  }
+  for (; length >= 4; length -= 4) {
+    uint32 word;
+    memcpy(&word, data, 4);
+    word = B32ENDIANSWAP(word);
+    memcpy(raw + address, &word, 4);
+    address += 4;
+    data += 4;
+  }
+  while (length > 0) {
+    raw[address++ ^ 0x3] = *data++;
+    length--;
+  }
+}
+
+VirtQueue::VirtQueue() {
+  Reset();
+}
+
+void VirtQueue::Reset() {
+  size_ = 0;
+  align_ = 4096;
+  pfn_ = 0;
+  desc_ = 0;
+  avail_ = 0;
+  used_ = 0;
+  last_avail_idx_ = 0;
+}
+
+void VirtQueue::SetSize(uint32 size) {
+  // Must be a power of two no bigger than QueueNumMax, anything else leaves
+  // the queue unusable.
+  if (size > kMaxSize || (size & (size - 1)) != 0) {
+    size = 0;
+  }
+  size_ = size;
+}
+
+void VirtQueue::SetAlign(uint32 align) {
+  align_ = align;
+}
+
+void VirtQueue::SetPFN(uint32 pfn, uint32 page_size) {
+  pfn_ = pfn;
+  last_avail_idx_ = 0;
+  if (pfn == 0 || size_ == 0 || align_ == 0 ||
+      (align_ & (align_ - 1)) != 0) {
+    desc_ = avail_ = used_ = 0;
+    return;
+  }
+
+  desc_ = pfn * page_size;
+  avail_ = desc_ + kDescSize * size_;
+  // flags, idx, ring[size], used_event.
+  used_ = (avail_ + 2 * (3 + size_) + align_ - 1) & ~(align_ - 1);
+  // flags, idx, ring[size] of id and len, avail_event.
+  const uint32 end = used_ + 4 + 8 * size_ + 2;
+  if (!IsInRam(desc_, end - desc_) || end < desc_) {
+    desc_ = avail_ = used_ = 0;
+  }
+}
+
+uint32 VirtQueue::PFN() const {
+  return pfn_;
+}
+
+bool VirtQueue::IsReady() const {
+  return desc_ != 0;
+}
+
+bool VirtQueue::Pop(RAM* ram, uint16* head, VirtBuffer* buffers,
+                    size_t* count) {
+  if (!IsReady()) {
+    return false;
+  }
+
+  Exception exception;
+  const uint16 avail_idx = ram->Load16(avail_ + 2, &exception);
+  if (avail_idx == last_avail_idx_) {
+    return false;
+  }
+
+  const uint32 slot = last_avail_idx_ & (size_ - 1);
+  *head = ram->Load16(avail_ + 4 + 2 * slot, &exception);
+  last_avail_idx_++;
+
+  size_t n = 0;
+  uint16 index = *head;
+  for (;;) {
+    if (index >= size_ || n == kMaxChainLength) {
+      // Malformed chain, hand it straight back.
+      Push(ram, *head, 0);
+      return false;
+    }
+
+    const uint32 desc = desc_ + kDescSize * index;
+    // 64 bit address, only the low word can reach RAM.
+    const uint32 address_high = ram->Load32(desc, &exception);
+    const uint32 address = ram->Load32(desc + 4, &exception);
+    const uint32 length = ram->Load32(desc + 8, &exception);
+    const uint16 flags = ram->Load16(desc + 12, &exception);
+    const uint16 next = ram->Load16(desc + 14, &exception);
+
+    if (address_high != 0 || !IsInRam(address, length)) {
+      Push(ram, *head, 0);
+      return false;
+    }
+
+    buffers[n].address = address;
+    buffers[n].length = length;
+    buffers[n].is_write = (flags & kDescWrite) != 0;
+    n++;
+
+    if (!(flags & kDescNext)) {
+      break;
+    }
+    index = next;
+  }
+
+  *count = n;
+  return true;
+}
+
+void VirtQueue::Unpop() {
+  last_avail_idx_--;
+}
+
+void VirtQueue::Push(RAM* ram, uint16 head, uint32 written) {
+  Exception exception;
+  const uint16 used_idx = ram->Load16(used_ + 2, &exception);
+  const uint32 element = used_ + 4 + 8 * (used_idx & (size_ - 1));
+  ram->Store32(element, head, &exception);
+  ram->Store32(element + 4, written, &exception);
+  ram->Store16(used_ + 2, used_idx + 1, &exception);
+}
+
+bool VirtQueue::IsInterruptSuppressed(RAM* ram) const {
+  Exception exception;
+  return (ram->Load16(avail_, &exception) & kAvailNoInterrupt) != 0;
+}
+
+VirtioMMIO::VirtioMMIO(RAM* ram, uint32 base_address, size_t queue_count)
+  :
+    BusDevice(),
+    ram_(ram),
+    base_address_(base_address),
+    queue_count_(queue_count) {
+  Reset();
+}
+
+VirtioMMIO::~VirtioMMIO() {
+}
+
+uint8 VirtioMMIO::Load8(uint32 address, Exception* exception) const {
+  *exception = kExceptionNone;
+  address -= base_address_;
+  if (address < kConfig) {
+    *exception = kExceptionBusError;
+    return 0;
+  }
+
+  return ConfigLoad8(address - kConfig);
+}
+
+uint32 VirtioMMIO::Load32(uint32 address, Exception* exception) const {
+  *exception = kExceptionNone;
+  address -= base_address_;
+
+  uint32 value = 0;
+  switch (address) {
+  case kMagicValue:
+    value = kMagic;
+    break;
+  case kVersion:
+    value = 1;
+    break;
+  case kDeviceId:
+    value = DeviceId();
+    break;
+  case kVendorId:
+    value = kVendor;
+    break;
+  case kHostFeatures:
+    value = DeviceFeatures(device_features_select_);
+    break;
+  case kQueueNumMax:
+    value = queue_select_ < queue_count_ ? VirtQueue::kMaxSize : 0;
+    break;
+  case kQueuePFN:
+    value = queue_select_ < queue_count_ ? queues_[queue_select_].PFN() : 0;
+    break;
+  case kInterruptStatus:
+    value = interrupt_status_;
+    break;
+  case kStatus:
+    value = status_;
+    break;
+  default:
+    if (address >= kConfig) {
+      // Config space is a byte array in guest order, no swap.
+      for (uint32 i = 0; i < 4; i++) {
+        value = (value << 8) | ConfigLoad8(address - kConfig + i);
+      }
+      return value;
+    }
+    break;
+  }
+
+  // The registers are little endian and the guest (readl) byte swaps them.
+  return B32ENDIANSWAP(value);
+}
+
+void VirtioMMIO::Store32(uint32 address, uint32 value, Exception* exception) {
+  *exception = kExceptionNone;
+  address -= base_address_;
+  value = B32ENDIANSWAP(value);
+
+  switch (address) {
+  case kHostFeaturesSel:
+    device_features_select_ = value;
+    break;
+  case kGuestFeatures:
+    if (driver_features_select_ == 0) {
+      driver_features_ = value;
+    }
+    break;
+  case kGuestFeaturesSel:
+    driver_features_select_ = value;
+    break;
+  case kGuestPageSize:
+    page_size_ = value;
+    break;
+  case kQueueSel:
+    queue_select_ = value;
+    break;
+  case kQueueNum:
+    if (queue_select_ < queue_count_) {
+      queues_[queue_select_].SetSize(value);
+    }
+    break;
+  case kQueueAlign:
+    if (queue_select_ < queue_count_) {
+      queues_[queue_select_].SetAlign(value);
+    }
+    break;
+  case kQueuePFN:
+    if (queue_select_ < queue_count_) {
+      queues_[queue_select_].SetPFN(value, page_size_);
+    }
+    break;
+  case kQueueNotify:
+    if (value < queue_count_) {
+      QueueNotify(value);
+    }
+    break;
+  case kInterruptACK:
+    interrupt_status_ &= ~value;
+    SetInterrupt(IsInterruptAsserted());
+    break;
+  case kStatus:
+    if (value == 0) {
+      Reset();
+      DeviceReset();
+    } else {
+      status_ = value;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+bool VirtioMMIO::IsInterruptAsserted() const {
+  return interrupt_status_ != 0;
+}
+
+bool VirtioMMIO::NotifyUsed(size_t queue) {
+  if (queues_[queue].IsInterruptSuppressed(ram_)) {
+    return false;
+  }
+
+  interrupt_status_ |= kInterruptUsedBuffer;
+  SetInterrupt(true);
+  return true;
+}
+
+uint32 VirtioMMIO::DriverFeatures() const {
+  return driver_features_;
+}
+
+bool VirtioMMIO::IsDriverReady() const {
+  return (status_ & kStatusDriverOk) != 0;
+}
+
+uint32 VirtioMMIO::DeviceFeatures(uint32 select) const {
+  return 0;
+}
+
+uint8 VirtioMMIO::ConfigLoad8(uint32 offset) const {
+  return 0;
+}
+
+void VirtioMMIO::DeviceReset() {
+}
+
+void VirtioMMIO::Reset() {
+  device_features_select_ = 0;
+  driver_features_select_ = 0;
+  driver_features_ = 0;
+  page_size_ = 4096;
+  queue_select_ = 0;
+  interrupt_status_ = 0;
+  status_ = 0;
+  SetInterrupt(false);
+
+  for (size_t i = 0; i < kMaxQueues; i++) {
+    queues_[i].Reset();
+  }
+}
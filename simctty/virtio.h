@@ -0,0 +1,141 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_VIRTIO_H_
+#define SIMCTTY_VIRTIO_H_
+
+#include "simctty/bus_device.h"
+#include "simctty/exception.h"
+#include "simctty/ram.h"
+#include "simctty/types.h"
+
+// One buffer of a descriptor chain: a run of guest physical memory.
+struct VirtBuffer {
+  uint32 address;
+  uint32 length;
+  bool is_write;  // Device writes (guest reads) this buffer.
+};
+
+// Byte copies between host memory and guest physical memory, undoing the
+// word swizzle RAM stores guest bytes in. The caller bounds checks.
+// CopyToGuest() also drops code compiled from what it overwrites
+// (RAM::InvalidateCode), so is for the CPU thread only. Other threads use
+// CopyToGuestUntracked() and leave the CPU thread to call InvalidateCode()
+// before the guest is told the data is there.
+void CopyFromGuest(RAM* ram, uint32 address, uint8* data, size_t length);
+void CopyToGuest(RAM* ram, uint32 address, const uint8* data, size_t length);
+void CopyToGuestUntracked(RAM* ram, uint32 address, const uint8* data,
+                          size_t length);
+
+// Split virtqueue in the legacy (virtio-mmio version 1) layout, read and
+// written in place in guest RAM. Ring fields are in guest byte order.
+class VirtQueue {
+ public:
+  const static uint16 kMaxSize = 256;
+  const static size_t kMaxChainLength = 16;
+
+  VirtQueue();
+
+  void Reset();
+
+  // Register interface.
+  void SetSize(uint32 size);
+  void SetAlign(uint32 align);
+  void SetPFN(uint32 pfn, uint32 page_size);
+  uint32 PFN() const;
+  bool IsReady() const;
+
+  // Takes the next available chain, filling buffers (up to kMaxChainLength)
+  // and head. Returns false when none is available or the chain is malformed.
+  bool Pop(RAM* ram, uint16* head, VirtBuffer* buffers, size_t* count);
+
+  // Puts back the chain last taken by Pop, to be taken again later.
+  void Unpop();
+
+  // Returns a chain to the guest, with written bytes of it filled in.
+  void Push(RAM* ram, uint16 head, uint32 written);
+
+  // Whether the guest has asked not to be interrupted for used buffers.
+  bool IsInterruptSuppressed(RAM* ram) const;
+
+ private:
+  uint32 size_;
+  uint32 align_;
+  uint32 pfn_;
+
+  uint32 desc_;   // Descriptor table, 16 bytes per entry.
+  uint32 avail_;  // Available ring.
+  uint32 used_;   // Used ring.
+
+  uint16 last_avail_idx_;
+
+  DISALLOW_COPY_AND_ASSIGN(VirtQueue);
+};
+
+// Virtio device on the bus, legacy (version 1) virtio-mmio transport.
+//
+// Subclasses supply the device type, features, queues and configuration
+// space. Queue notifications are handled synchronously in the guest's store.
+// Linux finds the device with e.g.
+//   virtio_mmio.device=0x200@0x92000000:3
+// on the kernel command line, or a "virtio,mmio" device tree node.
+class VirtioMMIO : public BusDevice {
+ public:
+  VirtioMMIO(RAM* ram, uint32 base_address, size_t queue_count);
+  virtual ~VirtioMMIO();
+
+  virtual uint8 Load8(uint32 address, Exception* exception) const;
+  virtual uint32 Load32(uint32 address, Exception* exception) const;
+  virtual void Store32(uint32 address, uint32 value, Exception* exception);
+
+  bool IsInterruptAsserted() const;
+
+  // Size of the register window.
+  const static uint32 kWindowSize = 0x200;
+
+ protected:
+  const static size_t kMaxQueues = 4;
+
+  RAM* ram_;
+  VirtQueue queues_[kMaxQueues];
+
+  // Raise the used buffer interrupt for queue, unless the guest suppressed it.
+  // Returns whether it did.
+  bool NotifyUsed(size_t queue);
+
+  // Features (word 0) the driver accepted.
+  uint32 DriverFeatures() const;
+
+  // Whether the driver has finished setting up (DRIVER_OK).
+  bool IsDriverReady() const;
+
+  virtual uint32 DeviceId() const = 0;
+  virtual uint32 DeviceFeatures(uint32 select) const;
+
+  // Device specific configuration space, read a byte at a time.
+  virtual uint8 ConfigLoad8(uint32 offset) const;
+
+  // Guest has made buffers available on queue.
+  virtual void QueueNotify(size_t queue) = 0;
+
+  // Device reset, written 0 to Status. Called after the transport is reset.
+  virtual void DeviceReset();
+
+ private:
+  const uint32 base_address_;
+  const size_t queue_count_;
+
+  uint32 device_features_select_;
+  uint32 driver_features_select_;
+  uint32 driver_features_;
+  uint32 page_size_;
+  uint32 queue_select_;
+  uint32 interrupt_status_;
+  uint32 status_;
+
+  void Reset();
+
+  DISALLOW_COPY_AND_ASSIGN(VirtioMMIO);
+};
+
+#endif  // SIMCTTY_VIRTIO_H_
@@ -0,0 +1,346 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/virtio_block.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+using std::vector;
+
+namespace {
+
+const uint32 kBlockDeviceId = 2;
+
+// Feature bits.
+const uint32 kFeatureSegMax = 1 << 2;
+const uint32 kFeatureReadOnly = 1 << 5;
+const uint32 kFeatureFlush = 1 << 9;
+
+// Request types.
+const uint32 kRequestIn = 0;
+const uint32 kRequestOut = 1;
+const uint32 kRequestFlush = 4;
+const uint32 kRequestGetId = 8;
+
+// Request status.
+const uint8 kStatusOk = 0;
+const uint8 kStatusIoError = 1;
+const uint8 kStatusUnsupported = 2;
+
+// type, reserved, sector.
+const uint32 kHeaderSize = 16;
+
+const uint32 kIdSize = 20;
+const char kId[] = "simctty";
+
+}  // namespace
+
+VirtioBlock::VirtioBlock(RAM* ram)
+  :
+    VirtioMMIO(ram, kMinVirtioBlockAddress, 1),
+    fd_(-1),
+    image_(nullptr),
+    size_(0),
+    is_read_only_(false),
+    is_private_(false),
+    in_flight_(0),
+    is_stopping_(false),
+    completed_count_(0) {
+}
+
+VirtioBlock::~VirtioBlock() {
+  if (thread_.joinable()) {
+    {
+      lock_guard<mutex> lock(mutex_);
+      is_stopping_ = true;
+    }
+    submitted_ready_.notify_one();
+    thread_.join();
+  }
+
+  if (image_) {
+    munmap(image_, size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool VirtioBlock::Open(const char* path, bool is_private) {
+  is_private_ = is_private;
+  fd_ = open(path, (is_private ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+  if (fd_ < 0 && !is_private) {
+    fd_ = open(path, O_RDONLY | O_CLOEXEC);
+    is_read_only_ = true;
+  }
+  if (fd_ < 0) {
+    perror(path);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    perror("fstat");
+    return false;
+  }
+
+  // Whole sectors only, a partial one at the end is ignored.
+  size_ = static_cast<uint64>(st.st_size) & ~static_cast<uint64>(
+      kSectorSize - 1);
+  if (size_ == 0) {
+    fprintf(stderr, "%s: image smaller than a sector\n", path);
+    return false;
+  }
+
+  const int protection = is_read_only_ ? PROT_READ : PROT_READ | PROT_WRITE;
+  const int flags = is_private ? MAP_PRIVATE : MAP_SHARED;
+  void* image = mmap(nullptr, size_, protection, flags, fd_, 0);
+  if (image == MAP_FAILED) {
+    perror("mmap");
+    return false;
+  }
+  image_ = static_cast<uint8*>(image);
+
+  thread_ = std::thread(&VirtioBlock::IoThread, this);
+  return true;
+}
+
+void VirtioBlock::Poll() {
+  if (completed_count_ == 0) {
+    return;
+  }
+
+  vector<Request> completed;
+  {
+    lock_guard<mutex> lock(mutex_);
+    completed.swap(completed_);
+    completed_count_ = 0;
+  }
+
+  for (size_t i = 0; i < completed.size(); i++) {
+    // The I/O thread leaves the code page map to this thread.
+    const Request& request = completed[i];
+    for (size_t j = 0; j < request.data_count; j++) {
+      if (request.data[j].is_write) {
+        ram_->InvalidateCode(request.data[j].address, request.data[j].length);
+      }
+    }
+    ram_->InvalidateCode(request.status_address, 1);
+    queues_[0].Push(ram_, request.head, request.written);
+  }
+  NotifyUsed(0);
+}
+
+void VirtioBlock::Drain() {
+  unique_lock<mutex> lock(mutex_);
+  while (in_flight_ > 0) {
+    idle_.wait(lock);
+  }
+}
+
+uint32 VirtioBlock::DeviceId() const {
+  return kBlockDeviceId;
+}
+
+uint32 VirtioBlock::DeviceFeatures(uint32 select) const {
+  if (select != 0) {
+    return 0;
+  }
+
+  uint32 features = kFeatureSegMax | kFeatureFlush;
+  if (is_read_only_) {
+    features |= kFeatureReadOnly;
+  }
+  return features;
+}
+
+uint8 VirtioBlock::ConfigLoad8(uint32 offset) const {
+  // Guest byte order: capacity (sectors) then size_max and seg_max.
+  if (offset < 8) {
+    const uint64 capacity = size_ / kSectorSize;
+    return capacity >> (8 * (7 - offset));
+  } else if (offset >= 12 && offset < 16) {
+    // Less the header and status descriptors.
+    const uint32 seg_max = VirtQueue::kMaxChainLength - 2;
+    return seg_max >> (8 * (15 - offset));
+  }
+
+  return 0;
+}
+
+void VirtioBlock::QueueNotify(size_t queue) {
+  VirtBuffer buffers[VirtQueue::kMaxChainLength];
+  vector<Request> batch;
+  bool is_used = false;
+
+  uint16 head;
+  size_t count;
+  while (queues_[0].Pop(ram_, &head, buffers, &count)) {
+    Request request;
+    request.head = head;
+    if (!Parse(buffers, count, &request)) {
+      // Nowhere to put a status, just hand it back.
+      queues_[0].Push(ram_, head, 0);
+      is_used = true;
+    } else if (!image_) {
+      // No media, fail it here.
+      Execute(&request);
+      queues_[0].Push(ram_, head, request.written);
+      is_used = true;
+    } else {
+      batch.push_back(request);
+    }
+  }
+
+  if (is_used) {
+    NotifyUsed(0);
+  }
+
+  if (!batch.empty()) {
+    {
+      lock_guard<mutex> lock(mutex_);
+      in_flight_ += batch.size();
+      submitted_.insert(submitted_.end(), batch.begin(), batch.end());
+    }
+    submitted_ready_.notify_one();
+  }
+}
+
+void VirtioBlock::DeviceReset() {
+  // The transport has forgotten the queue, so finished requests have
+  // nowhere to go.
+  Drain();
+
+  lock_guard<mutex> lock(mutex_);
+  completed_.clear();
+  completed_count_ = 0;
+}
+
+bool VirtioBlock::Parse(const VirtBuffer* buffers, size_t count,
+                        Request* request) const {
+  // Header, any data, then a status byte at the end of the last buffer.
+  if (count < 2) {
+    return false;
+  }
+
+  const VirtBuffer& header = buffers[0];
+  const VirtBuffer& status = buffers[count - 1];
+  if (header.is_write || header.length < kHeaderSize ||
+      !status.is_write || status.length == 0) {
+    return false;
+  }
+
+  Exception exception;
+  request->type = ram_->Load32(header.address, &exception);
+  request->sector =
+      static_cast<uint64>(ram_->Load32(header.address + 8, &exception)) << 32 |
+      ram_->Load32(header.address + 12, &exception);
+
+  request->data_count = 0;
+  for (size_t i = 1; i < count - 1; i++) {
+    request->data[request->data_count++] = buffers[i];
+  }
+  if (status.length > 1) {
+    VirtBuffer* data = &request->data[request->data_count++];
+    *data = status;
+    data->length--;
+  }
+
+  request->status_address = status.address + status.length - 1;
+  request->written = 0;
+  return true;
+}
+
+void VirtioBlock::IoThread() {
+  unique_lock<mutex> lock(mutex_);
+  for (;;) {
+    while (submitted_.empty() && !is_stopping_) {
+      submitted_ready_.wait(lock);
+    }
+    if (submitted_.empty()) {
+      return;
+    }
+
+    // Take the whole backlog at once, one lock round trip per batch.
+    vector<Request> batch;
+    batch.swap(submitted_);
+    lock.unlock();
+
+    for (size_t i = 0; i < batch.size(); i++) {
+      Execute(&batch[i]);
+    }
+
+    lock.lock();
+    completed_.insert(completed_.end(), batch.begin(), batch.end());
+    completed_count_ = completed_.size();
+    in_flight_ -= batch.size();
+    if (in_flight_ == 0) {
+      idle_.notify_all();
+    }
+  }
+}
+
+void VirtioBlock::Execute(Request* request) {
+  uint8 status = kStatusOk;
+  uint64 offset = request->sector * kSectorSize;
+
+  switch (request->type) {
+  case kRequestIn:
+  case kRequestOut:
+    if ((request->type == kRequestOut && is_read_only_) ||
+        request->sector > size_ / kSectorSize) {
+      status = kStatusIoError;
+      break;
+    }
+
+    for (size_t i = 0; i < request->data_count; i++) {
+      const VirtBuffer& data = request->data[i];
+      if (offset > size_ || data.length > size_ - offset ||
+          data.is_write != (request->type == kRequestIn)) {
+        status = kStatusIoError;
+        break;
+      }
+
+      if (request->type == kRequestIn) {
+        CopyToGuestUntracked(ram_, data.address, image_ + offset, data.length);
+        request->written += data.length;
+      } else {
+        CopyFromGuest(ram_, data.address, image_ + offset, data.length);
+      }
+      offset += data.length;
+    }
+    break;
+  case kRequestFlush:
+    if (image_ && !is_read_only_ && !is_private_ &&
+        msync(image_, size_, MS_SYNC) != 0) {
+      status = kStatusIoError;
+    }
+    break;
+  case kRequestGetId:
+    if (request->data_count > 0 && request->data[0].is_write) {
+      uint8 id[kIdSize] = {0};
+      memcpy(id, kId, sizeof(kId));
+      const uint32 length = request->data[0].length < kIdSize ?
+          request->data[0].length : kIdSize;
+      CopyToGuestUntracked(ram_, request->data[0].address, id, length);
+      request->written += length;
+    } else {
+      status = kStatusIoError;
+    }
+    break;
+  default:
+    status = kStatusUnsupported;
+    break;
+  }
+
+  CopyToGuestUntracked(ram_, request->status_address, &status, 1);
+  request->written++;
+}
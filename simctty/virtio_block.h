@@ -0,0 +1,91 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_VIRTIO_BLOCK_H_
+#define SIMCTTY_VIRTIO_BLOCK_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "simctty/types.h"
+#include "simctty/virtio.h"
+
+const static uint32 kMinVirtioBlockAddress = 0x92001000;
+const static uint32 kMaxVirtioBlockAddress =
+    kMinVirtioBlockAddress + VirtioMMIO::kWindowSize - 1;
+
+// Interrupt line, PICSR bit.
+const static uint32 kVirtioBlockIrq = 4;
+
+// virtio-blk disk (vda in Linux) backed by a memory mapped host file.
+//
+// The CPU thread only parses descriptor chains: every notification hands
+// the whole batch of new requests to a host I/O thread, which copies
+// straight between the mapping and guest RAM. Completions are posted to the
+// used ring by Poll(), so the CPU thread never waits on the disk. Without an
+// image the device reports no media.
+class VirtioBlock : public VirtioMMIO {
+ public:
+  explicit VirtioBlock(RAM* ram);
+  ~VirtioBlock();
+
+  // Maps the image at path, read only if it can't be opened for writing.
+  // If is_private, the guest can still write but its writes stay in this
+  // process's copy of the mapping and never reach the image.
+  bool Open(const char* path, bool is_private = false);
+
+  // Post finished requests to the guest. Call between CPU slices.
+  void Poll();
+
+  // Blocks until every submitted request has finished.
+  void Drain();
+
+ protected:
+  virtual uint32 DeviceId() const;
+  virtual uint32 DeviceFeatures(uint32 select) const;
+  virtual uint8 ConfigLoad8(uint32 offset) const;
+  virtual void QueueNotify(size_t queue);
+  virtual void DeviceReset();
+
+ private:
+  const static uint32 kSectorSize = 512;
+
+  struct Request {
+    uint16 head;
+    uint32 type;
+    uint64 sector;
+    VirtBuffer data[VirtQueue::kMaxChainLength];
+    size_t data_count;
+    uint32 status_address;
+    uint32 written;  // Bytes written to the guest, for the used ring.
+  };
+
+  int fd_;
+  uint8* image_;
+  uint64 size_;
+  bool is_read_only_;
+  bool is_private_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable submitted_ready_;
+  std::condition_variable idle_;
+  std::vector<Request> submitted_;
+  std::vector<Request> completed_;
+  size_t in_flight_;
+  bool is_stopping_;
+
+  // Lets Poll() skip the lock when nothing has finished.
+  std::atomic<size_t> completed_count_;
+
+  bool Parse(const VirtBuffer* buffers, size_t count, Request* request) const;
+  void IoThread();
+  void Execute(Request* request);
+
+  DISALLOW_COPY_AND_ASSIGN(VirtioBlock);
+};
+
+#endif  // SIMCTTY_VIRTIO_BLOCK_H_
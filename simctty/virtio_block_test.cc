@@ -0,0 +1,239 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "simctty/bitwise.h"
+#include "simctty/exception.h"
+#include "simctty/ram.h"
+#include "simctty/virtio_block.h"
+
+class VirtioBlockTest : public ::testing::Test {
+ public:
+  VirtioBlockTest()
+    :
+      block_(&ram_),
+      is_private_(false),
+      requests_(0) {
+    strcpy(path_, "/tmp/simctty-block-XXXXXX");
+  }
+
+  virtual void SetUp() {
+    // Four sectors, each byte its offset.
+    const int fd = mkstemp(path_);
+    ASSERT_GE(fd, 0);
+    uint8 image[4 * 512];
+    for (size_t i = 0; i < sizeof(image); i++) {
+      image[i] = i;
+    }
+    ASSERT_EQ(static_cast<ssize_t>(sizeof(image)),
+              write(fd, image, sizeof(image)));
+    close(fd);
+
+    ASSERT_TRUE(block_.Open(path_, is_private_));
+
+    Store(kQueueSel, 0);
+    Store(kQueueNum, 16);
+    Store(kQueueAlign, 4096);
+    Store(kQueuePFN, 0x10);
+    Store(kStatus, 0x7);
+  }
+
+  virtual void TearDown() {
+    unlink(path_);
+  }
+
+  uint32 Load(uint32 reg) {
+    Exception exception;
+    const uint32 value = block_.Load32(kMinVirtioBlockAddress + reg,
+                                       &exception);
+    return B32ENDIANSWAP(value);
+  }
+
+  void Store(uint32 reg, uint32 value) {
+    Exception exception;
+    block_.Store32(kMinVirtioBlockAddress + reg, B32ENDIANSWAP(value),
+                   &exception);
+  }
+
+  void SetDescriptor(uint16 index, uint32 address, uint32 length,
+                     uint16 flags, uint16 next) {
+    Exception exception;
+    const uint32 desc = 0x10000 + 16 * index;
+    ram_.Store32(desc, 0, &exception);
+    ram_.Store32(desc + 4, address, &exception);
+    ram_.Store32(desc + 8, length, &exception);
+    ram_.Store16(desc + 12, flags, &exception);
+    ram_.Store16(desc + 14, next, &exception);
+  }
+
+  // Header, data and status descriptors, then notify.
+  void Submit(uint32 type, uint32 sector, uint32 length) {
+    Prepare(type, sector, length);
+    Store(kQueueNotify, 0);
+  }
+
+  void Prepare(uint32 type, uint32 sector, uint32 length) {
+    Exception exception;
+    ram_.Store32(kHeader, type, &exception);
+    ram_.Store32(kHeader + 4, 0, &exception);
+    ram_.Store32(kHeader + 8, 0, &exception);
+    ram_.Store32(kHeader + 12, sector, &exception);
+    ram_.Store8(kStatusByte, 0xff, &exception);
+
+    const uint16 data_flags = type == 0 ? 0x3 : 0x1;
+    SetDescriptor(0, kHeader, 16, 0x1, 1);
+    SetDescriptor(1, kData, length, data_flags, 2);
+    SetDescriptor(2, kStatusByte, 1, 0x2, 0);
+
+    const uint32 avail = 0x10000 + 16 * 16;
+    ram_.Store16(avail + 4 + 2 * (requests_ % 16), 0, &exception);
+    requests_++;
+    ram_.Store16(avail + 2, requests_, &exception);
+  }
+
+  // Waits for the I/O thread, then posts its completions.
+  void Complete() {
+    block_.Drain();
+    block_.Poll();
+  }
+
+  uint16 UsedIndex() {
+    Exception exception;
+    return ram_.Load16(0x11000 + 2, &exception);
+  }
+
+  uint8 Status() {
+    Exception exception;
+    return ram_.Load8(kStatusByte, &exception);
+  }
+
+  RAM ram_;
+  VirtioBlock block_;
+  char path_[32];
+  bool is_private_;
+  uint16 requests_;
+
+  const static uint32 kQueueSel = 0x030;
+  const static uint32 kQueueNum = 0x038;
+  const static uint32 kQueueAlign = 0x03c;
+  const static uint32 kQueuePFN = 0x040;
+  const static uint32 kQueueNotify = 0x050;
+  const static uint32 kStatus = 0x070;
+
+  const static uint32 kHeader = 0x30000;
+  const static uint32 kData = 0x31000;
+  const static uint32 kStatusByte = 0x32000;
+};
+
+TEST_F(VirtioBlockTest, Identify) {
+  ASSERT_EQ(2u, Load(0x008));
+
+  // Capacity in sectors, the first config field.
+  Exception exception;
+  ASSERT_EQ(0, block_.Load8(kMinVirtioBlockAddress + 0x100, &exception));
+  ASSERT_EQ(4, block_.Load8(kMinVirtioBlockAddress + 0x107, &exception));
+}
+
+TEST_F(VirtioBlockTest, Read) {
+  Submit(0, 1, 512);
+  Complete();
+
+  ASSERT_EQ(1, UsedIndex());
+  ASSERT_EQ(0, Status());
+  ASSERT_TRUE(block_.IsInterruptAsserted());
+
+  uint8 data[512];
+  CopyFromGuest(&ram_, kData, data, sizeof(data));
+  for (size_t i = 0; i < sizeof(data); i++) {
+    ASSERT_EQ(static_cast<uint8>(512 + i), data[i]);
+  }
+}
+
+#ifdef SIMCTTY_WASM_BLOCKS
+// The I/O thread leaves compiled code alone, the completion drops it.
+TEST_F(VirtioBlockTest, ReadInvalidatesCodeOnPoll) {
+  // Marked after the header, on the same page, is written.
+  Prepare(0, 1, 512);
+  ram_.SetIsCodePage(kData);
+  const uint32 generation = ram_.CodeGeneration(kData);
+  Store(kQueueNotify, 0);
+  block_.Drain();
+  ASSERT_EQ(generation, ram_.CodeGeneration(kData));
+
+  block_.Poll();
+  ASSERT_EQ(1, UsedIndex());
+  ASSERT_NE(generation, ram_.CodeGeneration(kData));
+}
+#endif
+
+TEST_F(VirtioBlockTest, WriteAndFlush) {
+  uint8 data[512];
+  memset(data, 0xab, sizeof(data));
+  CopyToGuest(&ram_, kData, data, sizeof(data));
+
+  Submit(1, 2, 512);
+  Complete();
+  ASSERT_EQ(0, Status());
+
+  Submit(4, 0, 0);
+  Complete();
+  ASSERT_EQ(2, UsedIndex());
+  ASSERT_EQ(0, Status());
+
+  const int fd = open(path_, O_RDONLY);
+  uint8 sector[512];
+  ASSERT_EQ(512, pread(fd, sector, sizeof(sector), 2 * 512));
+  close(fd);
+  ASSERT_EQ(0, memcmp(data, sector, sizeof(sector)));
+}
+
+class VirtioBlockPrivateTest : public VirtioBlockTest {
+ public:
+  VirtioBlockPrivateTest() {
+    is_private_ = true;
+  }
+};
+
+TEST_F(VirtioBlockPrivateTest, WritesStayOffTheImage) {
+  ASSERT_EQ(0U, Load(0x010) & 0x20);  // Not read only.
+
+  uint8 data[512];
+  memset(data, 0xab, sizeof(data));
+  CopyToGuest(&ram_, kData, data, sizeof(data));
+  Submit(1, 2, 512);
+  Complete();
+  ASSERT_EQ(0, Status());
+  Submit(4, 0, 0);
+  Complete();
+  ASSERT_EQ(0, Status());
+
+  // The guest reads back what it wrote.
+  memset(data, 0, sizeof(data));
+  CopyToGuest(&ram_, kData, data, sizeof(data));
+  Submit(0, 2, 512);
+  Complete();
+  CopyFromGuest(&ram_, kData, data, sizeof(data));
+  ASSERT_EQ(0xab, data[0]);
+  ASSERT_EQ(0xab, data[511]);
+
+  const int fd = open(path_, O_RDONLY);
+  uint8 sector[512];
+  ASSERT_EQ(512, pread(fd, sector, sizeof(sector), 2 * 512));
+  close(fd);
+  ASSERT_EQ(0, sector[0]);
+  ASSERT_EQ(255, sector[511]);
+}
+
+TEST_F(VirtioBlockTest, OutOfRange) {
+  Submit(0, 4, 512);
+  Complete();
+
+  ASSERT_EQ(1, UsedIndex());
+  ASSERT_EQ(1, Status());
+}
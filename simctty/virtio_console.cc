@@ -0,0 +1,147 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/virtio_console.h"
+
+namespace {
+
+const uint32 kConsoleDeviceId = 3;
+
+}  // namespace
+
+VirtioConsole::VirtioConsole(RAM* ram)
+  :
+    VirtioMMIO(ram, kMinVirtioConsoleAddress, 2),
+    input_(kInputSize),
+    output_(kOutputSize) {
+}
+
+VirtioConsole::~VirtioConsole() {
+}
+
+void VirtioConsole::Poll() {
+  if (!input_.IsEmpty()) {
+    Receive();
+  }
+  Transmit();
+}
+
+size_t VirtioConsole::WriteBuffer(const uint8* data, size_t length) {
+  return input_.Write(data, length);
+}
+
+size_t VirtioConsole::WriteBufferFree() const {
+  return input_.Free();
+}
+
+size_t VirtioConsole::ReadBuffer(uint8* data, size_t length) {
+  return output_.Read(data, length);
+}
+
+bool VirtioConsole::CanRead() const {
+  return !output_.IsEmpty();
+}
+
+uint32 VirtioConsole::DeviceId() const {
+  return kConsoleDeviceId;
+}
+
+void VirtioConsole::QueueNotify(size_t queue) {
+  if (queue == kReceiveQueue) {
+    Receive();
+  } else if (queue == kTransmitQueue) {
+    Transmit();
+  }
+}
+
+void VirtioConsole::DeviceReset() {
+  input_.Clear();
+}
+
+void VirtioConsole::Receive() {
+  VirtQueue* queue = &queues_[kReceiveQueue];
+  VirtBuffer buffers[VirtQueue::kMaxChainLength];
+  uint8 data[256];
+  bool is_used = false;
+
+  uint16 head;
+  size_t count;
+  while (!input_.IsEmpty() && queue->Pop(ram_, &head, buffers, &count)) {
+    uint32 written = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (!buffers[i].is_write) {
+        continue;
+      }
+
+      uint32 address = buffers[i].address;
+      uint32 remaining = buffers[i].length;
+      while (remaining > 0) {
+        const size_t length = input_.Read(
+            data, remaining < sizeof(data) ? remaining : sizeof(data));
+        if (length == 0) {
+          break;
+        }
+        CopyToGuest(ram_, address, data, length);
+        address += length;
+        remaining -= length;
+        written += length;
+      }
+    }
+
+    queue->Push(ram_, head, written);
+    is_used = true;
+  }
+
+  if (is_used) {
+    NotifyUsed(kReceiveQueue);
+  }
+}
+
+void VirtioConsole::Transmit() {
+  VirtQueue* queue = &queues_[kTransmitQueue];
+  VirtBuffer buffers[VirtQueue::kMaxChainLength];
+  uint8 data[256];
+  bool is_used = false;
+
+  uint16 head;
+  size_t count;
+  while (queue->Pop(ram_, &head, buffers, &count)) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (!buffers[i].is_write) {
+        total += buffers[i].length;
+      }
+    }
+
+    // Leave it for a later Poll() rather than drop output. A chain bigger
+    // than the whole host buffer could never fit and is truncated instead.
+    if (total > output_.Free() && total <= output_.Capacity()) {
+      queue->Unpop();
+      break;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      if (buffers[i].is_write) {
+        continue;
+      }
+
+      uint32 address = buffers[i].address;
+      uint32 remaining = buffers[i].length;
+      while (remaining > 0) {
+        const size_t length =
+            remaining < sizeof(data) ? remaining : sizeof(data);
+        CopyFromGuest(ram_, address, data, length);
+        output_.Write(data, length);
+        address += length;
+        remaining -= length;
+      }
+    }
+
+    queue->Push(ram_, head, 0);
+    is_used = true;
+  }
+
+  if (is_used) {
+    NotifyUsed(kTransmitQueue);
+  }
+}
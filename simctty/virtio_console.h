@@ -0,0 +1,60 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_VIRTIO_CONSOLE_H_
+#define SIMCTTY_VIRTIO_CONSOLE_H_
+
+#include "simctty/ring_buffer.h"
+#include "simctty/serial_port.h"
+#include "simctty/types.h"
+#include "simctty/virtio.h"
+
+const static uint32 kMinVirtioConsoleAddress = 0x92000000;
+const static uint32 kMaxVirtioConsoleAddress =
+    kMinVirtioConsoleAddress + VirtioMMIO::kWindowSize - 1;
+
+// Interrupt line, PICSR bit.
+const static uint32 kVirtioConsoleIrq = 3;
+
+// Single port virtio console (hvc0 in Linux).
+//
+// Whole buffers move per notification instead of a byte per register
+// access, so output costs one exit per write() in the guest rather than one
+// per character. Host input is delivered by Poll(), on the CPU thread.
+class VirtioConsole : public VirtioMMIO, public SerialPort {
+ public:
+  explicit VirtioConsole(RAM* ram);
+  ~VirtioConsole();
+
+  // Hand pending host input to the guest, and retry output held off by a
+  // full host buffer. Call between CPU slices.
+  void Poll();
+
+  // Host side of the console.
+  virtual size_t WriteBuffer(const uint8* data, size_t length);
+  virtual size_t WriteBufferFree() const;
+  virtual size_t ReadBuffer(uint8* data, size_t length);
+  virtual bool CanRead() const;
+
+ protected:
+  virtual uint32 DeviceId() const;
+  virtual void QueueNotify(size_t queue);
+  virtual void DeviceReset();
+
+ private:
+  const static size_t kReceiveQueue = 0;
+  const static size_t kTransmitQueue = 1;
+
+  const static size_t kInputSize = 4096;
+  const static size_t kOutputSize = 65536;
+
+  RingBuffer input_;
+  RingBuffer output_;
+
+  void Receive();
+  void Transmit();
+
+  DISALLOW_COPY_AND_ASSIGN(VirtioConsole);
+};
+
+#endif  // SIMCTTY_VIRTIO_CONSOLE_H_
@@ -0,0 +1,150 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include "simctty/bitwise.h"
+#include "simctty/exception.h"
+#include "simctty/ram.h"
+#include "simctty/virtio_console.h"
+
+class VirtioConsoleTest : public ::testing::Test {
+ public:
+  VirtioConsoleTest()
+    :
+      console_(&ram_) {
+  }
+
+  // As the guest's readl()/writel() see them, little endian.
+  uint32 Load(uint32 reg) {
+    Exception exception;
+    const uint32 value = console_.Load32(kMinVirtioConsoleAddress + reg,
+                                         &exception);
+    return B32ENDIANSWAP(value);
+  }
+
+  void Store(uint32 reg, uint32 value) {
+    Exception exception;
+    console_.Store32(kMinVirtioConsoleAddress + reg, B32ENDIANSWAP(value),
+                     &exception);
+  }
+
+  // Queue of 16 entries at page pfn, the layout Linux sets up.
+  void SetUpQueue(uint32 queue, uint32 pfn) {
+    Store(kQueueSel, queue);
+    Store(kQueueNum, kQueueSize);
+    Store(kQueueAlign, 4096);
+    Store(kQueuePFN, pfn);
+  }
+
+  // Makes buffer available as a single descriptor chain.
+  void AddBuffer(uint32 pfn, uint16 index, uint32 address, uint32 length,
+                 bool is_write) {
+    Exception exception;
+    const uint32 desc = pfn * 4096 + 16 * index;
+    ram_.Store32(desc, 0, &exception);
+    ram_.Store32(desc + 4, address, &exception);
+    ram_.Store32(desc + 8, length, &exception);
+    ram_.Store16(desc + 12, is_write ? 2 : 0, &exception);
+    ram_.Store16(desc + 14, 0, &exception);
+
+    const uint32 avail = pfn * 4096 + 16 * kQueueSize;
+    const uint16 idx = ram_.Load16(avail + 2, &exception);
+    ram_.Store16(avail + 4 + 2 * (idx % kQueueSize), index, &exception);
+    ram_.Store16(avail + 2, idx + 1, &exception);
+  }
+
+  uint16 UsedIndex(uint32 pfn) {
+    Exception exception;
+    return ram_.Load16(pfn * 4096 + 4096 + 2, &exception);
+  }
+
+  uint32 UsedLength(uint32 pfn, uint16 slot) {
+    Exception exception;
+    return ram_.Load32(pfn * 4096 + 4096 + 4 + 8 * slot + 4, &exception);
+  }
+
+  RAM ram_;
+  VirtioConsole console_;
+
+  const static uint32 kQueueSize = 16;
+
+  const static uint32 kMagicValue = 0x000;
+  const static uint32 kVersion = 0x004;
+  const static uint32 kDeviceId = 0x008;
+  const static uint32 kQueueSel = 0x030;
+  const static uint32 kQueueNumMax = 0x034;
+  const static uint32 kQueueNum = 0x038;
+  const static uint32 kQueueAlign = 0x03c;
+  const static uint32 kQueuePFN = 0x040;
+  const static uint32 kQueueNotify = 0x050;
+  const static uint32 kInterruptStatus = 0x060;
+  const static uint32 kInterruptACK = 0x064;
+  const static uint32 kStatus = 0x070;
+
+  const static uint32 kReceivePFN = 0x10;
+  const static uint32 kTransmitPFN = 0x20;
+};
+
+TEST_F(VirtioConsoleTest, Identify) {
+  ASSERT_EQ(0x74726976u, Load(kMagicValue));
+  ASSERT_EQ(1u, Load(kVersion));
+  ASSERT_EQ(3u, Load(kDeviceId));
+
+  Store(kQueueSel, 1);
+  ASSERT_EQ(256u, Load(kQueueNumMax));
+  Store(kQueueSel, 2);
+  ASSERT_EQ(0u, Load(kQueueNumMax));
+}
+
+TEST_F(VirtioConsoleTest, Transmit) {
+  SetUpQueue(1, kTransmitPFN);
+  Store(kStatus, 0x7);
+
+  const uint8 message[] = "hello";
+  CopyToGuest(&ram_, 0x30000, message, 5);
+  AddBuffer(kTransmitPFN, 0, 0x30000, 5, false);
+  ASSERT_FALSE(console_.CanRead());
+
+  Store(kQueueNotify, 1);
+  ASSERT_EQ(1, UsedIndex(kTransmitPFN));
+  ASSERT_TRUE(console_.IsInterruptAsserted());
+
+  uint8 buffer[16];
+  ASSERT_EQ(5u, console_.ReadBuffer(buffer, sizeof(buffer)));
+  ASSERT_EQ(0, memcmp(buffer, message, 5));
+
+  Store(kInterruptACK, Load(kInterruptStatus));
+  ASSERT_FALSE(console_.IsInterruptAsserted());
+}
+
+TEST_F(VirtioConsoleTest, Receive) {
+  SetUpQueue(0, kReceivePFN);
+  Store(kStatus, 0x7);
+
+  AddBuffer(kReceivePFN, 0, 0x40000, 16, true);
+  Store(kQueueNotify, 0);
+  ASSERT_EQ(0, UsedIndex(kReceivePFN));
+
+  const uint8 keys[] = "abc";
+  ASSERT_EQ(3u, console_.WriteBuffer(keys, 3));
+  console_.Poll();
+
+  ASSERT_EQ(1, UsedIndex(kReceivePFN));
+  ASSERT_EQ(3u, UsedLength(kReceivePFN, 0));
+  ASSERT_TRUE(console_.IsInterruptAsserted());
+
+  uint8 buffer[3];
+  CopyFromGuest(&ram_, 0x40000, buffer, 3);
+  ASSERT_EQ(0, memcmp(buffer, keys, 3));
+}
+
+TEST_F(VirtioConsoleTest, Reset) {
+  SetUpQueue(0, kReceivePFN);
+  ASSERT_EQ(0x10u, Load(kQueuePFN));
+
+  Store(kStatus, 0);
+  ASSERT_EQ(0u, Load(kQueuePFN));
+}
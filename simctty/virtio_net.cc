@@ -0,0 +1,171 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "simctty/virtio_net.h"
+
+#include <string.h>
+
+namespace {
+
+const uint32 kNetDeviceId = 1;
+
+// Feature bits.
+const uint32 kFeatureMac = 1 << 5;
+
+// Locally administered, QEMU's prefix.
+const uint8 kDefaultMac[6] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+
+// Copies data to offset bytes into the device writable part of a chain.
+void ScatterToGuest(RAM* ram, const VirtBuffer* buffers, size_t count,
+                    size_t offset, const uint8* data, size_t length) {
+  for (size_t i = 0; i < count && length > 0; i++) {
+    if (!buffers[i].is_write) {
+      continue;
+    } else if (offset >= buffers[i].length) {
+      offset -= buffers[i].length;
+      continue;
+    }
+
+    size_t chunk = buffers[i].length - offset;
+    if (chunk > length) {
+      chunk = length;
+    }
+    CopyToGuest(ram, buffers[i].address + offset, data, chunk);
+    data += chunk;
+    length -= chunk;
+    offset = 0;
+  }
+}
+
+}  // namespace
+
+VirtioNet::VirtioNet(RAM* ram)
+  :
+    VirtioMMIO(ram, kMinVirtioNetAddress, 2),
+    is_receive_used_(false),
+    is_transmit_used_(false),
+    interrupt_count_(0) {
+  memcpy(mac_, kDefaultMac, sizeof(mac_));
+}
+
+VirtioNet::~VirtioNet() {
+}
+
+void VirtioNet::SetBackend(NetBackend* backend) {
+  backend_.reset(backend);
+}
+
+void VirtioNet::SetMacAddress(const uint8* mac) {
+  memcpy(mac_, mac, sizeof(mac_));
+}
+
+void VirtioNet::Poll() {
+  if (backend_) {
+    Receive();
+  }
+
+  if (is_receive_used_ && NotifyUsed(kReceiveQueue)) {
+    interrupt_count_++;
+  }
+  if (is_transmit_used_ && NotifyUsed(kTransmitQueue)) {
+    interrupt_count_++;
+  }
+  is_receive_used_ = false;
+  is_transmit_used_ = false;
+}
+
+uint64 VirtioNet::InterruptCount() const {
+  return interrupt_count_;
+}
+
+uint32 VirtioNet::DeviceId() const {
+  return kNetDeviceId;
+}
+
+uint32 VirtioNet::DeviceFeatures(uint32 select) const {
+  return select == 0 ? kFeatureMac : 0;
+}
+
+uint8 VirtioNet::ConfigLoad8(uint32 offset) const {
+  return offset < sizeof(mac_) ? mac_[offset] : 0;
+}
+
+void VirtioNet::QueueNotify(size_t queue) {
+  // New receive buffers are picked up by the next Poll().
+  if (queue == kTransmitQueue) {
+    Transmit();
+  }
+}
+
+void VirtioNet::Receive() {
+  VirtQueue* queue = &queues_[kReceiveQueue];
+  VirtBuffer buffers[VirtQueue::kMaxChainLength];
+  uint8 header[kHeaderSize] = {0};
+
+  uint16 head;
+  size_t count;
+  while (queue->Pop(ram_, &head, buffers, &count)) {
+    size_t capacity = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (buffers[i].is_write) {
+        capacity += buffers[i].length;
+      }
+    }
+
+    const size_t length = backend_->Receive(frame_, sizeof(frame_));
+    if (length == 0 || kHeaderSize + length > capacity) {
+      // Nothing waiting, or a frame this chain can't hold which is dropped.
+      // Either way the chain is still free.
+      queue->Unpop();
+      if (length == 0) {
+        break;
+      }
+      continue;
+    }
+
+    // Header then frame, across however the guest split its buffers.
+    ScatterToGuest(ram_, buffers, count, 0, header, kHeaderSize);
+    ScatterToGuest(ram_, buffers, count, kHeaderSize, frame_, length);
+
+    queue->Push(ram_, head, kHeaderSize + length);
+    is_receive_used_ = true;
+  }
+}
+
+void VirtioNet::Transmit() {
+  VirtQueue* queue = &queues_[kTransmitQueue];
+  VirtBuffer buffers[VirtQueue::kMaxChainLength];
+
+  uint16 head;
+  size_t count;
+  while (queue->Pop(ram_, &head, buffers, &count)) {
+    // Skip the header, gather the frame.
+    uint32 skip = kHeaderSize;
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (buffers[i].is_write) {
+        continue;
+      }
+
+      uint32 address = buffers[i].address;
+      uint32 size = buffers[i].length;
+      const uint32 skipped = size < skip ? size : skip;
+      address += skipped;
+      size -= skipped;
+      skip -= skipped;
+
+      if (size > sizeof(frame_) - length) {
+        size = sizeof(frame_) - length;
+      }
+      CopyFromGuest(ram_, address, frame_ + length, size);
+      length += size;
+    }
+
+    if (backend_ && length > 0) {
+      backend_->Send(frame_, length);
+    }
+
+    queue->Push(ram_, head, 0);
+    is_transmit_used_ = true;
+  }
+}
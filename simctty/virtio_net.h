@@ -0,0 +1,76 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#ifndef SIMCTTY_VIRTIO_NET_H_
+#define SIMCTTY_VIRTIO_NET_H_
+
+#include <memory>
+
+#include "simctty/net_backend.h"
+#include "simctty/types.h"
+#include "simctty/virtio.h"
+
+const static uint32 kMinVirtioNetAddress = 0x92002000;
+const static uint32 kMaxVirtioNetAddress =
+    kMinVirtioNetAddress + VirtioMMIO::kWindowSize - 1;
+
+// Interrupt line, PICSR bit.
+const static uint32 kVirtioNetIrq = 5;
+
+// virtio-net interface (eth0 in Linux) on a pluggable NetBackend.
+//
+// A sent frame is gathered from its descriptors into one buffer, undoing the
+// RAM swizzle, and handed to the backend as is. A received frame is copied
+// out of the backend's queue into a buffer and scattered from there into the
+// receive descriptors.
+//
+// Interrupts are mitigated: the device posts used buffers as it goes but
+// raises at most one interrupt per queue per CPU slice, in Poll(), on top of
+// the guest's own suppression while it polls (NAPI).
+class VirtioNet : public VirtioMMIO {
+ public:
+  explicit VirtioNet(RAM* ram);
+  ~VirtioNet();
+
+  // Takes ownership of backend. Without one, sent frames are dropped.
+  void SetBackend(NetBackend* backend);
+
+  void SetMacAddress(const uint8* mac);
+
+  // Receive frames from the backend and raise interrupts for the buffers
+  // used since the last call. Call between CPU slices.
+  void Poll();
+
+  uint64 InterruptCount() const;
+
+ protected:
+  virtual uint32 DeviceId() const;
+  virtual uint32 DeviceFeatures(uint32 select) const;
+  virtual uint8 ConfigLoad8(uint32 offset) const;
+  virtual void QueueNotify(size_t queue);
+
+ private:
+  const static size_t kReceiveQueue = 0;
+  const static size_t kTransmitQueue = 1;
+
+  // virtio_net_hdr ahead of every frame, without mergeable buffers.
+  const static uint32 kHeaderSize = 10;
+
+  const static size_t kMaxFrameSize = 65536;
+
+  std::unique_ptr<NetBackend> backend_;
+  uint8 mac_[6];
+
+  bool is_receive_used_;
+  bool is_transmit_used_;
+  uint64 interrupt_count_;
+
+  uint8 frame_[kMaxFrameSize];
+
+  void Receive();
+  void Transmit();
+
+  DISALLOW_COPY_AND_ASSIGN(VirtioNet);
+};
+
+#endif  // SIMCTTY_VIRTIO_NET_H_
@@ -0,0 +1,173 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include <deque>
+#include <vector>
+
+#include "simctty/bitwise.h"
+#include "simctty/exception.h"
+#include "simctty/ram.h"
+#include "simctty/virtio_net.h"
+
+using std::deque;
+using std::vector;
+
+namespace {
+
+// Records sent frames, hands out queued ones.
+class TestBackend : public NetBackend {
+ public:
+  virtual void Send(const uint8* frame, size_t length) {
+    sent.push_back(vector<uint8>(frame, frame + length));
+  }
+
+  virtual size_t Receive(uint8* frame, size_t size) {
+    if (pending.empty()) {
+      return 0;
+    }
+    const size_t length = pending.front().size();
+    memcpy(frame, pending.front().data(), length);
+    pending.pop_front();
+    return length;
+  }
+
+  vector<vector<uint8> > sent;
+  deque<vector<uint8> > pending;
+};
+
+}  // namespace
+
+class VirtioNetTest : public ::testing::Test {
+ public:
+  VirtioNetTest()
+    :
+      net_(&ram_),
+      backend_(new TestBackend()) {
+    net_.SetBackend(backend_);
+  }
+
+  void Store(uint32 reg, uint32 value) {
+    Exception exception;
+    net_.Store32(kMinVirtioNetAddress + reg, B32ENDIANSWAP(value),
+                 &exception);
+  }
+
+  void SetUpQueue(uint32 queue, uint32 pfn) {
+    Store(kQueueSel, queue);
+    Store(kQueueNum, 16);
+    Store(kQueueAlign, 4096);
+    Store(kQueuePFN, pfn);
+  }
+
+  void SetDescriptor(uint32 pfn, uint16 index, uint32 address,
+                     uint32 length, uint16 flags, uint16 next) {
+    Exception exception;
+    const uint32 desc = pfn * 4096 + 16 * index;
+    ram_.Store32(desc, 0, &exception);
+    ram_.Store32(desc + 4, address, &exception);
+    ram_.Store32(desc + 8, length, &exception);
+    ram_.Store16(desc + 12, flags, &exception);
+    ram_.Store16(desc + 14, next, &exception);
+  }
+
+  void MakeAvailable(uint32 pfn, uint16 head) {
+    Exception exception;
+    const uint32 avail = pfn * 4096 + 16 * 16;
+    const uint16 idx = ram_.Load16(avail + 2, &exception);
+    ram_.Store16(avail + 4 + 2 * (idx % 16), head, &exception);
+    ram_.Store16(avail + 2, idx + 1, &exception);
+  }
+
+  uint16 UsedIndex(uint32 pfn) {
+    Exception exception;
+    return ram_.Load16(pfn * 4096 + 4096 + 2, &exception);
+  }
+
+  // Header and data as separate descriptors, as Linux posts them.
+  void PostReceiveBuffer(uint16 index, uint32 address) {
+    SetDescriptor(kReceivePFN, index, address, 10, 0x3, index + 1);
+    SetDescriptor(kReceivePFN, index + 1, address + 16, 1514, 0x2, 0);
+    MakeAvailable(kReceivePFN, index);
+  }
+
+  RAM ram_;
+  VirtioNet net_;
+  TestBackend* backend_;  // Owned by net_.
+
+  const static uint32 kQueueSel = 0x030;
+  const static uint32 kQueueNum = 0x038;
+  const static uint32 kQueueAlign = 0x03c;
+  const static uint32 kQueuePFN = 0x040;
+  const static uint32 kQueueNotify = 0x050;
+
+  const static uint32 kReceivePFN = 0x10;
+  const static uint32 kTransmitPFN = 0x20;
+};
+
+TEST_F(VirtioNetTest, Transmit) {
+  SetUpQueue(1, kTransmitPFN);
+
+  // Header and frame in one buffer.
+  uint8 packet[10 + 60];
+  memset(packet, 0, 10);
+  for (size_t i = 10; i < sizeof(packet); i++) {
+    packet[i] = i;
+  }
+  CopyToGuest(&ram_, 0x30000, packet, sizeof(packet));
+  SetDescriptor(kTransmitPFN, 0, 0x30000, sizeof(packet), 0, 0);
+  MakeAvailable(kTransmitPFN, 0);
+
+  Store(kQueueNotify, 1);
+  ASSERT_EQ(1u, backend_->sent.size());
+  ASSERT_EQ(60u, backend_->sent[0].size());
+  ASSERT_EQ(0, memcmp(packet + 10, backend_->sent[0].data(), 60));
+  ASSERT_EQ(1, UsedIndex(kTransmitPFN));
+
+  // The interrupt waits for the end of the slice.
+  ASSERT_FALSE(net_.IsInterruptAsserted());
+  net_.Poll();
+  ASSERT_TRUE(net_.IsInterruptAsserted());
+}
+
+TEST_F(VirtioNetTest, ReceiveOneInterruptPerSlice) {
+  SetUpQueue(0, kReceivePFN);
+  for (uint16 i = 0; i < 4; i++) {
+    PostReceiveBuffer(2 * i, 0x40000 + 0x1000 * i);
+  }
+
+  for (uint8 i = 0; i < 3; i++) {
+    backend_->pending.push_back(vector<uint8>(60, i));
+  }
+
+  net_.Poll();
+  ASSERT_EQ(3, UsedIndex(kReceivePFN));
+  ASSERT_EQ(1u, net_.InterruptCount());
+
+  // Frame data follows the header, in the second buffer.
+  uint8 data[60];
+  CopyFromGuest(&ram_, 0x42000 + 16, data, sizeof(data));
+  ASSERT_EQ(vector<uint8>(60, 2), vector<uint8>(data, data + sizeof(data)));
+
+  // Nothing new, no interrupt.
+  net_.Poll();
+  ASSERT_EQ(1u, net_.InterruptCount());
+}
+
+TEST_F(VirtioNetTest, ReceiveSuppressed) {
+  SetUpQueue(0, kReceivePFN);
+  PostReceiveBuffer(0, 0x40000);
+
+  // Guest is polling (NAPI), no interrupts wanted.
+  Exception exception;
+  ram_.Store16(kReceivePFN * 4096 + 16 * 16, 1, &exception);
+
+  backend_->pending.push_back(vector<uint8>(60, 0));
+  net_.Poll();
+  ASSERT_EQ(1, UsedIndex(kReceivePFN));
+  ASSERT_EQ(0u, net_.InterruptCount());
+  ASSERT_FALSE(net_.IsInterruptAsserted());
+}
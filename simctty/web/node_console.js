@@ -0,0 +1,72 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+// Runs the web build from a terminal, through the same worker and shared
+// rings as the page:
+//
+//   node simctty/node_console.js simctty/simctty.js ../linux/vmlinux.bin
+'use strict';
+
+var fs = require('fs');
+var path = require('path');
+var Worker = require('worker_threads').Worker;
+var SharedRing = require('./shared_ring.js');
+
+var kRingSize = 65536;
+var kPollMs = 10;
+
+if (process.argv.length !== 4) {
+  process.stderr.write('usage: node node_console.js simctty.js image\n');
+  process.exit(1);
+}
+
+var image = fs.readFileSync(process.argv[3]);
+var input = SharedRing.Create(kRingSize);
+var output = SharedRing.Create(kRingSize);
+
+var worker = new Worker(path.join(__dirname, 'simctty_worker.js'));
+worker.postMessage({
+  module: path.resolve(process.argv[2]),
+  image: image.buffer.slice(image.byteOffset,
+                            image.byteOffset + image.length),
+  input: input.buffer,
+  output: output.buffer,
+  paced: true
+});
+
+// Keys typed while the ring is full wait here.
+var queued = Buffer.alloc(0);
+
+function WriteInput() {
+  var written = input.Write(queued);
+  queued = queued.subarray(written);
+}
+
+if (process.stdin.isTTY) {
+  process.stdin.setRawMode(true);
+}
+process.stdin.on('data', function(data) {
+  queued = Buffer.concat([queued, data]);
+  WriteInput();
+});
+
+var chunk = new Uint8Array(kRingSize);
+function DrainOutput() {
+  var length = output.Read(chunk);
+  if (length > 0) {
+    process.stdout.write(Buffer.from(chunk.subarray(0, length)));
+  }
+}
+
+var poll = setInterval(function() {
+  WriteInput();
+  DrainOutput();
+}, kPollMs);
+
+worker.on('message', function(message) {
+  if (message.halted) {
+    DrainOutput();
+    clearInterval(poll);
+    process.exit(0);
+  }
+});
@@ -0,0 +1,88 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+// Fixed capacity byte FIFO in a SharedArrayBuffer, the JavaScript twin of
+// RingBuffer. Safe for one producer and one consumer, each on its own thread
+// (the page and the emulator's worker), without locking. The capacity must
+// be a power of two.
+//
+// The buffer starts with two free running indices, only the low bits of which
+// address the data: head (next write, owned by the producer) and tail (next
+// read, owned by the consumer). A worker side consumer can sleep on head with
+// Wait() until the producer writes.
+'use strict';
+
+var kHead = 0;
+var kTail = 1;
+var kHeaderSize = 8;
+
+function SharedRing(buffer) {
+  this.buffer = buffer;
+  this.index_ = new Int32Array(buffer, 0, 2);
+  this.data_ = new Uint8Array(buffer, kHeaderSize);
+  this.mask_ = this.data_.length - 1;
+}
+
+SharedRing.Create = function(capacity) {
+  if (capacity & (capacity - 1)) {
+    throw new Error('SharedRing capacity must be a power of two');
+  }
+  return new SharedRing(new SharedArrayBuffer(kHeaderSize + capacity));
+};
+
+SharedRing.prototype.Size = function() {
+  return (Atomics.load(this.index_, kHead) -
+          Atomics.load(this.index_, kTail)) >>> 0;
+};
+
+SharedRing.prototype.Free = function() {
+  return this.data_.length - this.Size();
+};
+
+SharedRing.prototype.IsEmpty = function() {
+  return this.Size() === 0;
+};
+
+// Producer side. Returns the number of bytes accepted.
+SharedRing.prototype.Write = function(bytes) {
+  var head = Atomics.load(this.index_, kHead);
+  var tail = Atomics.load(this.index_, kTail);
+  var length = Math.min(bytes.length,
+                        this.data_.length - ((head - tail) >>> 0));
+  for (var i = 0; i < length; i++) {
+    this.data_[(head + i) & this.mask_] = bytes[i];
+  }
+  if (length > 0) {
+    Atomics.store(this.index_, kHead, (head + length) | 0);
+    Atomics.notify(this.index_, kHead);
+  }
+  return length;
+};
+
+// Consumer side. Reads up to bytes.length bytes into bytes, returns the
+// number read.
+SharedRing.prototype.Read = function(bytes) {
+  var head = Atomics.load(this.index_, kHead);
+  var tail = Atomics.load(this.index_, kTail);
+  var length = Math.min(bytes.length, (head - tail) >>> 0);
+  for (var i = 0; i < length; i++) {
+    bytes[i] = this.data_[(tail + i) & this.mask_];
+  }
+  if (length > 0) {
+    Atomics.store(this.index_, kTail, (tail + length) | 0);
+  }
+  return length;
+};
+
+// Consumer side, workers only (the page's thread may not block). Sleeps for
+// up to timeout_ms or until the producer writes.
+SharedRing.prototype.Wait = function(timeout_ms) {
+  var head = Atomics.load(this.index_, kHead);
+  if (head === Atomics.load(this.index_, kTail)) {
+    Atomics.wait(this.index_, kHead, head, timeout_ms);
+  }
+};
+
+if (typeof module !== 'undefined') {
+  module.exports = SharedRing;
+}
@@ -0,0 +1,97 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+// Page side of the web build: starts simctty_worker.js and carries console
+// bytes to and from it through two SharedRings (shared_ring.js, loaded
+// first). SharedArrayBuffer needs the page to be cross-origin isolated
+// (served with Cross-Origin-Opener-Policy: same-origin and
+// Cross-Origin-Embedder-Policy: require-corp).
+//
+//   var simctty = new SimcttyConsole({
+//     worker: 'simctty_worker.js', module: 'simctty.js', image: 'vmlinux.bin',
+//     output: function(bytes) { ... }, halted: function() { ... }
+//   });
+//   simctty.Start();
+//   simctty.Write(bytes);  // Keys, a Uint8Array.
+'use strict';
+
+var kRingSize = 65536;
+
+function SimcttyConsole(options) {
+  this.options_ = options;
+  this.input_ = SharedRing.Create(kRingSize);
+  this.output_ = SharedRing.Create(kRingSize);
+  this.worker_ = null;
+  this.queued_ = new Uint8Array(0);  // Keys the input ring had no room for.
+  this.chunk_ = new Uint8Array(kRingSize);
+  this.frame_ = 0;
+}
+
+// Fetches the image and boots it in a new worker.
+SimcttyConsole.prototype.Start = function() {
+  var self = this;
+  return fetch(this.options_.image).then(function(response) {
+    if (!response.ok) {
+      throw new Error('Unable to load image ' + self.options_.image);
+    }
+    return response.arrayBuffer();
+  }).then(function(image) {
+    self.worker_ = new Worker(self.options_.worker);
+    self.worker_.onmessage = function(event) {
+      if (event.data.halted) {
+        self.Stop();
+        if (self.options_.halted) {
+          self.options_.halted();
+        }
+      }
+    };
+    self.worker_.postMessage({
+      module: self.options_.module,
+      image: image,
+      input: self.input_.buffer,
+      output: self.output_.buffer,
+      paced: true
+    }, [image]);
+    self.Poll_();
+  });
+};
+
+SimcttyConsole.prototype.Stop = function() {
+  this.DrainOutput_();
+  if (this.frame_) {
+    cancelAnimationFrame(this.frame_);
+    this.frame_ = 0;
+  }
+};
+
+SimcttyConsole.prototype.Write = function(bytes) {
+  var queued = new Uint8Array(this.queued_.length + bytes.length);
+  queued.set(this.queued_);
+  queued.set(bytes, this.queued_.length);
+  this.queued_ = queued;
+  this.WriteInput_();
+};
+
+SimcttyConsole.prototype.WriteInput_ = function() {
+  if (this.queued_.length > 0) {
+    var written = this.input_.Write(this.queued_);
+    this.queued_ = this.queued_.subarray(written);
+  }
+};
+
+SimcttyConsole.prototype.DrainOutput_ = function() {
+  var length = this.output_.Read(this.chunk_);
+  if (length > 0) {
+    this.options_.output(this.chunk_.slice(0, length));
+  }
+};
+
+// Once per frame, the page's thread may not block on the rings.
+SimcttyConsole.prototype.Poll_ = function() {
+  var self = this;
+  this.WriteInput_();
+  this.DrainOutput_();
+  this.frame_ = requestAnimationFrame(function() {
+    self.Poll_();
+  });
+};
@@ -0,0 +1,112 @@
+// simctty
+// Copyright 2014 Tom Harwood
+
+// Runs the emulator (simctty.js) in a Web Worker, or a Node worker_threads
+// Worker, so the page's thread is free for the UI.
+//
+// Console bytes cross between the page and the guest through two SharedRings,
+// moved in bulk into and out of the emulator's heap once per slice. While the
+// guest is ahead of its nominal 20MHz the worker sleeps on the input ring, so
+// a keypress wakes it at once.
+//
+// Started with one message:
+//   {module: 'simctty.js', image: ArrayBuffer, input: SharedArrayBuffer,
+//    output: SharedArrayBuffer, paced: true}
+// and posts {halted: true} when the guest powers off.
+'use strict';
+
+var is_node = typeof process !== 'undefined' && process.versions &&
+    process.versions.node;
+
+var port = is_node ? require('worker_threads').parentPort : self;
+var SharedRing = is_node ? require('./shared_ring.js') : null;
+
+var kStartAddress = 0x100;
+var kGuestHz = 20000000;
+var kCyclesPerSlice = kGuestHz / 1000;  // 1ms of guest time.
+var kSliceMs = 1000 * kCyclesPerSlice / kGuestHz;
+var kStagingSize = 4096;
+
+function Run(options) {
+  var input = new SharedRing(options.input);
+  var output = new SharedRing(options.output);
+
+  var image = new Uint8Array(options.image);
+  var image_ptr = Module._malloc(image.length);
+  Module.HEAPU8.set(image, image_ptr);
+  Module._sys_load_image(image_ptr, image.length, kStartAddress);
+  Module._free(image_ptr);
+
+  var input_ptr = Module._malloc(kStagingSize);
+  var input_staging = Module.HEAPU8.subarray(input_ptr,
+                                             input_ptr + kStagingSize);
+  var pending = 0;  // Input read from the ring not yet taken by the guest.
+  var output_ptr = Module._malloc(kStagingSize);
+  var output_staging = Module.HEAPU8.subarray(output_ptr,
+                                              output_ptr + kStagingSize);
+
+  var start_ms = Date.now();
+  var slices = 0;
+
+  for (;;) {
+    // Input to the guest, as much as it will take.
+    if (pending === 0) {
+      pending = input.Read(input_staging);
+    }
+    if (pending > 0) {
+      var taken = Module._sys_write_buffer(input_ptr, pending);
+      input_staging.copyWithin(0, taken, pending);
+      pending -= taken;
+    }
+
+    var is_running = Module._sys_run_cycles(kCyclesPerSlice);
+    ++slices;
+
+    // Output from the guest, including the last slice's.
+    while (output.Free() > 0) {
+      var length = Module._sys_read_buffer(
+          output_ptr, Math.min(output.Free(), kStagingSize));
+      if (length === 0) {
+        break;
+      }
+      output.Write(output_staging.subarray(0, length));
+    }
+
+    if (!is_running) {
+      break;
+    }
+
+    if (options.paced) {
+      var ahead_ms = slices * kSliceMs - (Date.now() - start_ms);
+      if (ahead_ms > 0) {
+        input.Wait(ahead_ms);
+      }
+    }
+  }
+
+  port.postMessage({halted: true});
+}
+
+function Start(options) {
+  // Emscripten picks up an existing global Module.
+  var scope = is_node ? global : self;
+  scope.Module = {
+    onRuntimeInitialized: function() {
+      Run(options);
+    }
+  };
+
+  if (is_node) {
+    require(options.module);
+  } else {
+    importScripts('shared_ring.js', options.module);
+  }
+}
+
+if (is_node) {
+  port.once('message', Start);
+} else {
+  port.onmessage = function(event) {
+    Start(event.data);
+  };
+}